@@ -0,0 +1,481 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include "mlua/alloc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mlua/util.h"
+
+// The alignment of all allocations.
+#define ALIGN ((size_t)8)
+
+// Size classes cover blocks up to CLASS_MAX bytes, in steps of CLASS_STEP.
+#define CLASS_STEP ((size_t)8)
+#define CLASS_MAX ((size_t)64)
+#define CLASS_COUNT (CLASS_MAX / CLASS_STEP)
+
+// The heap uses SL_COUNT second-level lists per power of two. Sizes below
+// (1 << FL_SHIFT) are all in the first first-level list.
+#define SL_LOG2 2
+#define SL_COUNT (1u << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + 3)
+#if SIZE_MAX > UINT32_MAX
+#define FL_COUNT 32
+#else
+#define FL_COUNT 24
+#endif
+
+// The maximum size of a heap block.
+#define BLOCK_MAX (((size_t)1 << (FL_COUNT + FL_SHIFT - 1)) - ALIGN)
+
+// A heap block. The free list pointers are only valid if the block is free, and
+// overlap the payload otherwise.
+typedef struct Block Block;
+struct Block {
+    Block* prev;        // The previous block in memory, or NULL
+    size_t size;        // The size of the payload, with FREE in bit 0
+    Block* next_free;   // The next block in the free list
+    Block* prev_free;   // The previous block in the free list
+};
+
+#define FREE ((size_t)1)
+#define HEADER align_up(offsetof(Block, next_free))
+#define MIN_PAYLOAD align_up(sizeof(Block) - offsetof(Block, next_free))
+
+// A page of blocks of a single size class. Pages are carved contiguously from
+// the top of the arena, right above the heap sentinel, so that the page of a
+// block can be computed from its address. The page header is at the start of
+// the page.
+typedef struct Page Page;
+struct Page {
+    Page* next;         // The next page in the list
+    Page* prev;         // The previous page in the list
+    void* free;         // The free blocks in the page
+    uint16_t used;      // The number of used blocks
+    uint8_t cls;        // The size class, or NO_CLASS if the page is empty
+};
+
+#define PAGE_SIZE ((size_t)MLUA_ALLOC_POOL_PAGE_SIZE & ~(ALIGN - 1))
+#define PAGE_HEADER ((sizeof(Page) + (ALIGN - 1)) & ~(ALIGN - 1))
+#define PAGE_PAYLOAD (PAGE_SIZE - PAGE_HEADER)
+#define NO_CLASS UINT8_MAX
+
+_Static_assert(PAGE_PAYLOAD >= CLASS_MAX,
+               "MLUA_ALLOC_POOL_PAGE_SIZE too small");
+_Static_assert(PAGE_PAYLOAD / CLASS_STEP <= UINT16_MAX,
+               "MLUA_ALLOC_POOL_PAGE_SIZE too large");
+
+struct MLuaPool {
+    Block* first;                       // The first block of the heap
+    Block* sentinel;                    // The sentinel at the end of the heap
+    char* top;                          // The end of the arena
+    size_t size;                        // The size of the heap
+    size_t cached;                      // Free memory in the size classes
+    uint32_t fl_bitmap;                 // Non-empty first-level lists
+    uint8_t sl_bitmap[FL_COUNT];        // Non-empty second-level lists
+    Block* free[FL_COUNT][SL_COUNT];    // Heap free lists
+    Page* classes[CLASS_COUNT];         // Pages with free blocks, per class
+    Page* empty;                        // Empty pages
+};
+
+static inline size_t align_up(size_t size) {
+    return (size + (ALIGN - 1)) & ~(ALIGN - 1);
+}
+
+static inline unsigned log2_size(size_t size) {
+#if SIZE_MAX > UINT32_MAX
+    return 63 - __builtin_clzll(size);
+#else
+    return 31 - __builtin_clz(size);
+#endif
+}
+
+static inline size_t block_size(Block const* b) { return b->size & ~FREE; }
+static inline bool block_is_free(Block const* b) { return b->size & FREE; }
+
+static inline void* block_payload(Block* b) { return (char*)b + HEADER; }
+
+static inline Block* payload_block(void* ptr) {
+    return (Block*)((char*)ptr - HEADER);
+}
+
+static inline Block* block_next(Block* b) {
+    return (Block*)((char*)block_payload(b) + block_size(b));
+}
+
+// Compute the free list indexes for a block size.
+static inline void mapping(size_t size, unsigned* fl, unsigned* sl) {
+    if (size < ((size_t)1 << FL_SHIFT)) {
+        *fl = 0;
+        *sl = size / ALIGN;
+        return;
+    }
+    unsigned f = log2_size(size);
+    *fl = f - FL_SHIFT + 1;
+    *sl = (size >> (f - SL_LOG2)) - SL_COUNT;
+}
+
+static void insert_free(MLuaPool* pool, Block* b) {
+    unsigned fl, sl;
+    mapping(block_size(b), &fl, &sl);
+    Block* head = pool->free[fl][sl];
+    b->size |= FREE;
+    b->prev_free = NULL;
+    b->next_free = head;
+    if (head != NULL) head->prev_free = b;
+    pool->free[fl][sl] = b;
+    pool->sl_bitmap[fl] |= 1u << sl;
+    pool->fl_bitmap |= (uint32_t)1 << fl;
+}
+
+static void remove_free(MLuaPool* pool, Block* b) {
+    Block* prev = b->prev_free;
+    Block* next = b->next_free;
+    if (next != NULL) next->prev_free = prev;
+    if (prev != NULL) {
+        prev->next_free = next;
+    } else {
+        unsigned fl, sl;
+        mapping(block_size(b), &fl, &sl);
+        pool->free[fl][sl] = next;
+        if (next == NULL) {
+            pool->sl_bitmap[fl] &= ~(1u << sl);
+            if (pool->sl_bitmap[fl] == 0) {
+                pool->fl_bitmap &= ~((uint32_t)1 << fl);
+            }
+        }
+    }
+    b->size &= ~FREE;
+}
+
+// Find a free block in the list (fl, sl) or any larger list.
+static Block* find_free(MLuaPool* pool, unsigned fl, unsigned sl) {
+    unsigned sl_map = pool->sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        uint32_t fl_map = fl + 1 < 32 ?
+            pool->fl_bitmap & (~(uint32_t)0 << (fl + 1)) : 0;
+        if (fl_map == 0) return NULL;
+        fl = MLUA_CTZ(fl_map);
+        sl_map = pool->sl_bitmap[fl];
+    }
+    return pool->free[fl][MLUA_CTZ(sl_map)];
+}
+
+// Return a free block to the heap, merging it with its free neighbors.
+static void free_block(MLuaPool* pool, Block* b) {
+    Block* next = block_next(b);
+    if (block_is_free(next)) {
+        remove_free(pool, next);
+        b->size = block_size(b) + HEADER + block_size(next);
+        block_next(b)->prev = b;
+    }
+    Block* prev = b->prev;
+    if (prev != NULL && block_is_free(prev)) {
+        remove_free(pool, prev);
+        prev->size = block_size(prev) + HEADER + block_size(b);
+        block_next(prev)->prev = prev;
+        b = prev;
+    }
+    insert_free(pool, b);
+}
+
+// Shrink a used block to the given size, and return the remainder to the heap
+// if it is large enough to form a block.
+static void split(MLuaPool* pool, Block* b, size_t size) {
+    size_t bsize = block_size(b);
+    if (bsize < size + HEADER + MIN_PAYLOAD) return;
+    Block* rest = (Block*)((char*)block_payload(b) + size);
+    rest->prev = b;
+    rest->size = bsize - size - HEADER;
+    b->size = size;
+    block_next(rest)->prev = rest;
+    free_block(pool, rest);
+}
+
+static inline size_t payload_size(size_t size) {
+    return size < MIN_PAYLOAD ? MIN_PAYLOAD : align_up(size);
+}
+
+static void* heap_alloc(MLuaPool* pool, size_t size) {
+    if (size > pool->size) return NULL;
+    size = payload_size(size);
+
+    // Round the size up to the next list boundary, so that any block in the
+    // list found is large enough.
+    size_t search = size;
+    if (search >= ((size_t)1 << FL_SHIFT)) {
+        search += ((size_t)1 << (log2_size(search) - SL_LOG2)) - 1;
+    }
+    unsigned fl, sl;
+    mapping(search, &fl, &sl);
+    if (fl >= FL_COUNT) return NULL;
+    Block* b = find_free(pool, fl, sl);
+    if (b == NULL) return NULL;
+    remove_free(pool, b);
+    split(pool, b, size);
+    return block_payload(b);
+}
+
+static void* heap_realloc(MLuaPool* pool, void* ptr, size_t old_size,
+                          size_t new_size) {
+    if (new_size > pool->size) return NULL;
+    Block* b = payload_block(ptr);
+    size_t size = payload_size(new_size);
+    size_t bsize = block_size(b);
+    if (size <= bsize) {
+        split(pool, b, size);
+        return ptr;
+    }
+
+    // Try to grow in place.
+    Block* next = block_next(b);
+    if (block_is_free(next) && bsize + HEADER + block_size(next) >= size) {
+        remove_free(pool, next);
+        b->size = bsize + HEADER + block_size(next);
+        block_next(b)->prev = b;
+        split(pool, b, size);
+        return ptr;
+    }
+    void* res = heap_alloc(pool, new_size);
+    if (res == NULL) return NULL;
+    memcpy(res, ptr, old_size);
+    free_block(pool, b);
+    return res;
+}
+
+static inline unsigned size_class(size_t size) {
+    return size > 0 ? (size - 1) / CLASS_STEP : 0;
+}
+
+static inline size_t class_size(unsigned cls) {
+    return (cls + 1) * CLASS_STEP;
+}
+
+static inline size_t class_count(unsigned cls) {
+    return PAGE_PAYLOAD / class_size(cls);
+}
+
+static void page_push(Page** head, Page* p) {
+    p->prev = NULL;
+    p->next = *head;
+    if (*head != NULL) (*head)->prev = p;
+    *head = p;
+}
+
+static void page_remove(Page** head, Page* p) {
+    if (p->next != NULL) p->next->prev = p->prev;
+    if (p->prev != NULL) {
+        p->prev->next = p->next;
+    } else {
+        *head = p->next;
+    }
+}
+
+// Return the lowest page of the page region. The region is empty if it is
+// equal to pool->top.
+static inline Page* pages_bottom(MLuaPool const* pool) {
+    return (Page*)((char*)pool->sentinel + HEADER);
+}
+
+// Return true iff the given block was allocated from a page.
+static inline bool in_pages(MLuaPool const* pool, void* ptr) {
+    return (char*)ptr >= (char*)pages_bottom(pool);
+}
+
+// Return the page containing the given block.
+static inline Page* block_page(MLuaPool const* pool, void* ptr) {
+    size_t index = (size_t)(pool->top - (char*)ptr - 1) / PAGE_SIZE;
+    return (Page*)(pool->top - (index + 1) * PAGE_SIZE);
+}
+
+// Grow the page region by one page, taken from the free block at the end of
+// the heap. Returns NULL if that block is used or too small.
+static Page* grow_pages(MLuaPool* pool) {
+    Block* last = pool->sentinel->prev;
+    if (!block_is_free(last) || block_size(last) < PAGE_SIZE + MIN_PAYLOAD) {
+        return NULL;
+    }
+    remove_free(pool, last);
+    last->size -= PAGE_SIZE;
+    Block* sentinel = block_next(last);
+    sentinel->prev = last;
+    sentinel->size = 0;
+    pool->sentinel = sentinel;
+    insert_free(pool, last);
+    return pages_bottom(pool);
+}
+
+// Return the empty pages at the bottom of the page region to the heap.
+static void release_pages(MLuaPool* pool) {
+    for (;;) {
+        Page* p = pages_bottom(pool);
+        if ((char*)p == pool->top || p->cls != NO_CLASS) return;
+        page_remove(&pool->empty, p);
+        pool->cached -= PAGE_PAYLOAD;
+        Block* sentinel = pool->sentinel;
+        Block* last = sentinel->prev;
+        if (block_is_free(last)) {
+            remove_free(pool, last);
+            last->size += PAGE_SIZE;
+        } else {
+            // The old sentinel becomes a block spanning the page.
+            sentinel->size = PAGE_SIZE - HEADER;
+            last = sentinel;
+        }
+        sentinel = block_next(last);
+        sentinel->prev = last;
+        sentinel->size = 0;
+        pool->sentinel = sentinel;
+        insert_free(pool, last);
+    }
+}
+
+// Set up a page for a size class, taking an empty page if there is one, or
+// growing the page region otherwise.
+static Page* new_page(MLuaPool* pool, unsigned cls) {
+    Page* p = pool->empty;
+    if (p != NULL) {
+        page_remove(&pool->empty, p);
+        pool->cached -= PAGE_PAYLOAD;
+    } else {
+        p = grow_pages(pool);
+        if (p == NULL) return NULL;
+    }
+    size_t size = class_size(cls);
+    size_t count = class_count(cls);
+    char* data = (char*)p + PAGE_HEADER;
+    void* head = NULL;
+    for (size_t i = count; i-- > 0;) {
+        void** blk = (void**)(data + i * size);
+        *blk = head;
+        head = blk;
+    }
+    p->free = head;
+    p->used = 0;
+    p->cls = cls;
+    page_push(&pool->classes[cls], p);
+    pool->cached += count * size;
+    return p;
+}
+
+static void* class_alloc(MLuaPool* pool, unsigned cls) {
+    Page* p = pool->classes[cls];
+    if (p == NULL) {
+        p = new_page(pool, cls);
+        if (p == NULL) return NULL;
+    }
+    void** blk = p->free;
+    p->free = *blk;
+    ++p->used;
+    if (p->free == NULL) page_remove(&pool->classes[cls], p);
+    pool->cached -= class_size(cls);
+    return blk;
+}
+
+// Return a block to its page. Empty pages become available to all size
+// classes, and are returned to the heap when they reach the bottom of the page
+// region.
+static void class_free(MLuaPool* pool, void* ptr) {
+    Page* p = block_page(pool, ptr);
+    unsigned cls = p->cls;
+    if (p->free == NULL) page_push(&pool->classes[cls], p);
+    *(void**)ptr = p->free;
+    p->free = ptr;
+    pool->cached += class_size(cls);
+    if (--p->used > 0) return;
+    page_remove(&pool->classes[cls], p);
+    pool->cached -= class_count(cls) * class_size(cls);
+    p->cls = NO_CLASS;
+    page_push(&pool->empty, p);
+    pool->cached += PAGE_PAYLOAD;
+    release_pages(pool);
+}
+
+MLuaPool* mlua_pool_init(void* mem, size_t size) {
+    uintptr_t start = align_up((uintptr_t)mem);
+    uintptr_t end = ((uintptr_t)mem + size) & ~(uintptr_t)(ALIGN - 1);
+    MLuaPool* pool = (MLuaPool*)start;
+    start = align_up(start + sizeof(MLuaPool));
+    if (end < start || end - start < 2 * HEADER + MIN_PAYLOAD) return NULL;
+    if (end - start - 2 * HEADER > BLOCK_MAX) {
+        end = start + 2 * HEADER + BLOCK_MAX;
+    }
+    memset(pool, 0, sizeof(*pool));
+    pool->size = end - start;
+
+    // Set up a single free block, followed by a zero-sized sentinel that is
+    // never free.
+    Block* b = (Block*)start;
+    b->prev = NULL;
+    b->size = end - start - 2 * HEADER;
+    Block* sentinel = block_next(b);
+    sentinel->prev = b;
+    sentinel->size = 0;
+    pool->first = b;
+    pool->sentinel = sentinel;
+    pool->top = (char*)end;
+    insert_free(pool, b);
+    return pool;
+}
+
+void* mlua_pool_alloc(MLuaPool* pool, size_t size) {
+    if (size <= CLASS_MAX) {
+        void* ptr = class_alloc(pool, size_class(size));
+        if (ptr != NULL) return ptr;
+        // The page region can't grow. Fall back to a heap block.
+    }
+    return heap_alloc(pool, size);
+}
+
+void mlua_pool_free(MLuaPool* pool, void* ptr, size_t size) {
+    if (ptr == NULL) return;
+    if (in_pages(pool, ptr)) {
+        class_free(pool, ptr);
+    } else {
+        free_block(pool, payload_block(ptr));
+    }
+}
+
+void* mlua_pool_realloc(MLuaPool* pool, void* ptr, size_t old_size,
+                        size_t new_size) {
+    if (ptr == NULL) return mlua_pool_alloc(pool, new_size);
+    if (in_pages(pool, ptr)) {
+        if (new_size <= CLASS_MAX
+                && size_class(new_size) == block_page(pool, ptr)->cls) {
+            return ptr;
+        }
+        void* res = mlua_pool_alloc(pool, new_size);
+        if (res == NULL) {
+            // Shrinking must not fail. The block stays in its larger class.
+            return new_size <= old_size ? ptr : NULL;
+        }
+        memcpy(res, ptr, old_size < new_size ? old_size : new_size);
+        class_free(pool, ptr);
+        return res;
+    }
+    if (new_size <= CLASS_MAX) {
+        void* res = class_alloc(pool, size_class(new_size));
+        if (res != NULL) {
+            memcpy(res, ptr, old_size < new_size ? old_size : new_size);
+            free_block(pool, payload_block(ptr));
+            return res;
+        }
+    }
+    return heap_realloc(pool, ptr, old_size, new_size);
+}
+
+void mlua_pool_stats(MLuaPool const* pool, MLuaPoolStats* stats) {
+    stats->size = pool->size;
+    stats->free = 0;
+    stats->largest = 0;
+    stats->cached = pool->cached;
+    for (Block* b = pool->first; block_size(b) != 0; b = block_next(b)) {
+        if (!block_is_free(b)) continue;
+        size_t size = block_size(b);
+        stats->free += size;
+        if (size > stats->largest) stats->largest = size;
+    }
+}
@@ -0,0 +1,144 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#ifndef _MLUA_CORE_ALLOC_H
+#define _MLUA_CORE_ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mlua/module.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The size of the arena from which the pool allocator carves all allocations
+// of an interpreter.
+#ifndef MLUA_ALLOC_POOL_SIZE
+#define MLUA_ALLOC_POOL_SIZE MLUA_ALLOC_POOL_SIZE_DEFAULT
+#endif
+
+// The size of the pages that are split into blocks of a size class.
+#ifndef MLUA_ALLOC_POOL_PAGE_SIZE
+#define MLUA_ALLOC_POOL_PAGE_SIZE 512
+#endif
+
+// A memory pool. Small blocks are allocated from segregated size classes,
+// larger blocks from a two-level segregated fit (TLSF) heap. All memory is
+// carved out of a fixed arena.
+typedef struct MLuaPool MLuaPool;
+
+// Statistics about a memory pool.
+typedef struct MLuaPoolStats {
+    size_t size;        // Size of the arena
+    size_t free;        // Free memory in the heap
+    size_t largest;     // Largest free block in the heap
+    size_t cached;      // Free memory in the size class lists
+} MLuaPoolStats;
+
+// Initialize a memory pool in the given memory block. Returns NULL if the block
+// is too small.
+MLuaPool* mlua_pool_init(void* mem, size_t size);
+
+// Allocate a block of memory. Returns NULL if the pool is exhausted.
+void* mlua_pool_alloc(MLuaPool* pool, size_t size);
+
+// Free a block of memory. "size" must be the size of the block, as passed to
+// mlua_pool_alloc() or mlua_pool_realloc().
+void mlua_pool_free(MLuaPool* pool, void* ptr, size_t size);
+
+// Resize a block of memory. The block is unchanged if the allocation fails.
+void* mlua_pool_realloc(MLuaPool* pool, void* ptr, size_t old_size,
+                        size_t new_size);
+
+// Compute statistics about a memory pool.
+void mlua_pool_stats(MLuaPool const* pool, MLuaPoolStats* stats);
+
+// The default number of bytes allocated between two samples of the allocation
+// profiler.
+#ifndef MLUA_ALLOC_PROFILE_INTERVAL
+#define MLUA_ALLOC_PROFILE_INTERVAL 4096
+#endif
+
+// The maximum number of distinct call stacks recorded by the allocation
+// profiler.
+#ifndef MLUA_ALLOC_PROFILE_STACKS
+#define MLUA_ALLOC_PROFILE_STACKS 64
+#endif
+
+// The maximum number of frames recorded per call stack. Deeper stacks are
+// truncated at the caller side.
+#ifndef MLUA_ALLOC_PROFILE_DEPTH
+#define MLUA_ALLOC_PROFILE_DEPTH 8
+#endif
+
+// The maximum number of distinct functions recorded by the allocation
+// profiler.
+#ifndef MLUA_ALLOC_PROFILE_FRAMES
+#define MLUA_ALLOC_PROFILE_FRAMES 128
+#endif
+
+// The maximum length of the name of a function recorded by the allocation
+// profiler, including the terminating zero.
+#ifndef MLUA_ALLOC_PROFILE_NAME
+#define MLUA_ALLOC_PROFILE_NAME 48
+#endif
+
+// The frame index used when the frame table is full.
+#define MLUA_ALLOC_PROFILE_NO_FRAME UINT16_MAX
+
+// A function recorded by the allocation profiler.
+typedef struct MLuaAllocFrame {
+    uint32_t hash;                          // Hash of the name
+    char name[MLUA_ALLOC_PROFILE_NAME];     // "name (source:line)"
+} MLuaAllocFrame;
+
+// A call stack recorded by the allocation profiler.
+typedef struct MLuaAllocStack {
+    uint32_t hash;                                  // Hash of the frames
+    uint8_t depth;                                  // Number of frames
+    bool truncated;                                 // Callers are missing
+    uint16_t frames[MLUA_ALLOC_PROFILE_DEPTH];      // Frame indexes, leaf first
+    size_t count;                                   // Allocations
+    size_t size;                                    // Bytes allocated
+} MLuaAllocStack;
+
+// The state of the allocation profiler. Every "interval" bytes, the allocator
+// records the Lua call stack of the running thread, and attributes the
+// allocations performed since the previous sample to it.
+typedef struct MLuaAllocProfile {
+    bool active;                // True while sampling
+    size_t interval;            // Sampling interval, in bytes
+    size_t pending_count;       // Allocations since the last sample
+    size_t pending_size;        // Bytes allocated since the last sample
+    size_t dropped_count;       // Allocations not attributed (stacks full)
+    size_t dropped_size;        // Bytes not attributed (stacks full)
+    uint16_t nframes;           // Number of recorded frames
+    uint16_t nstacks;           // Number of recorded stacks
+    MLuaAllocFrame frames[MLUA_ALLOC_PROFILE_FRAMES];
+    MLuaAllocStack stacks[MLUA_ALLOC_PROFILE_STACKS];
+} MLuaAllocProfile;
+
+#if MLUA_ALLOC_PROFILE
+
+// Clear the allocation profile and start sampling every "interval" bytes.
+// Returns false if the profile couldn't be allocated.
+bool mlua_alloc_profile_start(lua_State* ls, size_t interval);
+
+// Stop sampling. The recorded profile is kept until the next start.
+void mlua_alloc_profile_stop(lua_State* ls);
+
+// Return the recorded allocation profile, or NULL if the profiler was never
+// started. Entries are only ever appended, so the profile can be iterated
+// while sampling is active.
+MLuaAllocProfile const* mlua_alloc_profile(lua_State* ls);
+
+#endif  // MLUA_ALLOC_PROFILE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
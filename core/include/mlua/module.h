@@ -10,6 +10,9 @@
 #include "lua.h"
 #include "lauxlib.h"
 #include "mlua/platform.h"
+#if MLUA_ALLOC_BUDGET && LIB_MLUA_MOD_MLUA_THREAD
+#include "mlua/event.h"
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,24 +30,139 @@ extern "C" {
 #define MLUA_SYMBOL_HASH_DEBUG 0
 #endif
 
+// The estimated number of bytes per interpreter that can be used to cache
+// symbols resolved through hashed symbol tables. Resolved symbols are stored
+// into the module or class table on first use, so that subsequent lookups
+// don't go through the hash. Zero disables the cache.
+#ifndef MLUA_SYMBOL_CACHE_SIZE
+#define MLUA_SYMBOL_CACHE_SIZE 0
+#endif
+
 // Enable memory allocation statistics.
 #ifndef MLUA_ALLOC_STATS
 #define MLUA_ALLOC_STATS 0
 #endif
 
+// Enable per-type and per-size allocation statistics. Requires
+// MLUA_ALLOC_STATS, and prefixes each allocated block with a small header
+// recording the type of the object.
+#ifndef MLUA_ALLOC_STATS_DETAIL
+#define MLUA_ALLOC_STATS_DETAIL 0
+#endif
+
+// Enable the per-interpreter memory budget. Allocations that would exceed the
+// hard limit fail after an emergency collection, and crossing the soft
+// watermark sets an event.
+#ifndef MLUA_ALLOC_BUDGET
+#define MLUA_ALLOC_BUDGET 0
+#endif
+
+// The initial hard limit of the memory budget, in bytes. Zero means no limit.
+#ifndef MLUA_ALLOC_BUDGET_LIMIT
+#define MLUA_ALLOC_BUDGET_LIMIT 0
+#endif
+
+// The initial soft watermark of the memory budget, in bytes. Zero means no
+// watermark.
+#ifndef MLUA_ALLOC_BUDGET_WATERMARK
+#define MLUA_ALLOC_BUDGET_WATERMARK 0
+#endif
+
+// Enable the sampling allocation profiler. See mlua/alloc.h.
+#ifndef MLUA_ALLOC_PROFILE
+#define MLUA_ALLOC_PROFILE 0
+#endif
+
+// Allocate Lua memory from a per-interpreter pool with size classes, instead of
+// using realloc() and free(). See mlua/alloc.h.
+#ifndef MLUA_ALLOC_POOL
+#define MLUA_ALLOC_POOL 0
+#endif
+
+// Enable garbage collector statistics, i.e. a histogram of the time spent in
+// collector steps and full collections.
+#ifndef MLUA_GC_STATS
+#define MLUA_GC_STATS 0
+#endif
+
+// The number of buckets of the GC pause histogram. Bucket i counts pauses of
+// [2^(i-1), 2^i) microseconds.
+#ifndef MLUA_GC_STATS_BUCKETS
+#define MLUA_GC_STATS_BUCKETS 24
+#endif
+
+// Enable module loading statistics, i.e. the time, the number of allocations
+// and the memory retained by each module loaded through require().
+#ifndef MLUA_REQUIRE_STATS
+#define MLUA_REQUIRE_STATS 0
+#endif
+
+// Write a report of the module loading statistics to stderr when closing the
+// interpreter. Requires MLUA_REQUIRE_STATS.
+#ifndef MLUA_REQUIRE_STATS_REPORT
+#define MLUA_REQUIRE_STATS_REPORT 0
+#endif
+
 // Enable thread statistics.
 #ifndef MLUA_THREAD_STATS
 #define MLUA_THREAD_STATS 0
 #endif
 
+#if MLUA_ALLOC_STATS_DETAIL
+// The number of object types tracked by the detailed allocation statistics,
+// indexed by the basic type tag passed to the allocator.
+#define MLUA_ALLOC_TYPES 16
+
+// The number of power-of-two size buckets tracked by the detailed allocation
+// statistics. Bucket i holds blocks of (2^(i-1), 2^i] bytes.
+#define MLUA_ALLOC_SIZES 32
+
+// Live allocation counters.
+typedef struct MLuaAllocCount {
+    size_t count;   // Number of live blocks
+    size_t size;    // Total size of live blocks
+} MLuaAllocCount;
+#endif
+
 // Per-interpreter global state.
 typedef struct MLuaGlobal {
 #if MLUA_ALLOC_STATS
     size_t alloc_count;     // Number of memory allocation
     size_t alloc_size;      // Sum of all memory allocations
-    size_t alloc_used;      // Memory currently used
     size_t alloc_peak;      // Peak memory usage
 #endif
+#if MLUA_ALLOC_STATS || MLUA_ALLOC_BUDGET
+    size_t alloc_used;      // Memory currently used
+#endif
+#if MLUA_ALLOC_BUDGET
+    size_t alloc_limit;     // Hard limit on memory usage
+    size_t alloc_watermark; // Soft watermark on memory usage
+#if LIB_MLUA_MOD_MLUA_THREAD
+    MLuaEvent alloc_event;  // Set when crossing the watermark
+#endif
+#endif
+#if MLUA_ALLOC_STATS_DETAIL
+    MLuaAllocCount alloc_types[MLUA_ALLOC_TYPES];   // Per object type
+    MLuaAllocCount alloc_sizes[MLUA_ALLOC_SIZES];   // Per size bucket
+#endif
+#if MLUA_ALLOC_POOL
+    struct MLuaPool* alloc_pool;    // Memory pool
+#endif
+#if MLUA_ALLOC_PROFILE
+    struct MLuaAllocProfile* alloc_profile; // Allocation profile
+    lua_State* alloc_running;               // Thread sampled by the profiler
+#endif
+#if MLUA_GC_STATS
+    uint64_t gc_time;       // Total time spent in the collector
+    uint32_t gc_max;        // Longest collector pause
+    uint32_t gc_pauses[MLUA_GC_STATS_BUCKETS];  // Pause histogram
+#endif
+#if MLUA_REQUIRE_STATS
+    struct MLuaRequireStats* require_stats; // Module loading statistics
+#endif
+#if MLUA_HASH_SYMBOL_TABLES && MLUA_SYMBOL_CACHE_SIZE
+    size_t symbol_cache_used;   // Memory used by the symbol cache
+#endif
 #if LIB_MLUA_MOD_MLUA_THREAD && MLUA_THREAD_STATS
     lua_Unsigned thread_dispatches;     // Number of event dispatch cycles
     lua_Unsigned thread_waits;          // Number of event waits
@@ -219,14 +337,15 @@ typedef struct MLuaSymHash {
     uint32_t seed1, seed2;
     uint16_t nkeys, ng;
     uint8_t bits;
+    bool words;  // Hash keys one word at a time instead of one byte at a time
 } MLuaSymHash;
 
 // Define a symbol hash for a symbol table.
-#define MLUA_SYMBOLS_HASH_FN_HASH(n, s1, s2, nk, nb, ngv, ...) \
+#define MLUA_SYMBOLS_HASH_FN_HASH(n, w, s1, s2, nk, nb, ngv, ...) \
 static uint8_t const n ## _hash_g[] = {__VA_ARGS__}; \
 static MLuaSymHash const n ## _hash = { \
     .fields = n, .g = n ## _hash_g, .seed1 = s1, .seed2 = s2, \
-    .nkeys = nk, .ng = ngv, .bits = nb, \
+    .nkeys = nk, .ng = ngv, .bits = nb, .words = w, \
 };
 
 // An empty symbol table. Useful for classes without metamethods.
@@ -290,32 +409,68 @@ void mlua_new_class_hash_(lua_State* ls, char const* name, int cnt,
 // instances.
 void mlua_set_metaclass(lua_State* ls);
 
+// The maximum length of module names.
+#define MLUA_MODULE_NAME_MAX 64
+
+// Compute the hash of a module name at compile time. The hash is FNV-1a over
+// the bytes of the name, and must match module_hash() in module.c.
+#define MLUA_MODULE_HASH(s) \
+    MLUA_MODULE_HASH_8(s, 56, MLUA_MODULE_HASH_8(s, 48, \
+    MLUA_MODULE_HASH_8(s, 40, MLUA_MODULE_HASH_8(s, 32, \
+    MLUA_MODULE_HASH_8(s, 24, MLUA_MODULE_HASH_8(s, 16, \
+    MLUA_MODULE_HASH_8(s, 8, MLUA_MODULE_HASH_8(s, 0, 0x811c9dc5u))))))))
+#define MLUA_MODULE_HASH_8(s, i, h) \
+    MLUA_MODULE_HASH_1(s, i + 7, MLUA_MODULE_HASH_1(s, i + 6, \
+    MLUA_MODULE_HASH_1(s, i + 5, MLUA_MODULE_HASH_1(s, i + 4, \
+    MLUA_MODULE_HASH_1(s, i + 3, MLUA_MODULE_HASH_1(s, i + 2, \
+    MLUA_MODULE_HASH_1(s, i + 1, MLUA_MODULE_HASH_1(s, i, h))))))))
+#define MLUA_MODULE_HASH_1(s, i, h) \
+    (((uint32_t)(h) ^ ((i) < sizeof(s) - 1 ? (uint8_t)(s)[(i)] : 0u)) \
+     * ((i) < sizeof(s) - 1 ? 0x01000193u : 1u))
+
 // A module registry entry.
 typedef struct MLuaModule {
     char const* name;
     lua_CFunction open;
+    uint32_t hash;
 } MLuaModule;
 
 // Define a function to open a module with the given name, and register it.
 #define MLUA_OPEN_MODULE(n) \
 MLUA_PLATFORM_REGISTER_MODULE(n); \
+_Static_assert(sizeof(#n) <= MLUA_MODULE_NAME_MAX + 1, "module name too long"); \
 static int mlua_open_module(lua_State* ls); \
 static MLuaModule const module \
     __attribute__((__section__("mlua_module_registry"), __used__)) \
-    = {.name = #n, .open = &mlua_open_module}; \
+    = {.name = #n, .open = &mlua_open_module, .hash = MLUA_MODULE_HASH(#n)}; \
 static int mlua_open_module(lua_State* ls)
 
 // Register a module open function.
 #define MLUA_REGISTER_MODULE(n, fn) \
 MLUA_PLATFORM_REGISTER_MODULE(n); \
+_Static_assert(sizeof(#n) <= MLUA_MODULE_NAME_MAX + 1, "module name too long"); \
 int fn(lua_State* ls); \
 static MLuaModule const module \
     __attribute__((__section__("mlua_module_registry"), __used__)) \
-    = {.name = #n, .open = fn}
+    = {.name = #n, .open = fn, .hash = MLUA_MODULE_HASH(#n)}
+
+// Load a Lua chunk compressed by the "luamod" command of tools/gen.lua, and
+// push it as a function, like luaL_loadbufferx(). The chunk is decompressed
+// incrementally, through a window of 1 kB.
+int mlua_load_compressed(lua_State* ls, char const* data, size_t size,
+                         char const* name, char const* mode);
 
 // Populate package.preload with all comiled-in modules.
 void mlua_register_modules(lua_State* ls);
 
+// Push a report of the module loading statistics, sorted by decreasing time
+// spent loading each module, excluding nested requires. Pushes nil if module
+// loading statistics are disabled.
+void mlua_push_require_report(lua_State* ls);
+
+// Free the module loading statistics of an interpreter.
+void mlua_free_require_stats(MLuaGlobal* g);
+
 #ifdef __cplusplus
 }
 #endif
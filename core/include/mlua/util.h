@@ -71,13 +71,21 @@ void* mlua_check_userdata(lua_State* ls, int arg);
 // Raises an error if the argument is not a userdata or nil.
 void* mlua_check_userdata_or_nil(lua_State* ls, int arg);
 
-// A buffer vtable.
+// A buffer vtable. "read", "write", "fill" and "find" may be NULL if "span" is
+// provided, in which case the generic span-based implementations are used.
 typedef struct MLuaBufferVt {
     void (*read)(void*, lua_Unsigned, lua_Unsigned, void*);
     void (*write)(void*, lua_Unsigned, lua_Unsigned, void const*);
     void (*fill)(void*, lua_Unsigned, lua_Unsigned, int);
     lua_Unsigned (*find)(void*, lua_Unsigned, lua_Unsigned, void const*,
                          lua_Unsigned);
+
+    // Return a pointer to the contiguous span of the buffer starting at the
+    // given offset, and set *len to its length. Return NULL at the end of the
+    // buffer. The last argument points to a per-iteration state, which is NULL
+    // on the first call. Subsequent calls of an iteration request the span
+    // immediately following the previous one. Optional.
+    void* (*span)(void*, lua_Unsigned, lua_Unsigned*, void**);
 } MLuaBufferVt;
 
 // The parameters returned by the buffer protocol. When vt is NULL, the buffer
@@ -96,33 +104,94 @@ bool mlua_get_buffer(lua_State* ls, int arg, MLuaBuffer* buf);
 // pointer and size. Also accepts a string.
 bool mlua_get_ro_buffer(lua_State* ls, int arg, MLuaBuffer* buf);
 
+// Return true iff the contents of the buffer can be accessed span by span.
+static inline bool mlua_buffer_has_spans(MLuaBuffer const* buf) {
+    return buf->vt == NULL || buf->vt->span != NULL;
+}
+
+// An iterator over the spans of a range of a buffer.
+typedef struct MLuaBufferIter {
+    MLuaBuffer const* buf;
+    lua_Unsigned off;
+    lua_Unsigned end;
+    void* state;
+} MLuaBufferIter;
+
+// Initialize a span iterator over a range of a buffer. The buffer must support
+// span access.
+static inline void mlua_buffer_iter_init(
+        MLuaBufferIter* it, MLuaBuffer const* buf, lua_Unsigned off,
+        lua_Unsigned len) {
+    it->buf = buf;
+    it->off = off;
+    it->end = off + len;
+    it->state = NULL;
+}
+
+// Return a pointer to the next span of the range, and set *len to its length.
+// Return NULL when the range is exhausted.
+static inline void* mlua_buffer_iter_next(MLuaBufferIter* it,
+                                          lua_Unsigned* len) {
+    lua_Unsigned rem = it->end - it->off;
+    if (rem == 0) return NULL;
+    void* ptr;
+    if (it->buf->vt == NULL) {
+        ptr = it->buf->ptr + it->off;
+        *len = rem;
+    } else {
+        ptr = it->buf->vt->span(it->buf->ptr, it->off, len, &it->state);
+        if (ptr == NULL || *len == 0) return NULL;
+        if (*len > rem) *len = rem;
+    }
+    it->off += *len;
+    return ptr;
+}
+
+// Generic implementations of the buffer operations, for buffers that only
+// provide span access.
+void mlua_buffer_read_spans(MLuaBuffer const* buf, lua_Unsigned off,
+                            lua_Unsigned len, void* dest);
+void mlua_buffer_write_spans(MLuaBuffer const* buf, lua_Unsigned off,
+                             lua_Unsigned len, void const* src);
+void mlua_buffer_fill_spans(MLuaBuffer const* buf, lua_Unsigned off,
+                            lua_Unsigned len, int value);
+lua_Unsigned mlua_buffer_find_spans(
+    MLuaBuffer const* buf, lua_Unsigned off, lua_Unsigned len,
+    void const* needle, lua_Unsigned needle_len);
+
 // Read from a buffer.
 static inline void mlua_buffer_read(MLuaBuffer const* buf, lua_Unsigned off,
                                     lua_Unsigned len, void* dest) {
-    if (buf->vt != NULL) {
+    if (buf->vt == NULL) {
+        memcpy(dest, buf->ptr + off, len);
+    } else if (buf->vt->read != NULL) {
         buf->vt->read(buf->ptr, off, len, dest);
     } else {
-        memcpy(dest, buf->ptr + off, len);
+        mlua_buffer_read_spans(buf, off, len, dest);
     }
 }
 
 // Write to a buffer.
 static inline void mlua_buffer_write(MLuaBuffer const* buf, lua_Unsigned off,
                                      lua_Unsigned len, void const* src) {
-    if (buf->vt != NULL) {
+    if (buf->vt == NULL) {
+        memcpy(buf->ptr + off, src, len);
+    } else if (buf->vt->write != NULL) {
         buf->vt->write(buf->ptr, off, len, src);
     } else {
-        memcpy(buf->ptr + off, src, len);
+        mlua_buffer_write_spans(buf, off, len, src);
     }
 }
 
 // Fill a part of a buffer.
 static inline void mlua_buffer_fill(MLuaBuffer const* buf, lua_Unsigned off,
                                     lua_Unsigned len, int value) {
-    if (buf->vt != NULL) {
+    if (buf->vt == NULL) {
+        memset(buf->ptr + off, value, len);
+    } else if (buf->vt->fill != NULL) {
         buf->vt->fill(buf->ptr, off, len, value);
     } else {
-        memset(buf->ptr + off, value, len);
+        mlua_buffer_fill_spans(buf, off, len, value);
     }
 }
 
@@ -130,14 +199,40 @@ static inline void mlua_buffer_fill(MLuaBuffer const* buf, lua_Unsigned off,
 static inline lua_Unsigned mlua_buffer_find(
         MLuaBuffer const* buf, lua_Unsigned off, lua_Unsigned len,
         void const* needle, lua_Unsigned needle_len) {
-    if (buf->vt != NULL) {
-        return buf->vt->find(buf->ptr, off, len, needle, needle_len);
-    } else {
+    if (buf->vt == NULL) {
         void const* pos = memmem(buf->ptr + off, len, needle, needle_len);
         return pos != NULL ? (lua_Unsigned)(pos - buf->ptr) : LUA_MAXUNSIGNED;
+    } else if (buf->vt->find != NULL) {
+        return buf->vt->find(buf->ptr, off, len, needle, needle_len);
+    } else {
+        return mlua_buffer_find_spans(buf, off, len, needle, needle_len);
     }
 }
 
+// Call fn(ctx, ptr, len) for consecutive pieces of a range of a buffer. The
+// pieces are the buffer spans if the buffer supports span access, or chunks
+// read into a temporary buffer otherwise.
+void mlua_buffer_visit(MLuaBuffer const* buf, lua_Unsigned off,
+                       lua_Unsigned len,
+                       void (*fn)(void*, void const*, lua_Unsigned), void* ctx);
+
+// Copy a range of a buffer to another buffer. Overlapping ranges are only
+// supported for raw buffers.
+void mlua_buffer_copy(MLuaBuffer const* dest, lua_Unsigned dest_off,
+                      MLuaBuffer const* src, lua_Unsigned src_off,
+                      lua_Unsigned len);
+
+// Compare a range of a buffer with a range of another buffer. Returns a
+// negative value, zero or a positive value, like memcmp().
+int mlua_buffer_compare(MLuaBuffer const* a, lua_Unsigned a_off,
+                        MLuaBuffer const* b, lua_Unsigned b_off,
+                        lua_Unsigned len);
+
+// Compute the Internet checksum (RFC 1071) of a range of a buffer, starting
+// from the given partial sum. The result isn't complemented.
+uint16_t mlua_buffer_inet_checksum(MLuaBuffer const* buf, lua_Unsigned off,
+                                   lua_Unsigned len, uint16_t sum);
+
 // Push a failure and an error message, and return the number of pushed values.
 int mlua_push_fail(lua_State* ls, char const* err);
 
@@ -51,6 +51,13 @@
 #define LUAL_BUFFERSIZE MLUA_BUFFERSIZE
 #endif
 
+// When GC statistics are enabled, redirect the calls to the collector from the
+// Lua core to the instrumented wrappers in main.c.
+#if MLUA_GC_STATS && defined(LUA_CORE) && !defined(lgc_c)
+#define luaC_step mlua_gc_step
+#define luaC_fullgc mlua_gc_fullgc
+#endif
+
 // lua_writestring and lua_writeline are only used by print(), which we override
 // in main.c.
 #define lua_writestring(s, l) do { (void)s; (void)l; } while (0)
@@ -4,9 +4,15 @@
 #include "mlua/main.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if MLUA_GC_STATS
+#include "lgc.h"
+#endif
+#include "mlua/alloc.h"
 #include "mlua/module.h"
 #include "mlua/platform.h"
 #if LIB_MLUA_MOD_MLUA_THREAD
@@ -79,28 +85,301 @@ static int pmain(lua_State* ls) {
     return lua_call(ls, 0, 1), 1;
 }
 
+static inline void* block_realloc(MLuaGlobal* g, void* ptr, size_t old_size,
+                                  size_t new_size) {
+#if MLUA_ALLOC_POOL
+    if (new_size == 0) {
+        mlua_pool_free(g->alloc_pool, ptr, old_size);
+        return NULL;
+    }
+    return mlua_pool_realloc(g->alloc_pool, ptr, old_size, new_size);
+#else
+    (void)g; (void)old_size;
+    if (new_size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    return realloc(ptr, new_size);
+#endif
+}
+
+#if MLUA_ALLOC_STATS_DETAIL
+
+// The header prepended to each block, recording the type of the object.
+typedef union AllocHeader {
+    uint8_t type;
+    max_align_t align;
+} AllocHeader;
+
+static inline unsigned size_bucket(size_t size) {
+    if (size <= 1) return 0;
+    unsigned i = sizeof(unsigned long long) * 8
+                 - __builtin_clzll((unsigned long long)(size - 1));
+    return i < MLUA_ALLOC_SIZES ? i : MLUA_ALLOC_SIZES - 1;
+}
+
+static inline void detail_add(MLuaGlobal* g, unsigned type, size_t size) {
+    MLuaAllocCount* c = &g->alloc_types[type];
+    ++c->count;
+    c->size += size;
+    c = &g->alloc_sizes[size_bucket(size)];
+    ++c->count;
+    c->size += size;
+}
+
+static inline void detail_sub(MLuaGlobal* g, unsigned type, size_t size) {
+    MLuaAllocCount* c = &g->alloc_types[type];
+    --c->count;
+    c->size -= size;
+    c = &g->alloc_sizes[size_bucket(size)];
+    --c->count;
+    c->size -= size;
+}
+
+#endif  // MLUA_ALLOC_STATS_DETAIL
+
+#if MLUA_ALLOC_PROFILE
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+static uint32_t hash_bytes(uint32_t hash, void const* data, size_t len) {
+    uint8_t const* p = data;
+    for (size_t i = 0; i < len; ++i) hash = (hash ^ p[i]) * FNV_PRIME;
+    return hash;
+}
+
+static size_t append_str(char* buf, size_t len, char const* s) {
+    while (*s != '\0' && len < MLUA_ALLOC_PROFILE_NAME - 1) buf[len++] = *s++;
+    buf[len] = '\0';
+    return len;
+}
+
+static size_t append_int(char* buf, size_t len, int value) {
+    char tmp[12];
+    char* p = tmp + sizeof(tmp);
+    *--p = '\0';
+    unsigned v = value < 0 ? -(unsigned)value : (unsigned)value;
+    do { *--p = '0' + v % 10; v /= 10; } while (v != 0);
+    if (value < 0) *--p = '-';
+    return append_str(buf, len, p);
+}
+
+// Format a frame as "name (source:line)" for Lua functions, and "name [C]" for
+// C functions. The name is omitted if unknown.
+static void format_frame(char* buf, lua_Debug const* ar) {
+    size_t len = 0;
+    buf[0] = '\0';
+    if (ar->name != NULL) len = append_str(buf, len, ar->name);
+    if (ar->what[0] == 'C') {
+        if (len > 0) len = append_str(buf, len, " ");
+        append_str(buf, len, "[C]");
+        return;
+    }
+    if (len > 0) len = append_str(buf, len, " (");
+    len = append_str(buf, len, ar->short_src);
+    len = append_str(buf, len, ":");
+    len = append_int(buf, len, ar->linedefined);
+    if (ar->name != NULL) append_str(buf, len, ")");
+}
+
+static uint16_t intern_frame(MLuaAllocProfile* prof, lua_Debug const* ar) {
+    char name[MLUA_ALLOC_PROFILE_NAME];
+    format_frame(name, ar);
+    uint32_t hash = hash_bytes(FNV_OFFSET, name, strlen(name));
+    for (uint16_t i = 0; i < prof->nframes; ++i) {
+        MLuaAllocFrame const* f = &prof->frames[i];
+        if (f->hash == hash && strcmp(f->name, name) == 0) return i;
+    }
+    if (prof->nframes == MLUA_ALLOC_PROFILE_FRAMES) {
+        return MLUA_ALLOC_PROFILE_NO_FRAME;
+    }
+    MLuaAllocFrame* f = &prof->frames[prof->nframes];
+    f->hash = hash;
+    memcpy(f->name, name, sizeof(name));
+    return prof->nframes++;
+}
+
+// Attribute the pending allocations to the call stack of the running thread.
+static void sample(MLuaGlobal* g, MLuaAllocProfile* prof) {
+    lua_State* ls = g->alloc_running;
+    uint16_t frames[MLUA_ALLOC_PROFILE_DEPTH];
+    uint8_t depth = 0;
+    bool truncated = false;
+    lua_Debug ar;
+    for (int level = 0; lua_getstack(ls, level, &ar); ++level) {
+        if (depth == MLUA_ALLOC_PROFILE_DEPTH) {
+            truncated = true;
+            break;
+        }
+        lua_getinfo(ls, "Sn", &ar);
+        frames[depth++] = intern_frame(prof, &ar);
+    }
+    uint32_t hash = hash_bytes(FNV_OFFSET + truncated, frames,
+                               depth * sizeof(frames[0]));
+
+    MLuaAllocStack* st = prof->stacks;
+    MLuaAllocStack* end = st + prof->nstacks;
+    for (; st != end; ++st) {
+        if (st->hash == hash && st->depth == depth
+                && st->truncated == truncated
+                && memcmp(st->frames, frames, depth * sizeof(frames[0])) == 0) {
+            break;
+        }
+    }
+    if (st == end) {
+        if (prof->nstacks == MLUA_ALLOC_PROFILE_STACKS) {
+            prof->dropped_count += prof->pending_count;
+            prof->dropped_size += prof->pending_size;
+            prof->pending_count = prof->pending_size = 0;
+            return;
+        }
+        st->hash = hash;
+        st->depth = depth;
+        st->truncated = truncated;
+        memcpy(st->frames, frames, depth * sizeof(frames[0]));
+        st->count = st->size = 0;
+        ++prof->nstacks;
+    }
+    st->count += prof->pending_count;
+    st->size += prof->pending_size;
+    prof->pending_count = prof->pending_size = 0;
+}
+
+bool mlua_alloc_profile_start(lua_State* ls, size_t interval) {
+    MLuaGlobal* g = mlua_global(ls);
+    MLuaAllocProfile* prof = g->alloc_profile;
+    if (prof == NULL) {
+        prof = realloc(NULL, sizeof(*prof));
+        if (prof == NULL) return false;
+    }
+    memset(prof, 0, sizeof(*prof));
+    prof->interval = interval > 0 ? interval : 1;
+    prof->active = true;
+    g->alloc_profile = prof;
+    return true;
+}
+
+void mlua_alloc_profile_stop(lua_State* ls) {
+    MLuaAllocProfile* prof = mlua_global(ls)->alloc_profile;
+    if (prof != NULL) prof->active = false;
+}
+
+MLuaAllocProfile const* mlua_alloc_profile(lua_State* ls) {
+    return mlua_global(ls)->alloc_profile;
+}
+
+#endif  // MLUA_ALLOC_PROFILE
+
 static void* allocate(void* ud, void* ptr, size_t old_size, size_t new_size) {
-    // TODO: Record per-object stats based on old_size
-    if (new_size != 0) {
-        void* res = realloc(ptr, new_size);
-#if MLUA_ALLOC_STATS
-        if (res == NULL) return NULL;
-        MLuaGlobal* g = ud;
-        ++g->alloc_count;
-        g->alloc_size += new_size;
-        if (ptr != NULL) new_size -= old_size;
-        g->alloc_used += new_size;
-        if (g->alloc_used > g->alloc_peak) g->alloc_peak = g->alloc_used;
-#endif
-        return res;
+    MLuaGlobal* g = ud;
+    // When ptr is NULL, old_size is the type of the object being allocated.
+    unsigned type = ptr == NULL ? old_size : 0;
+    if (ptr == NULL) old_size = 0;
+#if MLUA_ALLOC_BUDGET
+    // Fail allocations that would exceed the limit. Lua then performs an
+    // emergency collection and retries, and raises a memory error if the
+    // allocation still fails.
+    if (new_size > old_size && g->alloc_limit != 0
+            && g->alloc_used + (new_size - old_size) > g->alloc_limit) {
+        return NULL;
     }
-    free(ptr);
+#endif
+#if MLUA_ALLOC_STATS_DETAIL
+    if (type >= MLUA_ALLOC_TYPES) type = 0;
+    AllocHeader* block = NULL;
+    if (ptr != NULL) {
+        block = (AllocHeader*)ptr - 1;
+        type = block->type;
+    }
+    block = block_realloc(g, block, ptr != NULL ? old_size + sizeof(*block) : 0,
+                          new_size != 0 ? new_size + sizeof(*block) : 0);
+    void* res = NULL;
+    if (block != NULL) {
+        block->type = type;
+        res = block + 1;
+    }
+#else
+    (void)type;
+    void* res = block_realloc(g, ptr, old_size, new_size);
+#endif
+    if (new_size == 0) {
+#if MLUA_ALLOC_STATS || MLUA_ALLOC_BUDGET
+        g->alloc_used -= old_size;
+#endif
+#if MLUA_ALLOC_STATS_DETAIL
+        if (ptr != NULL) detail_sub(g, type, old_size);
+#endif
+        return NULL;
+    }
+    if (res == NULL) return NULL;
+#if MLUA_ALLOC_STATS || MLUA_ALLOC_BUDGET
+    g->alloc_used += new_size - old_size;
+#endif
 #if MLUA_ALLOC_STATS
-    ((MLuaGlobal*)ud)->alloc_used -= old_size;
+    ++g->alloc_count;
+    g->alloc_size += new_size;
+    if (g->alloc_used > g->alloc_peak) g->alloc_peak = g->alloc_used;
+#endif
+#if MLUA_ALLOC_BUDGET && LIB_MLUA_MOD_MLUA_THREAD
+    if (new_size > old_size && g->alloc_watermark != 0
+            && g->alloc_used >= g->alloc_watermark
+            && g->alloc_used - (new_size - old_size) < g->alloc_watermark) {
+        mlua_event_set(&g->alloc_event);
+    }
+#endif
+#if MLUA_ALLOC_STATS_DETAIL
+    if (ptr != NULL) detail_sub(g, type, old_size);
+    detail_add(g, type, new_size);
 #endif
-    return NULL;
+#if MLUA_ALLOC_PROFILE
+    MLuaAllocProfile* prof = g->alloc_profile;
+    if (prof != NULL && prof->active && new_size > old_size) {
+        ++prof->pending_count;
+        prof->pending_size += new_size - old_size;
+        // Only sample when allocating new objects. Other allocations can
+        // happen while the stack is inconsistent, e.g. when it is resized.
+        if (prof->pending_size >= prof->interval && ptr == NULL && type != 0) {
+            sample(g, prof);
+        }
+    }
+#endif
+    return res;
+}
+
+#if MLUA_GC_STATS
+
+static void record_gc_pause(lua_State* ls, uint64_t start) {
+    uint64_t dt = mlua_ticks64() - start;
+    MLuaGlobal* g = mlua_global(ls);
+    g->gc_time += dt;
+    if (dt > g->gc_max) g->gc_max = dt < UINT32_MAX ? dt : UINT32_MAX;
+    unsigned i = dt == 0 ? 0 : 64 - __builtin_clzll(dt);
+    if (i >= MLUA_GC_STATS_BUCKETS) i = MLUA_GC_STATS_BUCKETS - 1;
+    ++g->gc_pauses[i];
+}
+
+// Wrappers for the collector entry points, called from the Lua core instead of
+// the original functions. See luaconf.in.h. Steps taken while the collector is
+// stopped only reset the GC debt, so they aren't recorded.
+void mlua_gc_step(lua_State* ls) {
+    if (!gcrunning(G(ls))) {
+        luaC_step(ls);
+        return;
+    }
+    uint64_t start = mlua_ticks64();
+    luaC_step(ls);
+    record_gc_pause(ls, start);
 }
 
+void mlua_gc_fullgc(lua_State* ls, int isemergency) {
+    uint64_t start = mlua_ticks64();
+    luaC_fullgc(ls, isemergency);
+    record_gc_pause(ls, start);
+}
+
+#endif  // MLUA_GC_STATS
+
 static int on_panic(lua_State* ls) {
     char const* msg = lua_tostring(ls, -1);
     if (msg == NULL) msg = "unknown error";
@@ -136,24 +415,65 @@ static void on_warn_off(void* ud, char const* msg, int cont) {
 }
 
 lua_State* mlua_new_interpreter(void) {
+#if MLUA_ALLOC_POOL
+    // Allocate the pool arena together with the global state.
+    MLuaGlobal* g = realloc(NULL, sizeof(MLuaGlobal) + MLUA_ALLOC_POOL_SIZE);
+#else
     MLuaGlobal* g = realloc(NULL, sizeof(MLuaGlobal));
+#endif
     if (g == NULL) return NULL;
     memset(g, 0, sizeof(*g));
+#if MLUA_ALLOC_POOL
+    g->alloc_pool = mlua_pool_init(g + 1, MLUA_ALLOC_POOL_SIZE);
+    if (g->alloc_pool == NULL) {
+        free(g);
+        return NULL;
+    }
+#endif
     lua_State* ls = lua_newstate(allocate, g);
     if (ls == NULL) {
         free(g);
         return NULL;
     }
+#if MLUA_ALLOC_PROFILE
+    g->alloc_running = ls;
+#endif
     lua_atpanic(ls, &on_panic);
     lua_setwarnf(ls, &on_warn_off, ls);
     memset(lua_getextraspace(ls), 0, LUA_EXTRASPACE);
+#if MLUA_ALLOC_BUDGET
+    g->alloc_limit = MLUA_ALLOC_BUDGET_LIMIT;
+    g->alloc_watermark = MLUA_ALLOC_BUDGET_WATERMARK;
+#if LIB_MLUA_MOD_MLUA_THREAD
+    mlua_event_enable(ls, &g->alloc_event);
+#endif
+#endif
     return ls;
 }
 
 void mlua_close_interpreter(lua_State* ls) {
     void* ud;
     lua_getallocf(ls, &ud);
+#if MLUA_ALLOC_BUDGET && LIB_MLUA_MOD_MLUA_THREAD
+    mlua_event_disable(ls, &((MLuaGlobal*)ud)->alloc_event);
+#endif
+#if MLUA_ALLOC_PROFILE
+    MLuaAllocProfile* prof = ((MLuaGlobal*)ud)->alloc_profile;
+    ((MLuaGlobal*)ud)->alloc_profile = NULL;
+    free(prof);
+#endif
+#if MLUA_REQUIRE_STATS && MLUA_REQUIRE_STATS_REPORT
+    if (((MLuaGlobal*)ud)->require_stats != NULL) {
+        mlua_push_require_report(ls);
+        mlua_writestringerror("Module loading statistics:\n%s",
+                              lua_tostring(ls, -1));
+        lua_pop(ls, 1);
+    }
+#endif
     lua_close(ls);
+#if MLUA_REQUIRE_STATS
+    mlua_free_require_stats(ud);
+#endif
 #if MLUA_ALLOC_STATS
     if (((MLuaGlobal*)ud)->alloc_used != 0) {
         mlua_writestringerror("WARNING: interpreter memory leak\n");
@@ -3,8 +3,11 @@
 
 #include "mlua/module.h"
 
+#include <inttypes.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "lualib.h"
@@ -197,6 +200,94 @@ static int global_alloc_stats(lua_State* ls) {
 #endif
 }
 
+static int global_gc_stats(lua_State* ls) {
+    bool reset = mlua_to_cbool(ls, 1);
+#if MLUA_GC_STATS
+    MLuaGlobal* g = mlua_global(ls);
+    lua_Unsigned count = 0;
+    lua_createtable(ls, 0, 0);
+    for (int i = 0; i < MLUA_GC_STATS_BUCKETS; ++i) {
+        uint32_t n = g->gc_pauses[i];
+        if (n == 0) continue;
+        count += n;
+        lua_pushinteger(ls, n);
+        lua_rawseti(ls, -2, (lua_Integer)1 << i);
+    }
+    lua_pushinteger(ls, count);
+    lua_pushinteger(ls, g->gc_time);
+    lua_pushinteger(ls, g->gc_max);
+    lua_rotate(ls, -4, -1);
+    if (reset) {
+        g->gc_time = 0;
+        g->gc_max = 0;
+        memset(g->gc_pauses, 0, sizeof(g->gc_pauses));
+    }
+    return 4;
+#else
+    (void)reset;
+    return 0;
+#endif
+}
+
+#if MLUA_ALLOC_STATS_DETAIL
+
+static char const* const alloc_type_names[MLUA_ALLOC_TYPES] = {
+    [LUA_TSTRING] = "string",
+    [LUA_TTABLE] = "table",
+    [LUA_TFUNCTION] = "function",
+    [LUA_TUSERDATA] = "userdata",
+    [LUA_TTHREAD] = "thread",
+    [LUA_NUMTYPES] = "upvalue",
+    [LUA_NUMTYPES + 1] = "proto",
+};
+
+static void push_alloc_count(lua_State* ls, MLuaAllocCount const* c) {
+    lua_createtable(ls, 0, 2);
+    lua_pushinteger(ls, c->count);
+    lua_setfield(ls, -2, "count");
+    lua_pushinteger(ls, c->size);
+    lua_setfield(ls, -2, "size");
+}
+
+#endif  // MLUA_ALLOC_STATS_DETAIL
+
+static int global_alloc_stats_detail(lua_State* ls) {
+#if MLUA_ALLOC_STATS_DETAIL
+    // Copy the counters before allocating the result tables.
+    MLuaGlobal* g = mlua_global(ls);
+    MLuaAllocCount types[MLUA_ALLOC_TYPES], sizes[MLUA_ALLOC_SIZES];
+    memcpy(types, g->alloc_types, sizeof(types));
+    memcpy(sizes, g->alloc_sizes, sizeof(sizes));
+    MLuaAllocCount other = {0};
+    lua_createtable(ls, 0, 8);
+    for (int i = 0; i < MLUA_ALLOC_TYPES; ++i) {
+        MLuaAllocCount const* c = &types[i];
+        char const* name = alloc_type_names[i];
+        if (name == NULL) {
+            other.count += c->count;
+            other.size += c->size;
+        } else if (c->count != 0) {
+            push_alloc_count(ls, c);
+            lua_setfield(ls, -2, name);
+        }
+    }
+    if (other.count != 0) {
+        push_alloc_count(ls, &other);
+        lua_setfield(ls, -2, "other");
+    }
+    lua_createtable(ls, 0, 0);
+    for (int i = 0; i < MLUA_ALLOC_SIZES; ++i) {
+        MLuaAllocCount const* c = &sizes[i];
+        if (c->count == 0) continue;
+        push_alloc_count(ls, c);
+        lua_rawseti(ls, -2, (lua_Integer)1 << i);
+    }
+    return 2;
+#else
+    return 0;
+#endif
+}
+
 static int global_with_traceback(lua_State* ls) {
     lua_settop(ls, 1);
     lua_pushcclosure(ls, &mlua_with_traceback, 1);
@@ -219,11 +310,16 @@ static int global_log_error(lua_State* ls) {
     return 1;
 }
 
-static int index2(lua_State* ls) {
-    // TODO: Cache __index2 as an upvalue
-    lua_pushliteral(ls, "__index2");
-    if (lua_rawget(ls, lua_upvalueindex(1)) == LUA_TNIL) {
-        return mlua_index_undefined(ls);
+// Call __index2, which is cached in the given upvalue if it was set when the
+// __index closure was created, and looked up in the class table otherwise.
+static int index2(lua_State* ls, int upvalue) {
+    lua_pushvalue(ls, lua_upvalueindex(upvalue));
+    if (lua_isnil(ls, -1)) {
+        lua_pop(ls, 1);
+        lua_pushliteral(ls, "__index2");
+        if (lua_rawget(ls, lua_upvalueindex(1)) == LUA_TNIL) {
+            return mlua_index_undefined(ls);
+        }
     }
     lua_pushvalue(ls, 1);
     lua_pushvalue(ls, 2);
@@ -237,7 +333,18 @@ static int nohash___index(lua_State* ls) {
     lua_pop(ls, 1);
 
     // Fall back to __index2.
-    return index2(ls);
+    return index2(ls, 2);
+}
+
+// Push an __index closure for the table at the top of the stack, consuming the
+// n values below the table. The upvalues of the closure are the table, the n
+// values and the __index2 field of the table.
+static void push_index(lua_State* ls, lua_CFunction fn, int n) {
+    lua_pushvalue(ls, -1);
+    lua_rotate(ls, -n - 2, 2);
+    lua_pushliteral(ls, "__index2");
+    lua_rawget(ls, -n - 2);
+    lua_pushcclosure(ls, fn, n + 2);
 }
 
 void mlua_new_module_nohash_(lua_State* ls, MLuaSym const* fields, int narr,
@@ -254,13 +361,14 @@ void mlua_new_class_nohash_(lua_State* ls, char const* name,
     new_metatable(ls, name, 0, cnt + nh_cnt + 1);
     set_fields_(ls, fields, cnt);
     set_fields_(ls, nh_fields, nh_cnt);
-    lua_pushvalue(ls, -1);
-    lua_pushcclosure(ls, &nohash___index, 1);
+    push_index(ls, &nohash___index, 0);
     lua_setfield(ls, -2, "__index");
 }
 
 #define HASH_MULT 0x13
 
+// Compute the hash of a key, one byte at a time. This must match the "byte"
+// hash in tools/gen.lua.
 static uint32_t hash(char const* key, uint32_t seed) {
     for (;;) {
         uint32_t c = (uint32_t)*key;
@@ -270,6 +378,50 @@ static uint32_t hash(char const* key, uint32_t seed) {
     }
 }
 
+// The multiplier of the word hash: 2^32 divided by the golden ratio.
+#define WORD_HASH_MULT 0x9e3779b1u
+
+static inline uint32_t mix_word(uint32_t h, uint32_t w) {
+    h = (h ^ w) * WORD_HASH_MULT;
+    return h ^ (h >> 15);
+}
+
+// Compute the hashes of a key for two seeds in a single pass, one 32-bit
+// little-endian word at a time, with the last word padded with zeroes. This
+// must match the "word" hash in tools/gen.lua.
+static void hash_words(char const* key, size_t len, uint32_t* h1,
+                       uint32_t* h2) {
+    uint32_t s1 = *h1 ^ (uint32_t)len, s2 = *h2 ^ (uint32_t)len;
+    // Lua strings are word-aligned, so the aligned loop is the common case. It
+    // compiles to word loads on targets that don't support unaligned accesses.
+    bool aligned = ((uintptr_t)key & (sizeof(uint32_t) - 1)) == 0;
+    for (; len >= sizeof(uint32_t);
+            key += sizeof(uint32_t), len -= sizeof(uint32_t)) {
+        uint32_t w;
+        if (aligned) {
+            memcpy(&w, __builtin_assume_aligned(key, sizeof(uint32_t)),
+                   sizeof(w));
+        } else {
+            memcpy(&w, key, sizeof(w));
+        }
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+        w = __builtin_bswap32(w);
+#endif
+        s1 = mix_word(s1, w);
+        s2 = mix_word(s2, w);
+    }
+    if (len > 0) {
+        uint32_t w = 0;
+        for (size_t i = 0; i < len; ++i) {
+            w |= (uint32_t)(uint8_t)key[i] << (8 * i);
+        }
+        s1 = mix_word(s1, w);
+        s2 = mix_word(s2, w);
+    }
+    *h1 = s1 & 0x7fffffff;
+    *h2 = s2 & 0x7fffffff;
+}
+
 static uint32_t lookup_g(uint8_t const* g, uint32_t index, int bits) {
     if (bits == 0) return 0;
     uint32_t bi = index * bits;
@@ -284,51 +436,110 @@ static uint32_t lookup_g(uint8_t const* g, uint32_t index, int bits) {
     return (value >> shift) & ((1u << bits) - 1);
 }
 
-static uint32_t perfect_hash(char const* key, MLuaSymHash const* h) {
-    return (lookup_g(h->g, hash(key, h->seed1) % h->ng, h->bits)
-            + lookup_g(h->g, hash(key, h->seed2) % h->ng, h->bits)) % h->nkeys;
+static uint32_t perfect_hash(char const* key, size_t len,
+                             MLuaSymHash const* h) {
+    uint32_t h1 = h->seed1, h2 = h->seed2;
+    if (h->words) {
+        hash_words(key, len, &h1, &h2);
+    } else {
+        h1 = hash(key, h1);
+        h2 = hash(key, h2);
+    }
+    return (lookup_g(h->g, h1 % h->ng, h->bits)
+            + lookup_g(h->g, h2 % h->ng, h->bits)) % h->nkeys;
 }
 
+// Upvalue indexes of hash___index.
+typedef enum HashIndexUpvalue {
+    UV_CLASS = 1,
+    UV_HASH,
+    UV_CACHE_SELF,
+    UV_INDEX2,
+} HashIndexUpvalue;
+
+#if MLUA_SYMBOL_CACHE_SIZE
+
+// The estimated memory used by a symbol cached into a table: one hash node,
+// plus the same amount to account for the power-of-two growth of the nodes.
+#define SYMBOL_CACHE_ENTRY_SIZE (2 * (2 * sizeof(lua_Number) + sizeof(void*)))
+
+// Cache a resolved symbol, whose value is at the top of the stack, by storing
+// it into the module or class table. Only constant values looked up with a
+// string key are cached, within the per-interpreter budget. Numbers are
+// convertible to strings, but they aren't symbol names.
+static void cache_symbol(lua_State* ls, MLuaSymVal const* value) {
+    if (lua_type(ls, 2) != LUA_TSTRING) return;
+    void (*push)(lua_State*, MLuaSymVal const*) = value->push;
+    if (push != &mlua_sym_push_boolean && push != &mlua_sym_push_integer
+            && push != &mlua_sym_push_number && push != &mlua_sym_push_string
+            && push != &mlua_sym_push_function
+            && push != &mlua_sym_push_lightuserdata) {
+        return;
+    }
+    int table = lua_upvalueindex(UV_CLASS);
+    if (lua_toboolean(ls, lua_upvalueindex(UV_CACHE_SELF))) {
+        if (!lua_istable(ls, 1)) return;
+        table = 1;
+    }
+    MLuaGlobal* g = mlua_global(ls);
+    if (g->symbol_cache_used + SYMBOL_CACHE_ENTRY_SIZE
+            > MLUA_SYMBOL_CACHE_SIZE) {
+        return;
+    }
+    g->symbol_cache_used += SYMBOL_CACHE_ENTRY_SIZE;
+    lua_pushvalue(ls, 2);
+    lua_pushvalue(ls, -2);
+    lua_rawset(ls, table);
+}
+
+#endif  // MLUA_SYMBOL_CACHE_SIZE
+
 static int hash___index(lua_State* ls) {
     // Try the lookup in the class table.
     lua_pushvalue(ls, 2);
-    if (lua_rawget(ls, lua_upvalueindex(1)) != LUA_TNIL) return 1;
+    if (lua_rawget(ls, lua_upvalueindex(UV_CLASS)) != LUA_TNIL) return 1;
     lua_pop(ls, 1);
 
     // Try the lookup in the hash table.
     if (lua_isstring(ls, 2)) {
-        char const* key = lua_tostring(ls, 2);
-        MLuaSymHash const* h = lua_touserdata(ls, lua_upvalueindex(2));
+        size_t len;
+        char const* key = lua_tolstring(ls, 2, &len);
+        MLuaSymHash const* h = lua_touserdata(ls, lua_upvalueindex(UV_HASH));
         MLuaSymH const* field = h->fields;
-        uint32_t kh = perfect_hash(key, h);
+        uint32_t kh = perfect_hash(key, len, h);
         field += kh;
 #if MLUA_SYMBOL_HASH_DEBUG
         char const* name = field->name;
         if (name[0] == '_' && name[1] != '_') ++name;
-        if (strcmp(key, field->name) != 0) {
+        if (strcmp(key, name) != 0) {
             return luaL_error(ls, "bad symbol hash: %s -> %d", key, kh);
         }
         MLuaSymVal const* value = &field->value;
-        value->push(ls, value);
 #else
-        field->push(ls, field);
+        MLuaSymVal const* value = field;
+#endif
+        value->push(ls, value);
+#if MLUA_SYMBOL_CACHE_SIZE
+        cache_symbol(ls, value);
 #endif
         return 1;
     }
 
     // Fall back to __index2.
-    return index2(ls);
+    return index2(ls, UV_INDEX2);
 }
 
-static void set_hash_index(lua_State* ls, int cnt, MLuaSymHash const* h) {
+static void set_hash_index(lua_State* ls, int cnt, MLuaSymHash const* h,
+                           bool cache_self) {
     if (cnt != h->nkeys) {
         luaL_error(ls, "key count mismatch: %d symbols, expected %d", cnt,
                    h->nkeys);
         return;
     }
-    lua_pushvalue(ls, -1);
     lua_pushlightuserdata(ls, (void*)h);
-    lua_pushcclosure(ls, &hash___index, 2);
+    lua_pushboolean(ls, cache_self);
+    lua_rotate(ls, -3, -1);
+    push_index(ls, &hash___index, 2);
     lua_setfield(ls, -2, "__index");
 }
 
@@ -336,7 +547,7 @@ void mlua_new_module_hash_(lua_State* ls, int narr, int nrec,
                            MLuaSymHash const* h) {
     lua_createtable(ls, narr, 0);
     lua_createtable(ls, 0, 1);
-    set_hash_index(ls, nrec, h);
+    set_hash_index(ls, nrec, h, true);
     lua_setmetatable(ls, -2);
 }
 
@@ -345,7 +556,7 @@ void mlua_new_class_hash_(lua_State* ls, char const* name, int cnt,
                           int nh_cnt) {
     new_metatable(ls, name, 0, nh_cnt + 1);
     set_fields_(ls, nh_fields, nh_cnt);
-    set_hash_index(ls, cnt, h);
+    set_hash_index(ls, cnt, h, false);
 }
 
 void mlua_set_metaclass(lua_State* ls) {
@@ -361,17 +572,370 @@ void mlua_set_metaclass(lua_State* ls) {
 extern MLuaModule const __start_mlua_module_registry[];
 extern MLuaModule const __stop_mlua_module_registry[];
 
+// Compute the hash of a module name. This must match MLUA_MODULE_HASH().
+static uint32_t module_hash(char const* name) {
+    uint32_t h = 0x811c9dc5u;
+    for (; *name != 0; ++name) h = (h ^ (uint8_t)*name) * 0x01000193u;
+    return h;
+}
+
+// An index of the module registry, using open addressing with linear probing
+// on the module name hashes. Slots hold the registry index plus one, or zero if
+// they are empty.
+typedef struct ModuleIndex {
+    uint32_t mask;
+    uint16_t slots[];
+} ModuleIndex;
+
+static void new_module_index(lua_State* ls) {
+    size_t count = __stop_mlua_module_registry - __start_mlua_module_registry;
+    if (count >= UINT16_MAX) {
+        luaL_error(ls, "too many modules: %d", (int)count);
+        return;
+    }
+    uint32_t size = 1;
+    while (size < 2 * count) size <<= 1;
+    ModuleIndex* idx = lua_newuserdatauv(
+        ls, sizeof(ModuleIndex) + size * sizeof(uint16_t), 0);
+    idx->mask = size - 1;
+    memset(idx->slots, 0, size * sizeof(uint16_t));
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t s = __start_mlua_module_registry[i].hash & idx->mask;
+        while (idx->slots[s] != 0) s = (s + 1) & idx->mask;
+        idx->slots[s] = i + 1;
+    }
+}
+
+#if MLUA_REQUIRE_STATS
+
+// A sample of the resources used by the interpreter.
+typedef struct RequireSample {
+    uint64_t time;      // Time, in microseconds
+    size_t count;       // Number of allocations
+    ptrdiff_t used;     // Memory in use
+} RequireSample;
+
+// The loading statistics of a module. While the module is being loaded, total
+// holds the sample taken before loading, and self holds the nested sample of
+// the requiring module.
+typedef struct RequireStats {
+    char* name;             // The name of the module
+    RequireSample total;    // Resources used, including nested requires
+    RequireSample self;     // Resources used, excluding nested requires
+    uint16_t parent;        // Index of the requiring module plus one
+    uint16_t order;         // Load order starting at one, or zero if not loaded
+} RequireStats;
+
+typedef struct MLuaRequireStats {
+    RequireSample nested;   // Resources used by nested requires
+    uint16_t current;       // Index of the loading module plus one
+    uint16_t loaded;        // Number of modules loaded
+    uint16_t count;         // Number of per-module records
+    uint16_t cap;           // Capacity of the per-module records
+    RequireStats* modules;  // Per-module statistics, in order of first require
+} MLuaRequireStats;
+
+static void take_sample(MLuaGlobal* g, RequireSample* sample) {
+    sample->time = mlua_ticks64();
+#if MLUA_ALLOC_STATS
+    sample->count = g->alloc_count;
+    sample->used = g->alloc_used;
+#else
+    (void)g;
+    sample->count = 0;
+    sample->used = 0;
+#endif
+}
+
+static MLuaRequireStats* require_stats(MLuaGlobal* g) {
+    if (g->require_stats != NULL) return g->require_stats;
+    g->require_stats = calloc(1, sizeof(MLuaRequireStats));
+    return g->require_stats;
+}
+
+void mlua_free_require_stats(MLuaGlobal* g) {
+    MLuaRequireStats* rs = g->require_stats;
+    if (rs == NULL) return;
+    for (uint16_t i = 0; i < rs->count; ++i) free(rs->modules[i].name);
+    free(rs->modules);
+    free(rs);
+    g->require_stats = NULL;
+}
+
+// Return the index of the record of the module with the given name, creating
+// it if necessary, or -1 if memory allocation fails. The records are allocated
+// outside of the Lua heap, so that they don't skew the allocation counters.
+static int stats_index(MLuaRequireStats* rs, char const* name) {
+    for (uint16_t i = 0; i < rs->count; ++i) {
+        if (strcmp(rs->modules[i].name, name) == 0) return i;
+    }
+    if (rs->count == UINT16_MAX) return -1;
+    if (rs->count == rs->cap) {
+        uint16_t cap = rs->cap <= UINT16_MAX / 2 ? 2 * rs->cap : UINT16_MAX;
+        if (cap < 32) cap = 32;
+        RequireStats* m = realloc(rs->modules, cap * sizeof(RequireStats));
+        if (m == NULL) return -1;
+        rs->modules = m;
+        rs->cap = cap;
+    }
+    size_t len = strlen(name) + 1;
+    char* n = malloc(len);
+    if (n == NULL) return -1;
+    memcpy(n, name, len);
+    rs->modules[rs->count] = (RequireStats){.name = n};
+    return rs->count++;
+}
+
+static void sample_sub(RequireSample* res, RequireSample const* a,
+                       RequireSample const* b) {
+    res->time = a->time - b->time;
+    res->count = a->count - b->count;
+    res->used = a->used - b->used;
+}
+
+static void sample_add(RequireSample* res, RequireSample const* a,
+                       RequireSample const* b) {
+    res->time = a->time + b->time;
+    res->count = a->count + b->count;
+    res->used = a->used + b->used;
+}
+
+static int require_done(lua_State* ls) {
+    MLuaGlobal* g = mlua_global(ls);
+    MLuaRequireStats* rs = g->require_stats;
+    RequireStats* st = &rs->modules[lua_tointeger(ls, lua_upvalueindex(1))];
+    RequireSample now, parent_nested = st->self;
+    take_sample(g, &now);
+    sample_sub(&st->total, &now, &st->total);
+    sample_sub(&st->self, &st->total, &rs->nested);
+    st->order = lua_isnil(ls, 1) ? ++rs->loaded : 0;
+
+    // Attribute the resources used by the module to the requiring module.
+    sample_add(&rs->nested, &parent_nested, &st->total);
+    rs->current = st->parent;
+    return 0;
+}
+
+// A wrapper around require() that records the loading statistics of modules,
+// whichever searcher finds them. Modules that are already loaded aren't
+// recorded.
+static int require_with_stats(lua_State* ls) {
+    char const* name = luaL_checkstring(ls, 1);
+    lua_settop(ls, 1);
+    lua_getfield(ls, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    lua_getfield(ls, -1, name);
+    bool loaded = lua_toboolean(ls, -1);
+    lua_pop(ls, 2);
+    MLuaGlobal* g = mlua_global(ls);
+    MLuaRequireStats* rs = !loaded ? require_stats(g) : NULL;
+    int index = rs != NULL ? stats_index(rs, name) : -1;
+    // Don't record recursive requires of a module that is being loaded.
+    for (uint16_t c = index >= 0 ? rs->current : 0; c != 0;
+            c = rs->modules[c - 1].parent) {
+        if (c == index + 1) {
+            index = -1;
+            break;
+        }
+    }
+    if (index < 0) {
+        lua_pushvalue(ls, lua_upvalueindex(1));
+        lua_insert(ls, 1);
+        lua_call(ls, 1, LUA_MULTRET);
+        return lua_gettop(ls);
+    }
+
+    // Record the statistics in a to-be-closed function, so that they are
+    // restored correctly if loading the module fails.
+    lua_pushinteger(ls, index);
+    lua_pushcclosure(ls, &require_done, 1);
+    lua_toclose(ls, -1);
+    lua_pushvalue(ls, lua_upvalueindex(1));
+    lua_pushvalue(ls, 1);
+    RequireStats* st = &rs->modules[index];
+    st->self = rs->nested;
+    st->parent = rs->current;
+    rs->nested = (RequireSample){0};
+    rs->current = index + 1;
+    take_sample(g, &st->total);
+    lua_call(ls, 1, LUA_MULTRET);
+    return lua_gettop(ls) - 2;
+}
+
+static void push_require_stats(lua_State* ls, MLuaRequireStats const* rs,
+                               RequireStats const* st) {
+    lua_createtable(ls, 0, 8);
+    if (st->parent != 0) {
+        lua_pushstring(ls, rs->modules[st->parent - 1].name);
+        lua_setfield(ls, -2, "parent");
+    }
+    lua_pushinteger(ls, st->order);
+    lua_setfield(ls, -2, "order");
+    lua_pushinteger(ls, st->total.time);
+    lua_setfield(ls, -2, "time");
+    lua_pushinteger(ls, st->self.time);
+    lua_setfield(ls, -2, "self_time");
+    lua_pushinteger(ls, st->total.count);
+    lua_setfield(ls, -2, "count");
+    lua_pushinteger(ls, st->self.count);
+    lua_setfield(ls, -2, "self_count");
+    lua_pushinteger(ls, st->total.used);
+    lua_setfield(ls, -2, "used");
+    lua_pushinteger(ls, st->self.used);
+    lua_setfield(ls, -2, "self_used");
+}
+
+static void add_require_line(luaL_Buffer* buf, MLuaRequireStats const* rs,
+                             RequireStats const* st) {
+    char const* parent = st->parent != 0 ?
+        rs->modules[st->parent - 1].name : NULL;
+    size_t const size = 2 * MLUA_MODULE_NAME_MAX + 80;
+    char* p = luaL_prepbuffsize(buf, size);
+    int len = snprintf(
+        p, size,
+        "%10" PRIu64 " %10" PRIu64 " %8zu %8zu %9td %9td  %s%s%s%s\n",
+        st->total.time, st->self.time, st->total.count, st->self.count,
+        st->total.used, st->self.used, st->name, parent != NULL ? " (" : "",
+        parent != NULL ? parent : "", parent != NULL ? ")" : "");
+    if (len < 0) return;
+    // Keep the truncated line if the names don't fit.
+    luaL_addsize(buf, (size_t)len < size ? (size_t)len : size - 1);
+}
+
+#endif  // MLUA_REQUIRE_STATS
+
 static int Preload___index(lua_State* ls) {
     char const* name = luaL_checkstring(ls, 2);
-    for (MLuaModule const* m = __start_mlua_module_registry;
-            m != __stop_mlua_module_registry; ++m) {
-        if (strcmp(m->name, name) == 0) {
+    ModuleIndex const* idx = lua_touserdata(ls, lua_upvalueindex(1));
+    uint32_t h = module_hash(name);
+    for (uint32_t s = h & idx->mask; idx->slots[s] != 0;
+            s = (s + 1) & idx->mask) {
+        MLuaModule const* m = &__start_mlua_module_registry[idx->slots[s] - 1];
+        if (m->hash == h && strcmp(m->name, name) == 0) {
             return lua_pushcfunction(ls, m->open), 1;
         }
     }
     return 0;
 }
 
+static int global_require_stats(lua_State* ls) {
+#if MLUA_REQUIRE_STATS
+    MLuaRequireStats const* rs = mlua_global(ls)->require_stats;
+    lua_createtable(ls, 0, rs != NULL ? rs->loaded : 0);
+    if (rs == NULL) return 1;
+    for (uint16_t i = 0; i < rs->count; ++i) {
+        RequireStats const* st = &rs->modules[i];
+        if (st->order == 0) continue;
+        push_require_stats(ls, rs, st);
+        lua_setfield(ls, -2, st->name);
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void mlua_push_require_report(lua_State* ls) {
+#if MLUA_REQUIRE_STATS
+    MLuaRequireStats const* rs = mlua_global(ls)->require_stats;
+    size_t count = rs != NULL ? rs->count : 0;
+
+    // Sort the loaded modules by decreasing self time.
+    uint16_t* sorted = lua_newuserdatauv(ls, count * sizeof(uint16_t), 0);
+    size_t n = 0;
+    for (size_t i = 0; i < count; ++i) {
+        RequireStats const* st = &rs->modules[i];
+        if (st->order == 0) continue;
+        size_t j = n++;
+        for (; j > 0 && rs->modules[sorted[j - 1]].self.time < st->self.time;
+                --j) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = i;
+    }
+
+    luaL_Buffer buf;
+    luaL_buffinit(ls, &buf);
+    luaL_addstring(&buf, "      time       self   allocs     self      used"
+                         "      self  module (parent)\n");
+    for (size_t i = 0; i < n; ++i) {
+        add_require_line(&buf, rs, &rs->modules[sorted[i]]);
+    }
+    luaL_pushresult(&buf);
+    lua_remove(ls, -2);  // sorted
+#else
+    lua_pushnil(ls);
+#endif
+}
+
+// The parameters of the LZ format of compressed Lua modules. They must match
+// the encoder in tools/gen.lua.
+#define LZ_WINDOW_BITS 10
+#define LZ_WINDOW (1u << LZ_WINDOW_BITS)
+#define LZ_LEN_BITS (16 - LZ_WINDOW_BITS)
+#define LZ_MIN_MATCH 3
+
+// The state of the decompression of a Lua chunk. Only a window of the
+// decompressed data is kept, and it is handed to lua_load() piecewise.
+typedef struct LzReader {
+    uint8_t const* in;
+    uint8_t const* end;
+    uint16_t head;          // Write position in the window
+    uint16_t off;           // Offset of the current match
+    uint16_t len;           // Remaining length of the current match
+    uint8_t flags;          // Token flags of the current group
+    uint8_t nflags;         // Number of remaining tokens in the current group
+    uint8_t window[LZ_WINDOW];
+} LzReader;
+
+static char const* read_lz(lua_State* ls, void* ud, size_t* size) {
+    LzReader* r = ud;
+    uint16_t start = r->head, pos = start;
+    while (pos < LZ_WINDOW) {
+        if (r->len > 0) {
+            r->window[pos] = r->window[(pos - r->off) & (LZ_WINDOW - 1)];
+            ++pos;
+            --r->len;
+            continue;
+        }
+        if (r->in == r->end) break;
+        if (r->nflags == 0) {
+            r->flags = *r->in++;
+            r->nflags = 8;
+            continue;
+        }
+        bool match = (r->flags & 1) != 0;
+        r->flags >>= 1;
+        --r->nflags;
+        if (!match) {
+            r->window[pos++] = *r->in++;
+            continue;
+        }
+        if (r->end - r->in < 2) {  // Truncated input
+            r->in = r->end;
+            break;
+        }
+        uint16_t v = (r->in[0] << 8) | r->in[1];
+        r->in += 2;
+        r->off = (v >> LZ_LEN_BITS) + 1;
+        r->len = (v & ((1u << LZ_LEN_BITS) - 1)) + LZ_MIN_MATCH;
+    }
+    r->head = pos & (LZ_WINDOW - 1);
+    *size = pos - start;
+    return (char const*)&r->window[start];
+}
+
+int mlua_load_compressed(lua_State* ls, char const* data, size_t size,
+                         char const* name, char const* mode) {
+    LzReader* r = lua_newuserdatauv(ls, sizeof(LzReader), 0);
+    r->in = (uint8_t const*)data;
+    r->end = r->in + size;
+    r->head = r->off = r->len = 0;
+    r->flags = r->nflags = 0;
+    int res = lua_load(ls, &read_lz, r, name, mode);
+    lua_remove(ls, -2);
+    return res;
+}
+
 static int Preload_next(lua_State* ls) {
     MLuaModule const* m = __start_mlua_module_registry;
     if (!lua_isnil(ls, 2)) {
@@ -398,7 +962,6 @@ static int Preload___pairs(lua_State* ls) {
 static char const Preload_name[] = "mlua.Preload";
 
 MLUA_SYMBOLS_NOHASH(Preload_syms) = {
-    MLUA_SYM_F_NH(__index, Preload_),
     MLUA_SYM_F_NH(__pairs, Preload_),
 };
 
@@ -495,8 +1058,11 @@ void mlua_register_modules(lua_State* ls) {
     // compiled-in modules.
     luaL_requiref(ls, "package", luaopen_package, 0);
     lua_getfield(ls, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
-    new_metatable(ls, Preload_name, 0, MLUA_SYMCNT(Preload_syms));
+    new_metatable(ls, Preload_name, 0, MLUA_SYMCNT(Preload_syms) + 1);
     set_fields(ls, Preload_syms);
+    new_module_index(ls);
+    lua_pushcclosure(ls, &Preload___index, 1);
+    lua_setfield(ls, -2, "__index");
     lua_setmetatable(ls, -2);
     lua_pop(ls, 1);  // preload
 
@@ -508,6 +1074,13 @@ void mlua_register_modules(lua_State* ls) {
     }
     lua_pop(ls, 2);  // searchers, package
 
+#if MLUA_REQUIRE_STATS
+    // Wrap require() to record module loading statistics.
+    lua_getglobal(ls, "require");
+    lua_pushcclosure(ls, &require_with_stats, 1);
+    lua_setglobal(ls, "require");
+#endif
+
     // Set a metatable on light userdata.
     lua_pushlightuserdata(ls, NULL);
     new_metatable(ls, pointer_name, 0, MLUA_SYMCNT(pointer_syms));
@@ -540,6 +1113,12 @@ void mlua_register_modules(lua_State* ls) {
     lua_setglobal(ls, "equal");
     lua_pushcfunction(ls, &global_alloc_stats);
     lua_setglobal(ls, "alloc_stats");
+    lua_pushcfunction(ls, &global_alloc_stats_detail);
+    lua_setglobal(ls, "alloc_stats_detail");
+    lua_pushcfunction(ls, &global_gc_stats);
+    lua_setglobal(ls, "gc_stats");
+    lua_pushcfunction(ls, &global_require_stats);
+    lua_setglobal(ls, "require_stats");
     lua_pushcfunction(ls, &global_with_traceback);
     lua_setglobal(ls, "with_traceback");
     lua_pushcfunction(ls, &global_log_error);
@@ -29,7 +29,12 @@ static char const data[] = {@DATA@};
 #endif
 
 MLUA_OPEN_MODULE(@MOD@) {
-    if (luaL_loadbufferx(ls, data, data_size, "@MOD@", "bt") != LUA_OK) {
+#if @COMPRESS@
+    int res = mlua_load_compressed(ls, data, data_size, "@MOD@", "bt");
+#else
+    int res = luaL_loadbufferx(ls, data, data_size, "@MOD@", "bt");
+#endif
+    if (res != LUA_OK) {
         return luaL_error(ls, "failed to load '@MOD@':\n\t%s",
                           lua_tostring(ls, -1));
     }
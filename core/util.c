@@ -77,6 +77,220 @@ bool mlua_get_ro_buffer(lua_State* ls, int arg, MLuaBuffer* buf) {
     return mlua_get_buffer(ls, arg, buf);
 }
 
+// The size of the temporary buffer used for buffers without span access.
+#define CHUNK_SIZE 64
+
+void mlua_buffer_read_spans(MLuaBuffer const* buf, lua_Unsigned off,
+                            lua_Unsigned len, void* dest) {
+    MLuaBufferIter it;
+    mlua_buffer_iter_init(&it, buf, off, len);
+    void const* ptr;
+    lua_Unsigned size;
+    while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+        memcpy(dest, ptr, size);
+        dest += size;
+    }
+}
+
+void mlua_buffer_write_spans(MLuaBuffer const* buf, lua_Unsigned off,
+                             lua_Unsigned len, void const* src) {
+    MLuaBufferIter it;
+    mlua_buffer_iter_init(&it, buf, off, len);
+    void* ptr;
+    lua_Unsigned size;
+    while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+        memcpy(ptr, src, size);
+        src += size;
+    }
+}
+
+void mlua_buffer_fill_spans(MLuaBuffer const* buf, lua_Unsigned off,
+                            lua_Unsigned len, int value) {
+    MLuaBufferIter it;
+    mlua_buffer_iter_init(&it, buf, off, len);
+    void* ptr;
+    lua_Unsigned size;
+    while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+        memset(ptr, value, size);
+    }
+}
+
+static inline int sign(int v) { return (v > 0) - (v < 0); }
+
+// Compare a range of a buffer with a block of memory.
+static int compare_mem(MLuaBuffer const* buf, lua_Unsigned off,
+                       void const* mem, lua_Unsigned len) {
+    if (buf->vt == NULL) return sign(memcmp(buf->ptr + off, mem, len));
+    if (mlua_buffer_has_spans(buf)) {
+        MLuaBufferIter it;
+        mlua_buffer_iter_init(&it, buf, off, len);
+        void const* ptr;
+        lua_Unsigned size;
+        while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+            int res = memcmp(ptr, mem, size);
+            if (res != 0) return sign(res);
+            mem += size;
+        }
+        return 0;
+    }
+    uint8_t chunk[CHUNK_SIZE];
+    while (len > 0) {
+        lua_Unsigned size = len < sizeof(chunk) ? len : sizeof(chunk);
+        buf->vt->read(buf->ptr, off, size, chunk);
+        int res = memcmp(chunk, mem, size);
+        if (res != 0) return sign(res);
+        off += size;
+        mem += size;
+        len -= size;
+    }
+    return 0;
+}
+
+lua_Unsigned mlua_buffer_find_spans(
+        MLuaBuffer const* buf, lua_Unsigned off, lua_Unsigned len,
+        void const* needle, lua_Unsigned needle_len) {
+    if (needle_len == 0) return off;
+    if (needle_len > len) return LUA_MAXUNSIGNED;
+    uint8_t first = *(uint8_t const*)needle;
+
+    // Iterate over the candidate start positions only.
+    MLuaBufferIter it;
+    mlua_buffer_iter_init(&it, buf, off, len - needle_len + 1);
+    uint8_t const* ptr;
+    lua_Unsigned size;
+    while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+        lua_Unsigned start = it.off - size;
+        uint8_t const* end = ptr + size;
+        for (uint8_t const* p = ptr;
+                (p = memchr(p, first, end - p)) != NULL; ++p) {
+            lua_Unsigned pos = start + (p - ptr);
+            if (compare_mem(buf, pos + 1, needle + 1, needle_len - 1) == 0) {
+                return pos;
+            }
+        }
+    }
+    return LUA_MAXUNSIGNED;
+}
+
+void mlua_buffer_visit(MLuaBuffer const* buf, lua_Unsigned off,
+                       lua_Unsigned len,
+                       void (*fn)(void*, void const*, lua_Unsigned),
+                       void* ctx) {
+    if (mlua_buffer_has_spans(buf)) {
+        MLuaBufferIter it;
+        mlua_buffer_iter_init(&it, buf, off, len);
+        void const* ptr;
+        lua_Unsigned size;
+        while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+            fn(ctx, ptr, size);
+        }
+        return;
+    }
+    uint8_t chunk[CHUNK_SIZE];
+    while (len > 0) {
+        lua_Unsigned size = len < sizeof(chunk) ? len : sizeof(chunk);
+        buf->vt->read(buf->ptr, off, size, chunk);
+        fn(ctx, chunk, size);
+        off += size;
+        len -= size;
+    }
+}
+
+typedef struct CopyState {
+    MLuaBuffer const* buf;
+    lua_Unsigned off;
+} CopyState;
+
+static void copy_to(void* ctx, void const* ptr, lua_Unsigned len) {
+    CopyState* cs = ctx;
+    mlua_buffer_write(cs->buf, cs->off, len, ptr);
+    cs->off += len;
+}
+
+void mlua_buffer_copy(MLuaBuffer const* dest, lua_Unsigned dest_off,
+                      MLuaBuffer const* src, lua_Unsigned src_off,
+                      lua_Unsigned len) {
+    if (dest->vt == NULL && src->vt == NULL) {
+        memmove(dest->ptr + dest_off, src->ptr + src_off, len);
+        return;
+    }
+    if (!mlua_buffer_has_spans(src) && mlua_buffer_has_spans(dest)) {
+        MLuaBufferIter it;
+        mlua_buffer_iter_init(&it, dest, dest_off, len);
+        void* ptr;
+        lua_Unsigned size;
+        while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+            src->vt->read(src->ptr, src_off, size, ptr);
+            src_off += size;
+        }
+        return;
+    }
+    CopyState cs = {.buf = dest, .off = dest_off};
+    mlua_buffer_visit(src, src_off, len, &copy_to, &cs);
+}
+
+int mlua_buffer_compare(MLuaBuffer const* a, lua_Unsigned a_off,
+                        MLuaBuffer const* b, lua_Unsigned b_off,
+                        lua_Unsigned len) {
+    if (a->vt == NULL) return -compare_mem(b, b_off, a->ptr + a_off, len);
+    if (mlua_buffer_has_spans(a)) {
+        MLuaBufferIter it;
+        mlua_buffer_iter_init(&it, a, a_off, len);
+        void const* ptr;
+        lua_Unsigned size;
+        while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+            int res = compare_mem(b, b_off, ptr, size);
+            if (res != 0) return -res;
+            b_off += size;
+        }
+        return 0;
+    }
+    uint8_t chunk[CHUNK_SIZE];
+    while (len > 0) {
+        lua_Unsigned size = len < sizeof(chunk) ? len : sizeof(chunk);
+        a->vt->read(a->ptr, a_off, size, chunk);
+        int res = compare_mem(b, b_off, chunk, size);
+        if (res != 0) return -res;
+        a_off += size;
+        b_off += size;
+        len -= size;
+    }
+    return 0;
+}
+
+typedef struct InetSum {
+    uint32_t sum;
+    bool odd;
+} InetSum;
+
+static void inet_sum(void* ctx, void const* ptr, lua_Unsigned len) {
+    InetSum* s = ctx;
+    uint8_t const* p = ptr;
+    uint8_t const* end = p + len;
+    uint32_t sum = s->sum;
+    if (s->odd && p < end) {
+        sum += *p++;
+        s->odd = false;
+    }
+    for (; end - p >= 2; p += 2) {
+        sum += ((uint32_t)p[0] << 8) | p[1];
+        if (sum & 0x80000000u) sum = (sum & 0xffff) + (sum >> 16);
+    }
+    if (p < end) {
+        sum += (uint32_t)*p << 8;
+        s->odd = true;
+    }
+    s->sum = sum;
+}
+
+uint16_t mlua_buffer_inet_checksum(MLuaBuffer const* buf, lua_Unsigned off,
+                                   lua_Unsigned len, uint16_t sum) {
+    InetSum s = {.sum = sum};
+    mlua_buffer_visit(buf, off, len, &inet_sum, &s);
+    while ((s.sum >> 16) != 0) s.sum = (s.sum & 0xffff) + (s.sum >> 16);
+    return s.sum;
+}
+
 int mlua_push_fail(lua_State* ls, char const* err) {
     luaL_pushfail(ls);
     lua_pushstring(ls, err);
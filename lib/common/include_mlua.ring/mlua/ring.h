@@ -0,0 +1,165 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#ifndef _MLUA_LIB_COMMON_MLUA_RING_H
+#define _MLUA_LIB_COMMON_MLUA_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A single-producer, single-consumer byte ring buffer. The producer and the
+// consumer can run concurrently, e.g. in an interrupt handler or on another
+// core, without locking. The head is only modified by the producer, and the
+// tail only by the consumer. Both are in [0, 2 * size), which allows using the
+// full capacity of the buffer.
+typedef struct MLuaRing MLuaRing;
+struct MLuaRing {
+    // The storage of the ring.
+    uint8_t* data;
+
+    // The capacity of the ring. Must be at most SIZE_MAX / 2.
+    size_t size;
+
+    // The write index.
+    size_t head;
+
+    // The read index.
+    size_t tail;
+
+    // The minimum number of readable bytes after a commit that triggers a data
+    // notification.
+    size_t data_threshold;
+
+    // The minimum number of writable bytes after a consume that triggers a
+    // space notification.
+    size_t space_threshold;
+
+    // Called by the producer when data is available, and by the consumer when
+    // space is available. Optional.
+    void (*notify)(MLuaRing* ring, bool space);
+};
+
+// Initialize a ring buffer with the given storage.
+static inline void mlua_ring_init(MLuaRing* ring, void* data, size_t size) {
+    ring->data = data;
+    ring->size = size;
+    ring->head = ring->tail = 0;
+    ring->data_threshold = ring->space_threshold = 1;
+    ring->notify = NULL;
+}
+
+// Return the number of bytes in the ring between two indexes.
+static inline size_t mlua_ring_distance(MLuaRing const* ring, size_t from,
+                                       size_t to) {
+    return to >= from ? to - from : to + 2 * ring->size - from;
+}
+
+// Advance an index by the given number of bytes.
+static inline size_t mlua_ring_advance(MLuaRing const* ring, size_t idx,
+                                       size_t len) {
+    idx += len;
+    return idx >= 2 * ring->size ? idx - 2 * ring->size : idx;
+}
+
+// Return the storage position of an index.
+static inline size_t mlua_ring_pos(MLuaRing const* ring, size_t idx) {
+    return idx >= ring->size ? idx - ring->size : idx;
+}
+
+// Return the number of readable bytes.
+static inline size_t mlua_ring_count(MLuaRing const* ring) {
+    return mlua_ring_distance(ring,
+                              __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE),
+                              __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE));
+}
+
+// Return the number of writable bytes.
+static inline size_t mlua_ring_space(MLuaRing const* ring) {
+    return ring->size - mlua_ring_count(ring);
+}
+
+// Return a pointer to the contiguous writable span starting at the given
+// offset from the head of the ring, and set *len to its length. Returns NULL if
+// the offset is at or past the end of the writable space. Producer only.
+static inline void* mlua_ring_write_span(MLuaRing* ring, size_t off,
+                                         size_t* len) {
+    size_t head = ring->head;
+    size_t space = ring->size - mlua_ring_distance(
+        ring, __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE), head);
+    if (off >= space) return NULL;
+    size_t pos = mlua_ring_pos(ring, mlua_ring_advance(ring, head, off));
+    space -= off;
+    *len = ring->size - pos < space ? ring->size - pos : space;
+    return ring->data + pos;
+}
+
+// Make the given number of bytes written to the span(s) returned by
+// mlua_ring_write_span() available to the consumer. Producer only.
+static inline void mlua_ring_commit(MLuaRing* ring, size_t len) {
+    size_t head = mlua_ring_advance(ring, ring->head, len);
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    if (ring->notify != NULL
+            && mlua_ring_count(ring) >= ring->data_threshold) {
+        ring->notify(ring, false);
+    }
+}
+
+// Return a pointer to the contiguous readable span starting at the given
+// offset from the tail of the ring, and set *len to its length. Returns NULL
+// if the offset is at or past the end of the readable data. Consumer only.
+static inline void* mlua_ring_read_span(MLuaRing* ring, size_t off,
+                                        size_t* len) {
+    size_t tail = ring->tail;
+    size_t count = mlua_ring_distance(
+        ring, tail, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE));
+    if (off >= count) return NULL;
+    size_t pos = mlua_ring_pos(ring, mlua_ring_advance(ring, tail, off));
+    count -= off;
+    *len = ring->size - pos < count ? ring->size - pos : count;
+    return ring->data + pos;
+}
+
+// Release the given number of bytes at the tail of the ring to the producer.
+// Consumer only.
+static inline void mlua_ring_consume(MLuaRing* ring, size_t len) {
+    size_t tail = mlua_ring_advance(ring, ring->tail, len);
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    if (ring->notify != NULL
+            && mlua_ring_space(ring) >= ring->space_threshold) {
+        ring->notify(ring, true);
+    }
+}
+
+// Write up to len bytes to the ring. Returns the number of bytes written.
+// Producer only.
+size_t mlua_ring_write(MLuaRing* ring, void const* src, size_t len);
+
+// Copy up to len bytes starting at the given offset from the tail of the ring,
+// without consuming them. Returns the number of bytes copied. Consumer only.
+size_t mlua_ring_peek(MLuaRing* ring, size_t off, void* dest, size_t len);
+
+// Read and consume up to len bytes from the ring. Returns the number of bytes
+// read. Consumer only.
+size_t mlua_ring_read(MLuaRing* ring, void* dest, size_t len);
+
+// Consume up to len bytes from the ring. Returns the number of bytes consumed.
+// Consumer only.
+size_t mlua_ring_discard(MLuaRing* ring, size_t len);
+
+// Get the ring of a Ring value, or raise an error if the argument is not a Ring
+// userdata.
+MLuaRing* mlua_ring_check(lua_State* ls, int arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
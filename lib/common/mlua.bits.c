@@ -1,10 +1,14 @@
 // Copyright 2024 Remy Blank <remy@c-space.org>
 // SPDX-License-Identifier: MIT
 
+#include <stdint.h>
+#include <string.h>
+
 #include "lua.h"
 #include "lauxlib.h"
 #include "mlua/int64.h"
 #include "mlua/module.h"
+#include "mlua/util.h"
 
 #if MLUA_IS64INT
 #define CLZ __builtin_clzll
@@ -89,12 +93,211 @@ static int mod_mask(lua_State* ls) {
     return luaL_argerror(ls, 1, "too large");
 }
 
+// Bitmaps are stored LSB-first: bit i is bit (i % 8) of byte (i / 8). Words
+// are loaded with memcpy(), which matches this order on little-endian targets.
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+               "bitmap operations require a little-endian target");
+
+typedef unsigned long Word;
+#define WBYTES sizeof(Word)
+#define WBITS (WBYTES * 8)
+
+static inline Word word_mask(unsigned n) {
+    return n < WBITS ? ((Word)1u << n) - 1 : ~(Word)0;
+}
+
+// Load n <= WBITS bits starting at the given bit offset.
+static inline Word load_bits(uint8_t const* p, size_t bit, unsigned n) {
+    p += bit / 8;
+    unsigned sh = bit % 8;
+    unsigned nb = (sh + n + 7) / 8;
+    Word v = 0;
+    memcpy(&v, p, nb < WBYTES ? nb : WBYTES);
+    v >>= sh;
+    if (nb > WBYTES) v |= (Word)p[WBYTES] << (WBITS - sh);
+    return v & word_mask(n);
+}
+
+// Store the n <= WBITS low bits of v starting at the given bit offset.
+static inline void store_bits(uint8_t* p, size_t bit, unsigned n, Word v) {
+    p += bit / 8;
+    unsigned sh = bit % 8;
+    unsigned nb = (sh + n + 7) / 8;
+    Word m = word_mask(n);
+    v &= m;
+    Word w = 0;
+    size_t cnt = nb < WBYTES ? nb : WBYTES;
+    memcpy(&w, p, cnt);
+    w = (w & ~(m << sh)) | (v << sh);
+    memcpy(p, &w, cnt);
+    if (nb > WBYTES) {
+        unsigned hs = WBITS - sh;
+        p[WBYTES] = (p[WBYTES] & ~(uint8_t)(m >> hs)) | (uint8_t)(v >> hs);
+    }
+}
+
+static uint8_t* check_bitmap(lua_State* ls, int arg, size_t* bits, bool ro) {
+    MLuaBuffer buf;
+    bool ok = ro ? mlua_get_ro_buffer(ls, arg, &buf)
+                 : mlua_get_buffer(ls, arg, &buf);
+    luaL_argexpected(ls, ok && buf.vt == NULL, arg, "raw buffer");
+    *bits = buf.size != SIZE_MAX && buf.size < SIZE_MAX / 8 ? buf.size * 8
+                                                            : SIZE_MAX;
+    return buf.ptr;
+}
+
+// Check a bit range argument pair, with defaults covering the remainder of the
+// bitmap.
+static void check_range(lua_State* ls, int arg, size_t bits, size_t* off,
+                        size_t* len) {
+    lua_Unsigned o = luaL_optinteger(ls, arg, 0);
+    luaL_argcheck(ls, o <= bits, arg, "out of bounds");
+    lua_Unsigned l = bits != SIZE_MAX ?
+        (lua_Unsigned)luaL_optinteger(ls, arg + 1, bits - o) :
+        (lua_Unsigned)luaL_checkinteger(ls, arg + 1);
+    luaL_argcheck(ls, l <= bits - o, arg + 1, "out of bounds");
+    *off = o;
+    *len = l;
+}
+
+static int mod_count(lua_State* ls) {
+    size_t bits, off, len;
+    uint8_t const* p = check_bitmap(ls, 1, &bits, true);
+    check_range(ls, 2, bits, &off, &len);
+    lua_Unsigned cnt = 0;
+    for (; len >= WBITS; off += WBITS, len -= WBITS) {
+        cnt += __builtin_popcountl(load_bits(p, off, WBITS));
+    }
+    if (len > 0) cnt += __builtin_popcountl(load_bits(p, off, len));
+    return lua_pushinteger(ls, cnt), 1;
+}
+
+static int find(lua_State* ls, Word inv) {
+    size_t bits, off, len;
+    uint8_t const* p = check_bitmap(ls, 1, &bits, true);
+    check_range(ls, 2, bits, &off, &len);
+    while (len > 0) {
+        unsigned n = len < WBITS ? len : WBITS;
+        Word v = (load_bits(p, off, n) ^ inv) & word_mask(n);
+        if (v != 0) return lua_pushinteger(ls, off + __builtin_ctzl(v)), 1;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int mod_find_set(lua_State* ls) { return find(ls, 0); }
+static int mod_find_clear(lua_State* ls) { return find(ls, ~(Word)0); }
+
+static void fill_range(uint8_t* p, size_t off, size_t len, bool value) {
+    Word v = value ? ~(Word)0 : 0;
+    size_t head = (8 - off % 8) % 8;
+    if (head > len) head = len;
+    if (head > 0) {
+        store_bits(p, off, head, v);
+        off += head;
+        len -= head;
+    }
+    memset(p + off / 8, value ? 0xff : 0, len / 8);
+    off += len & ~(size_t)7;
+    if (len % 8 != 0) store_bits(p, off, len % 8, v);
+}
+
+static int mod_set_range(lua_State* ls) {
+    size_t bits, off, len;
+    uint8_t* p = check_bitmap(ls, 1, &bits, false);
+    check_range(ls, 2, bits, &off, &len);
+    fill_range(p, off, len, true);
+    return 0;
+}
+
+static int mod_clear_range(lua_State* ls) {
+    size_t bits, off, len;
+    uint8_t* p = check_bitmap(ls, 1, &bits, false);
+    check_range(ls, 2, bits, &off, &len);
+    fill_range(p, off, len, false);
+    return 0;
+}
+
+typedef enum { OP_AND, OP_OR, OP_XOR, OP_ANDNOT } BitOp;
+
+static int bitop(lua_State* ls, BitOp op) {
+    size_t dbits, sbits, doff, soff, len;
+    uint8_t* dest = check_bitmap(ls, 1, &dbits, false);
+    lua_Unsigned o = luaL_checkinteger(ls, 2);
+    luaL_argcheck(ls, o <= dbits, 2, "out of bounds");
+    doff = o;
+    uint8_t const* src = check_bitmap(ls, 3, &sbits, true);
+    check_range(ls, 4, sbits, &soff, &len);
+    luaL_argcheck(ls, len <= dbits - doff, 5, "out of bounds");
+    while (len > 0) {
+        unsigned n = len < WBITS ? len : WBITS;
+        Word d = load_bits(dest, doff, n), s = load_bits(src, soff, n);
+        switch (op) {
+        case OP_AND: d &= s; break;
+        case OP_OR: d |= s; break;
+        case OP_XOR: d ^= s; break;
+        case OP_ANDNOT: d &= ~s; break;
+        }
+        store_bits(dest, doff, n, d);
+        doff += n;
+        soff += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int mod_band(lua_State* ls) { return bitop(ls, OP_AND); }
+static int mod_bor(lua_State* ls) { return bitop(ls, OP_OR); }
+static int mod_bxor(lua_State* ls) { return bitop(ls, OP_XOR); }
+static int mod_bandnot(lua_State* ls) { return bitop(ls, OP_ANDNOT); }
+
+static unsigned check_width(lua_State* ls, int arg, size_t bits, size_t off) {
+    lua_Unsigned width = luaL_checkinteger(ls, arg);
+    luaL_argcheck(ls, width <= WBITS && width <= sizeof(lua_Unsigned) * 8,
+                  arg, "too large");
+    luaL_argcheck(ls, width <= bits - off, arg, "out of bounds");
+    return width;
+}
+
+static int mod_extract(lua_State* ls) {
+    size_t bits;
+    uint8_t const* p = check_bitmap(ls, 1, &bits, true);
+    lua_Unsigned off = luaL_checkinteger(ls, 2);
+    luaL_argcheck(ls, off <= bits, 2, "out of bounds");
+    unsigned width = check_width(ls, 3, bits, off);
+    if (width == 0) return lua_pushinteger(ls, 0), 1;
+    return lua_pushinteger(ls, (lua_Unsigned)load_bits(p, off, width)), 1;
+}
+
+static int mod_insert(lua_State* ls) {
+    size_t bits;
+    uint8_t* p = check_bitmap(ls, 1, &bits, false);
+    lua_Unsigned off = luaL_checkinteger(ls, 2);
+    luaL_argcheck(ls, off <= bits, 2, "out of bounds");
+    unsigned width = check_width(ls, 3, bits, off);
+    lua_Unsigned value = luaL_checkinteger(ls, 4);
+    if (width > 0) store_bits(p, off, width, value);
+    return 0;
+}
+
 MLUA_SYMBOLS(module_syms) = {
     MLUA_SYM_F(leading_zeros, mod_),
     MLUA_SYM_F(trailing_zeros, mod_),
     MLUA_SYM_F(ones, mod_),
     MLUA_SYM_F(parity, mod_),
     MLUA_SYM_F(mask, mod_),
+    MLUA_SYM_F(count, mod_),
+    MLUA_SYM_F(find_set, mod_),
+    MLUA_SYM_F(find_clear, mod_),
+    MLUA_SYM_F(set_range, mod_),
+    MLUA_SYM_F(clear_range, mod_),
+    MLUA_SYM_F(band, mod_),
+    MLUA_SYM_F(bor, mod_),
+    MLUA_SYM_F(bxor, mod_),
+    MLUA_SYM_F(bandnot, mod_),
+    MLUA_SYM_F(extract, mod_),
+    MLUA_SYM_F(insert, mod_),
 };
 
 MLUA_OPEN_MODULE(mlua.bits) {
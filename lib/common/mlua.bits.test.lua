@@ -5,6 +5,7 @@ _ENV = module(...)
 
 local bits = require 'mlua.bits'
 local int64 = require 'mlua.int64'
+local mem = require 'mlua.mem'
 local string = require 'string'
 local table = require 'table'
 
@@ -53,3 +54,203 @@ function test_mask(t)
         t:expect(t.expr(bits).mask(arg)):fmt(hex):eq(want)
     end
 end
+
+local raise = {}
+
+-- Return a bitmap buffer initialized from a string of '0' and '1' characters,
+-- in bit order.
+local function bitmap(s)
+    local buf = mem.alloc((#s + 7) // 8)
+    mem.fill(buf, 0)
+    for i = 1, #s do
+        if s:sub(i, i) == '1' then bits.set_range(buf, i - 1, 1) end
+    end
+    return buf
+end
+
+-- Return the contents of a bitmap buffer as a string of '0' and '1'
+-- characters, in bit order.
+local function bitstr(buf)
+    local parts = {}
+    for i = 0, #buf * 8 - 1 do
+        parts[#parts + 1] = bits.extract(buf, i, 1)
+    end
+    return table.concat(parts)
+end
+
+function test_count(t)
+    local buf = bitmap('0110100111000001' .. ('1'):rep(80) .. '00100000')
+    for _, test in ipairs{
+        {{}, 88},
+        {{3}, 86},
+        {{0, 16}, 7},
+        {{5, 7}, 3},
+        {{16, 80}, 80},
+        {{100, 4}, 0},
+        {{104, 0}, 0},
+        {{105}, raise},
+        {{100, 5}, raise},
+    } do
+        local args, want = table.unpack(test)
+        local exp = t:expect(t.expr(bits).count(buf, table.unpack(args)))
+        if want ~= raise then exp:eq(want)
+        else exp:raises("out of bounds") end
+    end
+    t:expect(t.expr(bits).count('\xff\x01')):eq(9)
+    t:expect(t.expr(bits).count(buf:ptr(), 0, 16)):eq(7)
+end
+
+function test_find(t)
+    local buf = bitmap(('0'):rep(70) .. '1' .. ('0'):rep(9) .. ('1'):rep(8))
+    for _, test in ipairs{
+        {{}, 70, 0},
+        {{70}, 70, 71},
+        {{71}, 80, 71},
+        {{81}, 81, nil},
+        {{0, 70}, nil, 0},
+        {{72, 8}, nil, 72},
+        {{88}, nil, nil},
+        {{89}, raise, raise},
+    } do
+        local args, want_set, want_clear = table.unpack(test)
+        local exp = t:expect(t.expr(bits).find_set(buf, table.unpack(args)))
+        if want_set ~= raise then exp:eq(want_set)
+        else exp:raises("out of bounds") end
+        exp = t:expect(t.expr(bits).find_clear(buf, table.unpack(args)))
+        if want_clear ~= raise then exp:eq(want_clear)
+        else exp:raises("out of bounds") end
+    end
+end
+
+function test_set_clear_range(t)
+    local buf = mem.alloc(12)
+    for _, test in ipairs{
+        {{}, ('1'):rep(96)},
+        {{3, 2}, '00011' .. ('0'):rep(91)},
+        {{5, 70}, ('0'):rep(5) .. ('1'):rep(70) .. ('0'):rep(21)},
+        {{16, 16}, ('0'):rep(16) .. ('1'):rep(16) .. ('0'):rep(64)},
+        {{90}, ('0'):rep(90) .. ('1'):rep(6)},
+        {{96, 0}, ('0'):rep(96)},
+        {{97}, raise},
+    } do
+        local args, want = table.unpack(test)
+        mem.fill(buf, 0)
+        local exp = t:expect(t.expr(bits).set_range(buf, table.unpack(args)))
+        if want ~= raise then
+            exp:eq(nil)
+            t:expect(bitstr(buf)):label("set bits"):eq(want)
+            mem.fill(buf, 0xff)
+            bits.clear_range(buf, table.unpack(args))
+            t:expect(bitstr(buf)):label("cleared bits")
+                :eq((want:gsub('.', {['0'] = '1', ['1'] = '0'})))
+        else exp:raises("out of bounds") end
+    end
+end
+
+function test_logic_ops(t)
+    local a = '0011' .. ('01'):rep(40) .. '1100'
+    local b = '0101' .. ('0011'):rep(20) .. '1010'
+    local function op(fn, x, y)
+        local res = {}
+        for i = 1, #x do
+            res[i] = fn(x:byte(i) - 48, y:byte(i) - 48)
+        end
+        return table.concat(res)
+    end
+    for _, test in ipairs{
+        {'band', function(x, y) return x & y end},
+        {'bor', function(x, y) return x | y end},
+        {'bxor', function(x, y) return x ~ y end},
+        {'bandnot', function(x, y) return x & (1 - y) end},
+    } do
+        local name, fn = table.unpack(test)
+        local dest = bitmap(a)
+        bits[name](dest, 0, bitmap(b))
+        t:expect(bitstr(dest)):label("%s", name):eq(op(fn, a, b))
+        -- Unaligned source and destination ranges.
+        dest = bitmap(a)
+        bits[name](dest, 3, bitmap(b), 5, 70)
+        t:expect(bitstr(dest)):label("%s unaligned", name)
+            :eq(a:sub(1, 3) .. op(fn, a:sub(4, 73), b:sub(6, 75))
+                .. a:sub(74))
+    end
+    local dest = bitmap(a)
+    t:expect(t.expr(bits).band(dest, 10, bitmap(b)))
+        :raises("out of bounds")
+    t:expect(t.expr(bits).band(dest, 0, bitmap(b), 89))
+        :raises("out of bounds")
+end
+
+function test_unbounded(t)
+    local buf = mem.alloc(4)
+    local ptr = buf:ptr()
+    for _, name in ipairs{'count', 'find_set', 'find_clear', 'set_range',
+                          'clear_range'} do
+        t:expect(t.expr(bits)[name](ptr)):raises("number expected")
+        t:expect(t.expr(bits)[name](ptr, 8)):raises("number expected")
+    end
+    for _, name in ipairs{'band', 'bor', 'bxor', 'bandnot'} do
+        t:expect(t.expr(bits)[name](buf, 0, ptr)):raises("number expected")
+        t:expect(t.expr(bits)[name](buf, 0, ptr, 8))
+            :raises("number expected")
+    end
+    mem.fill(buf, 0)
+    bits.set_range(ptr, 4, 8)
+    t:expect(t.expr(bits).count(ptr, 0, 32)):eq(8)
+    t:expect(t.expr(bits).find_set(ptr, 0, 32)):eq(4)
+    bits.bor(buf, 16, ptr, 4, 8)
+    t:expect(t.expr(bits).count(buf)):eq(16)
+end
+
+function test_extract_insert(t)
+    local buf = mem.alloc(16)
+    mem.fill(buf, 0)
+    local width = string.packsize('j') * 8
+    for _, test in ipairs{
+        {0, 1, 1},
+        {3, 5, 0x15},
+        {13, 12, 0xabc},
+        {30, 32, 0x12345678},
+        {61, 3, 5},
+        {100, 28, 0xfedcba9},
+        {128, 0, 0},
+    } do
+        local off, w, value = table.unpack(test)
+        bits.insert(buf, off, w, value)
+        t:expect(t.expr(bits).extract(buf, off, w)):fmt(hex):eq(value)
+    end
+    t:expect(t.expr(bits).extract(buf, 3, 5)):fmt(hex):eq(0x15)
+    t:expect(t.expr(bits).extract(buf, 0, width)):fmt(hex)
+        :eq(bits.extract(buf, 0, 32) | bits.extract(buf, 32, width - 32)
+            << 32)
+    bits.insert(buf, 0, 8, 0x1ff)
+    t:expect(t.expr(mem).get(buf, 0)):eq(0xff)
+    t:expect(t.expr(bits).extract(buf, 0, width + 1)):raises("too large")
+    t:expect(t.expr(bits).extract(buf, 120, 9)):raises("out of bounds")
+    t:expect(t.expr(bits).insert(buf, 129, 0, 0)):raises("out of bounds")
+end
+
+function bench_bitmap(t)
+    local size = 64 * 1024
+    local buf, other = mem.alloc(size // 8), mem.alloc(size // 8)
+    mem.fill(buf, 0)
+    mem.fill(other, 0x5a)
+    bits.set_range(buf, size - 1, 1)
+    t:benchmark("count", function(n)
+        for i = 1, n do bits.count(buf) end
+    end, nil, size // 8)
+    t:benchmark("find_set", function(n)
+        for i = 1, n do bits.find_set(buf) end
+    end, nil, size // 8)
+    t:benchmark("bxor", function(n)
+        for i = 1, n do bits.bxor(other, 0, buf) end
+    end, nil, size // 8)
+    t:benchmark("find_set (Lua)", function(n)
+        local get = mem.get
+        for i = 1, n do
+            for j = 0, size // 8 - 1 do
+                if get(buf, j) ~= 0 then break end
+            end
+        end
+    end, nil, size // 8)
+end
@@ -0,0 +1,373 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/platform.h"
+#include "mlua/util.h"
+
+// The minimum number of nodes allocated by a cache, including the list head.
+#define MIN_NODES 8
+
+static char const LRU_name[] = "mlua.cache.LRU";
+
+// User value indexes for LRU.
+typedef enum LRUUserValueIndex {
+    UV_NODES = 1,
+    UV_INDEX,
+    UV_ENTRIES,
+    UV_ON_EVICT,
+    UV_COUNT = UV_ON_EVICT,
+} LRUUserValueIndex;
+
+// A cache entry. Nodes are linked into a circular doubly linked list headed
+// by node 0, from the most recently used to the least recently used. Unused
+// nodes form a singly linked free list through next.
+typedef struct Node {
+    uint32_t prev;
+    uint32_t next;
+    uint64_t expiry;
+    size_t size;
+} Node;
+
+// A least-recently-used cache. The nodes are stored in a separate userdata,
+// which is replaced when the cache grows. The index table maps keys to node
+// indexes, and the entries table holds the value and key of node i at 2*i and
+// 2*i+1, respectively.
+typedef struct LRU {
+    Node* nodes;
+    uint32_t cap;
+    uint32_t free;
+    lua_Integer count;
+    lua_Integer max_count;
+    size_t size;
+    size_t max_size;
+    uint64_t ttl;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t expirations;
+} LRU;
+
+static inline LRU* check_LRU(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, LRU_name);
+}
+
+static inline void unlink_node(Node* nodes, uint32_t i) {
+    Node* n = &nodes[i];
+    nodes[n->prev].next = n->next;
+    nodes[n->next].prev = n->prev;
+}
+
+static inline void link_front(Node* nodes, uint32_t i) {
+    Node* n = &nodes[i];
+    n->prev = 0;
+    n->next = nodes[0].next;
+    nodes[n->next].prev = i;
+    nodes[0].next = i;
+}
+
+static inline bool is_expired(Node const* n) {
+    return n->expiry != 0 && mlua_ticks64_reached(n->expiry);
+}
+
+// Chain the nodes [from, to) into the free list.
+static void free_nodes(LRU* lru, uint32_t from, uint32_t to) {
+    for (uint32_t i = to; i-- > from;) {
+        lru->nodes[i].next = lru->free;
+        lru->free = i;
+    }
+}
+
+// Replace the node storage of the cache at the given index with a larger one.
+static void grow(lua_State* ls, LRU* lru, int arg) {
+    uint32_t cap = lru->cap * 2;
+    if (cap <= lru->cap || cap > SIZE_MAX / sizeof(Node)) {
+        luaL_error(ls, "cache too large");
+        return;
+    }
+    Node* nodes = lua_newuserdatauv(ls, cap * sizeof(Node), 0);
+    memcpy(nodes, lru->nodes, lru->cap * sizeof(Node));
+    lua_setiuservalue(ls, arg, UV_NODES);
+    lru->nodes = nodes;
+    uint32_t prev = lru->cap;
+    lru->cap = cap;
+    free_nodes(lru, prev, cap);
+}
+
+static void init_storage(lua_State* ls, LRU* lru, int arg, uint32_t cap) {
+    lru->nodes = lua_newuserdatauv(ls, cap * sizeof(Node), 0);
+    lua_setiuservalue(ls, arg, UV_NODES);
+    lru->cap = cap;
+    lru->nodes[0].prev = lru->nodes[0].next = 0;
+    lru->free = 0;
+    free_nodes(lru, 1, cap);
+    lua_createtable(ls, 0, 0);
+    lua_setiuservalue(ls, arg, UV_INDEX);
+    lua_createtable(ls, 0, 0);
+    lua_setiuservalue(ls, arg, UV_ENTRIES);
+    lru->count = 0;
+    lru->size = 0;
+}
+
+// Remove node i from the cache at the given index, and push its key and value.
+static void remove_node(lua_State* ls, LRU* lru, int arg, uint32_t i) {
+    lua_getiuservalue(ls, arg, UV_ENTRIES);
+    lua_rawgeti(ls, -1, 2 * (lua_Integer)i + 1);
+    lua_rawgeti(ls, -2, 2 * (lua_Integer)i);
+    lua_pushnil(ls);
+    lua_rawseti(ls, -4, 2 * (lua_Integer)i);
+    lua_pushnil(ls);
+    lua_rawseti(ls, -4, 2 * (lua_Integer)i + 1);
+    lua_getiuservalue(ls, arg, UV_INDEX);
+    lua_pushvalue(ls, -3);
+    lua_pushnil(ls);
+    lua_rawset(ls, -3);
+    lua_pop(ls, 1);
+    lua_remove(ls, -3);
+    Node* n = &lru->nodes[i];
+    unlink_node(lru->nodes, i);
+    --lru->count;
+    lru->size -= n->size;
+    n->next = lru->free;
+    lru->free = i;
+}
+
+// Call the eviction callback of the cache at the given index with the key and
+// value at the top of the stack, and pop them.
+static void call_on_evict(lua_State* ls, int arg, char const* reason) {
+    if (lua_getiuservalue(ls, arg, UV_ON_EVICT) == LUA_TNIL) {
+        lua_pop(ls, 3);
+        return;
+    }
+    lua_insert(ls, -3);
+    lua_pushstring(ls, reason);
+    lua_call(ls, 3, 0);
+}
+
+static inline bool over_limits(LRU const* lru) {
+    return lru->count > 0
+        && ((lru->max_count > 0 && lru->count > lru->max_count)
+            || (lru->max_size > 0 && lru->size > lru->max_size));
+}
+
+// Evict least recently used entries until the cache is within its limits.
+static void evict(lua_State* ls, LRU* lru, int arg) {
+    while (over_limits(lru)) {
+        ++lru->evictions;
+        remove_node(ls, lru, arg, lru->nodes[0].prev);
+        call_on_evict(ls, arg, "evicted");
+    }
+}
+
+// Return the node index of the key at the given index, or zero if the key isn't
+// in the cache.
+static uint32_t find_node(lua_State* ls, int arg, int key) {
+    lua_getiuservalue(ls, arg, UV_INDEX);
+    lua_pushvalue(ls, key);
+    lua_rawget(ls, -2);
+    uint32_t i = lua_tointeger(ls, -1);
+    lua_pop(ls, 2);
+    return i;
+}
+
+static void push_value(lua_State* ls, int arg, uint32_t i) {
+    lua_getiuservalue(ls, arg, UV_ENTRIES);
+    lua_rawgeti(ls, -1, 2 * (lua_Integer)i);
+    lua_remove(ls, -2);
+}
+
+static size_t estimate_size(lua_State* ls, int arg) {
+    switch (lua_type(ls, arg)) {
+    case LUA_TSTRING:
+    case LUA_TUSERDATA:
+        return lua_rawlen(ls, arg);
+    default:
+        return 0;
+    }
+}
+
+static int LRU___new(lua_State* ls) {
+    lua_remove(ls, 1);  // Remove class
+    lua_settop(ls, 4);
+    lua_Integer max_count = luaL_optinteger(ls, 1, 0);
+    luaL_argcheck(ls, 0 <= max_count && max_count <= INT32_MAX, 1,
+                  "out of range");
+    lua_Integer max_size = luaL_optinteger(ls, 2, 0);
+    luaL_argcheck(ls, 0 <= max_size, 2, "out of range");
+    int64_t ttl = luaL_opt(ls, mlua_check_int64, 3, 0);
+    luaL_argcheck(ls, 0 <= ttl, 3, "out of range");
+    LRU* lru = lua_newuserdatauv(ls, sizeof(LRU), UV_COUNT);
+    memset(lru, 0, sizeof(*lru));
+    luaL_getmetatable(ls, LRU_name);
+    lua_setmetatable(ls, -2);
+    lru->max_count = max_count;
+    lru->max_size = max_size;
+    lru->ttl = ttl;
+    int arg = lua_absindex(ls, -1);
+    uint32_t cap = max_count > 0 && max_count + 2 < MIN_NODES ? max_count + 2
+                   : MIN_NODES;
+    init_storage(ls, lru, arg, cap);
+    lua_pushvalue(ls, 4);
+    lua_setiuservalue(ls, arg, UV_ON_EVICT);
+    return 1;
+}
+
+static int LRU_get(lua_State* ls) {
+    LRU* lru = check_LRU(ls, 1);
+    uint32_t i = find_node(ls, 1, 2);
+    if (i == 0) {
+        ++lru->misses;
+        return 0;
+    }
+    if (is_expired(&lru->nodes[i])) {
+        ++lru->misses;
+        ++lru->expirations;
+        remove_node(ls, lru, 1, i);
+        call_on_evict(ls, 1, "expired");
+        return 0;
+    }
+    ++lru->hits;
+    unlink_node(lru->nodes, i);
+    link_front(lru->nodes, i);
+    return push_value(ls, 1, i), 1;
+}
+
+static int LRU_peek(lua_State* ls) {
+    LRU* lru = check_LRU(ls, 1);
+    uint32_t i = find_node(ls, 1, 2);
+    if (i == 0 || is_expired(&lru->nodes[i])) return 0;
+    return push_value(ls, 1, i), 1;
+}
+
+static int LRU_delete(lua_State* ls) {
+    LRU* lru = check_LRU(ls, 1);
+    uint32_t i = find_node(ls, 1, 2);
+    if (i != 0) remove_node(ls, lru, 1, i);
+    return lua_pushboolean(ls, i != 0), 1;
+}
+
+static int LRU_put(lua_State* ls) {
+    LRU* lru = check_LRU(ls, 1);
+    luaL_argcheck(ls, !lua_isnoneornil(ls, 2) && lua_rawequal(ls, 2, 2), 2,
+                  "invalid key");
+    if (lua_isnoneornil(ls, 3)) {
+        LRU_delete(ls);
+        return lua_settop(ls, 1), 1;
+    }
+    int64_t ttl = luaL_opt(ls, mlua_check_int64, 4, (int64_t)lru->ttl);
+    luaL_argcheck(ls, 0 <= ttl, 4, "out of range");
+    size_t est = estimate_size(ls, 2) + estimate_size(ls, 3);
+    lua_Integer size = luaL_opt(ls, luaL_checkinteger, 5, (lua_Integer)est);
+    luaL_argcheck(ls, 0 <= size, 5, "out of range");
+    uint32_t i = find_node(ls, 1, 2);
+    lua_getiuservalue(ls, 1, UV_ENTRIES);
+    if (i != 0) {
+        lua_pushvalue(ls, 3);
+        lua_rawseti(ls, -2, 2 * (lua_Integer)i);
+        lru->size -= lru->nodes[i].size;
+        unlink_node(lru->nodes, i);
+    } else {
+        if (lru->free == 0) grow(ls, lru, 1);
+        i = lru->free;
+        lua_pushvalue(ls, 3);
+        lua_rawseti(ls, -2, 2 * (lua_Integer)i);
+        lua_pushvalue(ls, 2);
+        lua_rawseti(ls, -2, 2 * (lua_Integer)i + 1);
+        lua_getiuservalue(ls, 1, UV_INDEX);
+        lua_pushvalue(ls, 2);
+        lua_pushinteger(ls, i);
+        lua_rawset(ls, -3);
+        lru->free = lru->nodes[i].next;
+        ++lru->count;
+    }
+    Node* n = &lru->nodes[i];
+    n->expiry = ttl != 0 ? mlua_ticks64() + ttl : 0;
+    n->size = size;
+    lru->size += size;
+    link_front(lru->nodes, i);
+    evict(ls, lru, 1);
+    return lua_settop(ls, 1), 1;
+}
+
+static int LRU_purge(lua_State* ls) {
+    LRU* lru = check_LRU(ls, 1);
+    lua_settop(ls, 1);
+    // Remove all expired entries first, then call the eviction callback, so
+    // that the callback can modify the cache.
+    lua_Integer count = 0;
+    for (uint32_t i = lru->nodes[0].prev; i != 0;) {
+        uint32_t prev = lru->nodes[i].prev;
+        if (is_expired(&lru->nodes[i])) {
+            luaL_checkstack(ls, 8, "too many expired entries");
+            ++lru->expirations;
+            remove_node(ls, lru, 1, i);
+            ++count;
+        }
+        i = prev;
+    }
+    for (lua_Integer j = 1; j <= count; ++j) {
+        lua_pushvalue(ls, 2 * j);
+        lua_pushvalue(ls, 2 * j + 1);
+        call_on_evict(ls, 1, "expired");
+    }
+    return lua_pushinteger(ls, count), 1;
+}
+
+static int LRU_clear(lua_State* ls) {
+    LRU* lru = check_LRU(ls, 1);
+    init_storage(ls, lru, 1, MIN_NODES);
+    return 0;
+}
+
+static int LRU_size(lua_State* ls) {
+    return lua_pushinteger(ls, check_LRU(ls, 1)->size), 1;
+}
+
+static int LRU_stats(lua_State* ls) {
+    LRU* lru = check_LRU(ls, 1);
+    mlua_push_int64(ls, lru->hits);
+    mlua_push_int64(ls, lru->misses);
+    mlua_push_int64(ls, lru->evictions);
+    mlua_push_int64(ls, lru->expirations);
+    return 4;
+}
+
+static int LRU___len(lua_State* ls) {
+    return lua_pushinteger(ls, check_LRU(ls, 1)->count), 1;
+}
+
+MLUA_SYMBOLS(LRU_syms) = {
+    MLUA_SYM_F(get, LRU_),
+    MLUA_SYM_F(peek, LRU_),
+    MLUA_SYM_F(put, LRU_),
+    MLUA_SYM_F(delete, LRU_),
+    MLUA_SYM_F(purge, LRU_),
+    MLUA_SYM_F(clear, LRU_),
+    MLUA_SYM_F(size, LRU_),
+    MLUA_SYM_F(stats, LRU_),
+};
+
+MLUA_SYMBOLS_NOHASH(LRU_syms_nh) = {
+    MLUA_SYM_F_NH(__new, LRU_),
+    MLUA_SYM_F_NH(__len, LRU_),
+};
+
+MLUA_OPEN_MODULE(mlua.cache) {
+    mlua_require(ls, "mlua.int64", false);
+
+    // Create the module.
+    mlua_new_module_nohash(ls, 0, mlua_nosyms);
+
+    // Create the LRU class.
+    mlua_new_class(ls, LRU_name, LRU_syms, LRU_syms_nh);
+    mlua_set_metaclass(ls);
+    lua_setfield(ls, -2, "LRU");
+    return 1;
+}
@@ -0,0 +1,145 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+local cache = require 'mlua.cache'
+local int64 = require 'mlua.int64'
+local time = require 'mlua.time'
+local util = require 'mlua.util'
+
+-- Return the keys of the cache entries that are present, without touching
+-- them.
+local function present(c, keys)
+    local res = {}
+    for _, k in ipairs(keys) do
+        if c:peek(k) ~= nil then res[#res + 1] = k end
+    end
+    return res
+end
+
+local function wait_for(delay)
+    local deadline = time.ticks() + delay
+    while time.ticks() <= deadline do end
+end
+
+function test_get_put(t)
+    local c = cache.LRU()
+    t:expect(t.expr(c):get('a')):eq(nil)
+    t:expect(t.expr(c):put('a', 1)):eq(c)
+    c:put('b', 2):put(3, 'c'):put(true, {})
+    t:expect(#c):label("#c"):eq(4)
+    t:expect(t.expr(c):get('a')):eq(1)
+    t:expect(t.expr(c):get(3)):eq('c')
+    c:put('a', 10)
+    t:expect(t.expr(c):get('a')):eq(10)
+    t:expect(t.expr(c):delete('a')):eq(true)
+    t:expect(t.expr(c):delete('a')):eq(false)
+    t:expect(t.expr(c):get('a')):eq(nil)
+    c:put('b', nil)
+    t:expect(t.expr(c):get('b')):eq(nil)
+    t:expect(#c):label("#c"):eq(2)
+    t:expect(t.expr(c):put(nil, 1)):raises("invalid key")
+    t:expect(t.expr(c):put(0 / 0, 1)):raises("invalid key")
+
+    -- Growing keeps all entries.
+    for i = 1, 100 do c:put(i, i * i) end
+    t:expect(#c):label("#c"):eq(101)
+    local ok = true
+    for i = 1, 100 do ok = ok and c:get(i) == i * i end
+    t:expect(ok):label("all present"):eq(true)
+    c:clear()
+    t:expect(#c):label("#c"):eq(0)
+    t:expect(t.expr(c):size()):eq(0)
+    t:expect(t.expr(c):get(1)):eq(nil)
+end
+
+function test_count_limit(t)
+    local evicted = {}
+    local c = cache.LRU(3, 0, 0, function(k, v, reason)
+        evicted[#evicted + 1] = ('%s=%s:%s'):format(k, v, reason)
+    end)
+    c:put('a', 1):put('b', 2):put('c', 3)
+    c:get('a')
+    c:put('d', 4)
+    t:expect(present(c, {'a', 'b', 'c', 'd'})):label("present")
+        :eq({'a', 'c', 'd'}, util.table_eq)
+    c:put('c', 30)
+    c:put('e', 5)
+    c:put('f', 6)
+    t:expect(present(c, {'a', 'b', 'c', 'd', 'e', 'f'})):label("present")
+        :eq({'c', 'e', 'f'}, util.table_eq)
+    t:expect(evicted):label("evicted")
+        :eq({'b=2:evicted', 'a=1:evicted', 'd=4:evicted'}, util.table_eq)
+    t:expect(#c):label("#c"):eq(3)
+end
+
+function test_size_limit(t)
+    local c = cache.LRU(0, 10)
+    c:put('a', 'xxxx')
+    t:expect(t.expr(c):size()):eq(5)
+    c:put('b', 'yyyy')
+    t:expect(t.expr(c):size()):eq(10)
+    c:put('c', 'z')
+    t:expect(present(c, {'a', 'b', 'c'})):label("present")
+        :eq({'b', 'c'}, util.table_eq)
+    t:expect(t.expr(c):size()):eq(7)
+    c:put('d', {}, nil, 4)
+    t:expect(present(c, {'b', 'c', 'd'})):label("present")
+        :eq({'c', 'd'}, util.table_eq)
+    t:expect(t.expr(c):size()):eq(6)
+
+    -- An entry larger than the limit is evicted immediately.
+    c:put('e', 'too large for the cache')
+    t:expect(#c):label("#c"):eq(0)
+    t:expect(t.expr(c):size()):eq(0)
+    t:expect(t.expr(c):put('f', 1, nil, -1)):raises("out of range")
+end
+
+function test_ttl(t)
+    local evicted = {}
+    local c = cache.LRU(0, 0, 1000000, function(k, v, reason)
+        evicted[#evicted + 1] = ('%s:%s'):format(k, reason)
+    end)
+    c:put('a', 1):put('b', 2, 0):put('c', 3, 1):put('d', 4, int64(1))
+    wait_for(2)
+    t:expect(t.expr(c):peek('c')):eq(nil)
+    t:expect(#c):label("#c"):eq(4)
+    t:expect(t.expr(c):get('c')):eq(nil)
+    t:expect(t.expr(c):get('a')):eq(1)
+    t:expect(t.expr(c):get('b')):eq(2)
+    t:expect(#c):label("#c"):eq(3)
+    t:expect(t.expr(c):purge()):eq(1)
+    t:expect(present(c, {'a', 'b', 'c', 'd'})):label("present")
+        :eq({'a', 'b'}, util.table_eq)
+    t:expect(evicted):label("evicted")
+        :eq({'c:expired', 'd:expired'}, util.table_eq)
+    t:expect(t.expr(c):put('e', 1, -1)):raises("out of range")
+end
+
+function test_on_evict_reentrant(t)
+    local c
+    c = cache.LRU(2, 0, 0, function(k, v)
+        if k == 'a' then c:put('x', v) end
+    end)
+    c:put('a', 1):put('b', 2):put('c', 3)
+    t:expect(#c):label("#c"):eq(2)
+    t:expect(present(c, {'a', 'b', 'c', 'x'})):label("present")
+        :eq({'c', 'x'}, util.table_eq)
+    t:expect(t.expr(c):peek('x')):eq(1)
+end
+
+function test_stats(t)
+    local c = cache.LRU(2)
+    c:put('a', 1):put('b', 2)
+    c:get('a')
+    c:get('a')
+    c:get('c')
+    c:peek('b')
+    c:put('c', 3)
+    local hits, misses, evictions, expirations = c:stats()
+    t:expect(hits):label("hits"):eq(2)
+    t:expect(misses):label("misses"):eq(1)
+    t:expect(evictions):label("evictions"):eq(1)
+    t:expect(expirations):label("expirations"):eq(0)
+end
@@ -316,6 +316,26 @@ static int Filesystem_mkconsistent(lua_State* ls) {
 #endif
 }
 
+// Open a file of the filesystem at the given index, and push it as a File
+// value. Returns a negative LFS error and pushes nothing on failure.
+static int open_file(lua_State* ls, int arg, Filesystem* fs, char const* path,
+                     int flags, struct lfs_attr* attrs, lfs_size_t attr_count,
+                     File** file) {
+    File* f = lua_newuserdatauv(ls, sizeof(File) + fs_dev(fs)->write_size, 1);
+    memset(f, 0, sizeof(File));
+    f->config.buffer = f->buffer;
+    f->config.attrs = attrs;
+    f->config.attr_count = attr_count;
+    int res = lfs_file_opencfg(&fs->lfs, &f->file, path, flags, &f->config);
+    if (res < 0) return lua_pop(ls, 1), res;
+    luaL_getmetatable(ls, File_name);
+    lua_setmetatable(ls, -2);
+    lua_pushvalue(ls, arg);  // Keep fs alive
+    lua_setiuservalue(ls, -2, 1);
+    *file = f;
+    return res;
+}
+
 static int Filesystem_open(lua_State* ls) {
     Filesystem* fs = check_Filesystem(ls, 1);
     if (!fs->mounted) return mlua_err_push(ls, MLUA_ENOTCONN);
@@ -329,16 +349,9 @@ static int Filesystem_open(lua_State* ls) {
     }
 #endif
 
-    File* f = lua_newuserdatauv(ls, sizeof(File) + fs_dev(fs)->write_size, 1);
-    memset(f, 0, sizeof(File));
-    f->config.buffer = f->buffer;
-    int res = lfs_file_opencfg(&fs->lfs, &f->file, path, from_open_flags(flags),
-                               &f->config);
+    File* f;
+    int res = open_file(ls, 1, fs, path, from_open_flags(flags), NULL, 0, &f);
     if (res < 0) return push_error(ls, res);
-    luaL_getmetatable(ls, File_name);
-    lua_setmetatable(ls, -2);
-    lua_pushvalue(ls, 1);  // Keep fs alive
-    lua_setiuservalue(ls, -2, 1);
     return 1;
 }
 
@@ -453,6 +466,192 @@ static int Filesystem_rename(lua_State* ls) {
 #endif
 }
 
+// The type of the custom attribute of cached chunks, holding the key of the
+// source from which they were compiled.
+#define CACHE_ATTR 0x63
+
+typedef struct CacheKey {
+    uint32_t size;      // The size of the source
+    uint32_t crc;       // The CRC of the source and the chunk name
+    uint32_t strip;     // Whether the chunk is stripped
+} CacheKey;
+
+typedef struct Loader {
+    Filesystem* fs;
+    lfs_file_t* file;
+    int err;
+#ifndef LFS_READONLY
+    struct lfs_attr attr;
+    char const* source;     // The source name to restore in a stripped dump
+    size_t pos;             // The number of bytes dumped so far
+#endif
+    CacheKey key;
+    char buf[LUAL_BUFFERSIZE];
+} Loader;
+
+static char const* read_chunk(lua_State* ls, void* ud, size_t* size) {
+    Loader* ld = ud;
+    lfs_ssize_t res = lfs_file_read(&ld->fs->lfs, ld->file, ld->buf,
+                                    sizeof(ld->buf));
+    if (res < 0) {
+        ld->err = res;
+        res = 0;
+    }
+    *size = res;
+    return ld->buf;
+}
+
+// Close a file that was opened with open_file().
+static int close_file(lua_State* ls, int arg, Filesystem* fs, File* f) {
+    arg = lua_absindex(ls, arg);
+    lua_pushnil(ls);  // Mark as closed
+    lua_setiuservalue(ls, arg, 1);
+    return lfs_file_close(&fs->lfs, &f->file);
+}
+
+#ifndef LFS_READONLY
+
+// The offset of the source name of the main function in a binary chunk. It
+// must match dump_main_pos() in tools/gen.lua.
+#define DUMP_SOURCE_POS (16 + sizeof(lua_Integer) + sizeof(lua_Number))
+
+static int write_data(Loader* ld, void const* data, size_t size) {
+    lfs_ssize_t res = lfs_file_write(&ld->fs->lfs, ld->file, data, size);
+    if (res < 0) return ld->err = res, 1;
+    return 0;
+}
+
+static int write_chunk(lua_State* ls, void const* data, size_t size,
+                       void* ud) {
+    Loader* ld = ud;
+    size_t pos = ld->pos;
+    ld->pos += size;
+    if (ld->source == NULL || pos != DUMP_SOURCE_POS || size != 1
+            || *(uint8_t const*)data != 0x80) {
+        return write_data(ld, data, size);
+    }
+
+    // Replace the empty source name of a stripped chunk, so that error
+    // messages and tracebacks identify the file. The size is encoded like in
+    // dumpSize().
+    size_t len = strlen(ld->source);
+    uint8_t buf[(sizeof(size_t) * 8 + 6) / 7];
+    uint8_t* p = buf + sizeof(buf);
+    size_t n = len + 1;
+    *--p = (n & 0x7f) | 0x80;
+    for (n >>= 7; n > 0; n >>= 7) *--p = n & 0x7f;
+    if (write_data(ld, p, buf + sizeof(buf) - p) != 0) return 1;
+    return write_data(ld, ld->source, len);
+}
+
+// Write the function at the top of the stack to the cache file at the given
+// index. Failures are ignored, as the cache is only an optimization.
+static void write_cache(lua_State* ls, Loader* ld, int cpath,
+                        char const* chunkname) {
+    char const* path = lua_tostring(ls, cpath);
+    ld->attr.type = CACHE_ATTR;
+    ld->attr.buffer = &ld->key;
+    ld->attr.size = sizeof(ld->key);
+    File* f;
+    int res = open_file(ls, 1, ld->fs, path,
+                        LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC,
+                        &ld->attr, 1, &f);
+    if (res < 0) return;
+    lua_toclose(ls, -1);
+    lua_pushvalue(ls, -2);
+    ld->file = &f->file;
+    ld->err = LFS_ERR_OK;
+    ld->source = ld->key.strip ? chunkname : NULL;
+    ld->pos = 0;
+    lua_dump(ls, &write_chunk, ld, ld->key.strip);
+    lua_pop(ls, 1);
+    res = close_file(ls, -1, ld->fs, f);
+    lua_closeslot(ls, -1);
+    lua_pop(ls, 1);
+    if (ld->err < 0 || res < 0) lfs_remove(&ld->fs->lfs, path);
+}
+
+#endif  // !LFS_READONLY
+
+static int Filesystem_load(lua_State* ls) {
+    Filesystem* fs = check_Filesystem(ls, 1);
+    if (!fs->mounted) return mlua_err_push(ls, MLUA_ENOTCONN);
+    char const* path = luaL_checkstring(ls, 2);
+    if (lua_isnoneornil(ls, 3)) {
+        lua_pushfstring(ls, "@%s", path);
+        lua_replace(ls, 3);
+    }
+    char const* chunkname = luaL_checkstring(ls, 3);
+    bool cache = mlua_to_cbool(ls, 4);
+    bool strip = mlua_to_cbool(ls, 5);
+    lua_settop(ls, 5);
+    Loader* ld = lua_newuserdatauv(ls, sizeof(Loader), 0);
+    ld->fs = fs;
+
+    // Open the source.
+    File* src;
+    int res = open_file(ls, 1, fs, path, LFS_O_RDONLY, NULL, 0, &src);
+    if (res < 0) return push_error(ls, res);
+    lua_toclose(ls, -1);
+    ld->file = &src->file;
+    ld->err = LFS_ERR_OK;
+
+    if (cache) {
+        // Compute the key of the source.
+        ld->key.size = 0;
+        ld->key.crc = 0xffffffffu;
+        ld->key.strip = strip;
+        for (;;) {
+            size_t size;
+            char const* data = read_chunk(ls, ld, &size);
+            if (ld->err < 0) return push_error(ls, ld->err);
+            if (size == 0) break;
+            ld->key.size += size;
+            ld->key.crc = lfs_crc(ld->key.crc, data, size);
+        }
+        // The chunk name is part of the cached chunk.
+        ld->key.crc = lfs_crc(ld->key.crc, chunkname, strlen(chunkname));
+        res = lfs_file_rewind(&fs->lfs, &src->file);
+        if (res < 0) return push_error(ls, res);
+
+        // Load the cached chunk if its key matches.
+        lua_pushfstring(ls, "%sc", path);
+        CacheKey key;
+        lfs_ssize_t ksize = lfs_getattr(&fs->lfs, lua_tostring(ls, -1),
+                                        CACHE_ATTR, &key, sizeof(key));
+        File* f;
+        if (ksize == sizeof(key) && memcmp(&key, &ld->key, sizeof(key)) == 0
+                && open_file(ls, 1, fs, lua_tostring(ls, -1), LFS_O_RDONLY,
+                             NULL, 0, &f) >= 0) {
+            lua_toclose(ls, -1);
+            ld->file = &f->file;
+            if (lua_load(ls, &read_chunk, ld, chunkname, "b") == LUA_OK
+                    && ld->err == LFS_ERR_OK) {
+                return 1;
+            }
+            // Fall back to compiling the source.
+            lua_pop(ls, 1);
+            lua_closeslot(ls, -1);
+            lua_pop(ls, 1);
+            ld->file = &src->file;
+            ld->err = LFS_ERR_OK;
+        }
+    }
+
+    // Compile the source.
+    int status = lua_load(ls, &read_chunk, ld, chunkname, NULL);
+    if (ld->err < 0) return push_error(ls, ld->err);
+    if (status != LUA_OK) {
+        luaL_pushfail(ls);
+        lua_insert(ls, -2);
+        return 2;
+    }
+#ifndef LFS_READONLY
+    if (cache) write_cache(ls, ld, 8, chunkname);
+#endif
+    return 1;
+}
+
 #if !defined(LFS_READONLY) && defined(LFS_MIGRATE)
 
 static int Filesystem_migrate(lua_State* ls) {
@@ -485,6 +684,7 @@ MLUA_SYMBOLS(Filesystem_syms) = {
     MLUA_SYM_F(mkdir, Filesystem_),
     MLUA_SYM_F(remove, Filesystem_),
     MLUA_SYM_F(rename, Filesystem_),
+    MLUA_SYM_F(load, Filesystem_),
 #if !defined(LFS_READONLY) && defined(LFS_MIGRATE)
     MLUA_SYM_F(migrate, Filesystem_),
 #else
@@ -4,18 +4,21 @@
 _ENV = module(...)
 
 local block_mem = require 'mlua.block.mem'
+local debug = require 'debug'
 local errors = require 'mlua.errors'
 local fs = require 'mlua.fs'
 local lfs = require 'mlua.fs.lfs'
 local list = require 'mlua.list'
 local mem = require 'mlua.mem'
 local util = require 'mlua.util'
+local string = require 'string'
 local table = require 'table'
 
 local dev, dfs
 
 local function write_file(path, data)
-    local f<close> = assert(dfs:open(path, fs.O_WRONLY | fs.O_CREAT))
+    local f<close> = assert(
+        dfs:open(path, fs.O_WRONLY | fs.O_CREAT | fs.O_TRUNC))
     assert(f:write(data))
     assert(f:close())
 end
@@ -174,3 +177,69 @@ function test_dir(t)
     }
     t:expect(t.expr.read_dir('/not-found')):raises("no such file")
 end
+
+function test_load(t)
+    local cache_attr = 0x63
+    local function source(f) return debug.getinfo(f, 'S').source end
+    local function stripped(f)
+        return next(debug.getinfo(f, 'L').activelines) == nil
+    end
+
+    -- Load without caching.
+    write_file('/mod.lua', "return 'v1', ...")
+    local f = assert(dfs:load('/mod.lua'))
+    t:expect(t.mexpr(f)('x')):eq{'v1', 'x'}
+    t:expect(t.expr.source(f)):eq('@/mod.lua')
+    t:expect(t.expr(dfs):stat('/mod.luac')):eq(nil)
+
+    -- Compile the source and cache the chunk.
+    f = assert(dfs:load('/mod.lua', nil, true))
+    t:expect(t.expr(f)()):eq('v1')
+    local key = dfs:getattr('/mod.luac', cache_attr)
+    t:expect(key):label("key"):neq(nil)
+
+    -- Load the cached chunk if the source is unchanged.
+    write_file('/mod.luac', string.dump(load("return 'cached'")))
+    assert(dfs:setattr('/mod.luac', cache_attr, key))
+    f = assert(dfs:load('/mod.lua', nil, true))
+    t:expect(t.expr(f)()):eq('cached')
+
+    -- Re-compile the source if the cache is stale.
+    write_file('/mod.lua', "return 'v2'")
+    f = assert(dfs:load('/mod.lua', nil, true))
+    t:expect(t.expr(f)()):eq('v2')
+    t:expect(t.expr(dfs):getattr('/mod.luac', cache_attr)):neq(key)
+    f = assert(dfs:load('/mod.lua', nil, true))
+    t:expect(t.expr(f)()):eq('v2')
+    t:expect(t.expr.source(f)):eq('@/mod.lua')
+
+    -- Re-compile the source if the cached chunk is invalid.
+    key = dfs:getattr('/mod.luac', cache_attr)
+    write_file('/mod.luac', 'invalid')
+    assert(dfs:setattr('/mod.luac', cache_attr, key))
+    f = assert(dfs:load('/mod.lua', nil, true))
+    t:expect(t.expr(f)()):eq('v2')
+
+    -- Cache a stripped chunk, keeping the chunk name.
+    f = assert(dfs:load('/mod.lua', '=mod', true, true))
+    t:expect(t.expr(f)()):eq('v2')
+    t:expect(t.expr.source(f)):eq('=mod')
+    t:expect(t.expr.stripped(f)):eq(false)
+    f = assert(dfs:load('/mod.lua', '=mod', true, true))
+    t:expect(t.expr(f)()):eq('v2')
+    t:expect(t.expr.source(f)):eq('=mod')
+    t:expect(t.expr.stripped(f)):eq(true)
+
+    -- Re-compile the source if the chunk name changes.
+    f = assert(dfs:load('/mod.lua', '=other', true, true))
+    t:expect(t.expr.source(f)):eq('=other')
+    t:expect(t.expr.stripped(f)):eq(false)
+
+    -- Report errors.
+    write_file('/invalid.lua', 'abcde')
+    t:expect(t.mexpr(dfs):load('/invalid.lua', nil, true))
+        :eq{nil, "/invalid.lua:1: syntax error near <eof>"}
+    t:expect(t.expr(dfs):stat('/invalid.luac')):eq(nil)
+    t:expect(t.mexpr(dfs):load('/not-found.lua'))
+        :eq{nil, "no such file or directory", errors.ENOENT}
+end
@@ -0,0 +1,95 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <limits.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lgc.h"
+#include "lstate.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+static void push_mode(lua_State* ls, int mode) {
+    lua_pushstring(ls, mode == LUA_GCGEN ? "generational" : "incremental");
+}
+
+static int mod_mode(lua_State* ls) {
+    return push_mode(ls, isdecGCmodegen(G(ls)) ? LUA_GCGEN : LUA_GCINC), 1;
+}
+
+// The largest values that the collector can store for each parameter. Most
+// parameters are stored divided by four in a byte, the minor multiplier is
+// stored as-is in a byte, and the step size is a log2.
+#define MAX_GCPARAM (4 * MAX_LU_BYTE + 3)
+#define MAX_MINORMUL MAX_LU_BYTE
+#define MAX_STEPSIZE log2maxs(l_mem)
+
+static int check_param(lua_State* ls, int arg, lua_Integer max) {
+    lua_Integer value = luaL_optinteger(ls, arg, 0);
+    luaL_argcheck(ls, 0 <= value && value <= max, arg, "out of range");
+    return value;
+}
+
+static int mod_incremental(lua_State* ls) {
+    int pause = check_param(ls, 1, MAX_GCPARAM);
+    int stepmul = check_param(ls, 2, MAX_GCPARAM);
+    int stepsize = check_param(ls, 3, MAX_STEPSIZE);
+    return push_mode(ls, lua_gc(ls, LUA_GCINC, pause, stepmul, stepsize)), 1;
+}
+
+static int mod_generational(lua_State* ls) {
+    int minormul = check_param(ls, 1, MAX_MINORMUL);
+    int majormul = check_param(ls, 2, MAX_GCPARAM);
+    return push_mode(ls, lua_gc(ls, LUA_GCGEN, minormul, majormul)), 1;
+}
+
+static int mod_collect(lua_State* ls) {
+    lua_gc(ls, LUA_GCCOLLECT);
+    return 0;
+}
+
+static int mod_step(lua_State* ls) {
+    // The collector multiplies the value by 1024 into an l_mem.
+    lua_Integer kbytes = luaL_optinteger(ls, 1, 0);
+    luaL_argcheck(ls, 0 <= kbytes && kbytes <= INT_MAX
+                      && kbytes <= MAX_LMEM / 1024, 1, "out of range");
+    return lua_pushboolean(ls, lua_gc(ls, LUA_GCSTEP, (int)kbytes)), 1;
+}
+
+static int mod_stop(lua_State* ls) {
+    lua_gc(ls, LUA_GCSTOP);
+    return 0;
+}
+
+static int mod_restart(lua_State* ls) {
+    lua_gc(ls, LUA_GCRESTART);
+    return 0;
+}
+
+static int mod_is_running(lua_State* ls) {
+    return lua_pushboolean(ls, lua_gc(ls, LUA_GCISRUNNING)), 1;
+}
+
+static int mod_count(lua_State* ls) {
+    lua_Integer count = ((lua_Integer)lua_gc(ls, LUA_GCCOUNT) << 10)
+                        + lua_gc(ls, LUA_GCCOUNTB);
+    return lua_pushinteger(ls, count), 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(mode, mod_),
+    MLUA_SYM_F(incremental, mod_),
+    MLUA_SYM_F(generational, mod_),
+    MLUA_SYM_F(collect, mod_),
+    MLUA_SYM_F(step, mod_),
+    MLUA_SYM_F(stop, mod_),
+    MLUA_SYM_F(restart, mod_),
+    MLUA_SYM_F(is_running, mod_),
+    MLUA_SYM_F(count, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.gc) {
+    mlua_new_module(ls, 0, module_syms);
+    return 1;
+}
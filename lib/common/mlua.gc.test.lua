@@ -0,0 +1,115 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+local gc = require 'mlua.gc'
+local math = require 'math'
+local util = require 'mlua.util'
+local string = require 'string'
+
+local function restore_mode(t)
+    local mode = gc.mode()
+    t:cleanup(function() gc[mode]() end)
+end
+
+function test_modes(t)
+    restore_mode(t)
+    local prev = gc.mode()
+    t:expect(t.expr(gc).generational()):eq(prev)
+    t:expect(t.expr(gc).mode()):eq('generational')
+    t:expect(t.expr(gc).incremental(150, 100)):eq('generational')
+    t:expect(t.expr(gc).mode()):eq('incremental')
+    t:expect(t.expr(gc).incremental(1024)):raises("out of range")
+    t:expect(t.expr(gc).incremental(0, 1024)):raises("out of range")
+    t:expect(t.expr(gc).incremental(0, 0, 63)):raises("out of range")
+    t:expect(t.expr(gc).generational(-1)):raises("out of range")
+    t:expect(t.expr(gc).generational(256)):raises("out of range")
+    t:expect(t.expr(gc).generational(0, 1024)):raises("out of range")
+    t:expect(gc.mode()):label("mode"):eq('incremental')
+end
+
+function test_control(t)
+    t:cleanup(gc.restart)
+    gc.collect()
+    gc.stop()
+    t:expect(t.expr(gc).is_running()):eq(false)
+    local before = gc.count()
+    local tab = {}
+    for i = 1, 100 do tab[i] = {i} end
+    local after = gc.count()
+    t:expect(after):label("count"):gt(before)
+    gc.restart()
+    t:expect(t.expr(gc).is_running()):eq(true)
+    tab = nil
+    gc.collect()
+    t:expect(gc.count()):label("count"):lt(after)
+    t:expect(t.expr(gc).step(-1)):raises("out of range")
+    t:expect(t.expr(gc).step(math.maxinteger)):raises("out of range")
+end
+
+function test_gc_stats(t)
+    local count, time, max, hist = gc_stats()
+    if not count then t:skip("GC statistics disabled") end
+    gc.collect()
+    local count2, time2, max2, hist2 = gc_stats()
+    t:expect(count2):label("count"):gt(count)
+    t:expect(time2):label("time"):gte(time)
+    t:expect(max2):label("max"):gte(max):lte(time2)
+    local n = 0
+    for _, c in pairs(hist2) do n = n + c end
+    t:expect(n):label("histogram total"):eq(count2)
+
+    t:cleanup(gc.restart)
+    gc.stop()
+    gc_stats(true)
+    local count3, time3, max3 = gc_stats()
+    gc.restart()
+    t:expect(count3):label("count"):eq(0)
+    t:expect(time3):label("time"):eq(0)
+    t:expect(max3):label("max"):eq(0)
+end
+
+-- Return the upper bound of the histogram bucket containing the given
+-- percentile.
+local function percentile(hist, count, p)
+    local sum = 0
+    for _, bound in util.keys(hist):sort():ipairs() do
+        sum = sum + hist[bound]
+        if sum >= p * count then return bound end
+    end
+    return 0
+end
+
+-- Parse messages and keep a sliding window of the most recent ones.
+local function process_messages(n, window)
+    local recent, head = {}, 0
+    for i = 1, n do
+        local line = ('id=%d;temp=%d.%d;status=ok;tags=a,b,c'):format(
+            i, i % 40, i % 10)
+        local msg = {}
+        for k, v in line:gmatch('(%w+)=([^;]*)') do msg[k] = v end
+        local tags = {}
+        for tag in msg.tags:gmatch('[^,]+') do tags[#tags + 1] = tag end
+        msg.tags = tags
+        head = head % window + 1
+        recent[head] = msg
+    end
+end
+
+function bench_gc_pauses(t)
+    if not gc_stats() then t:skip("GC statistics disabled") end
+    restore_mode(t)
+    for _, mode in ipairs{'incremental', 'generational'} do
+        gc[mode]()
+        local count, time, max, hist
+        t:benchmark(mode, function(n)
+            gc_stats(true)
+            process_messages(n, 64)
+            count, time, max, hist = gc_stats()
+        end, 20000)
+        t:printf("%s: %d pauses, p50 < %d us, p99 < %d us, max: %d us, " ..
+                 "total: %d us\n", mode, count, percentile(hist, count, 0.5),
+                 percentile(hist, count, 0.99), max, time)
+    end
+end
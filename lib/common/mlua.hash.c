@@ -0,0 +1,502 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// TODO: Use the DMA sniffer for CRCs on the RP2040
+
+#ifndef MLUA_CRC_SLICE_BY_8
+#define MLUA_CRC_SLICE_BY_8 MLUA_CRC_SLICE_BY_8_DEFAULT
+#endif
+
+#if MLUA_CRC_SLICE_BY_8 && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#undef MLUA_CRC_SLICE_BY_8
+#define MLUA_CRC_SLICE_BY_8 0
+#endif
+
+struct Hash;
+typedef struct Hash Hash;
+
+// An algorithm descriptor.
+typedef struct Algo {
+    void (*reset)(Hash*);
+    void (*update)(void*, void const*, lua_Unsigned);
+    uint32_t (*digest)(Hash const*);
+} Algo;
+
+// The state of an incremental hash computation.
+struct Hash {
+    Algo const* algo;
+    uint32_t a;
+    uint32_t b;
+    int pending;
+};
+
+// CRC-16/CCITT-FALSE: poly 0x1021, init 0xffff, not reflected.
+static uint16_t const crc16_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+};
+
+static void crc16_reset(Hash* h) { h->a = 0xffff; }
+
+static void crc16_update(void* ctx, void const* data, lua_Unsigned len) {
+    Hash* h = ctx;
+    uint8_t const* p = data;
+    uint32_t c = h->a;
+    for (; len > 0; --len) {
+        c = ((c << 8) ^ crc16_table[((c >> 8) ^ *p++) & 0xff]) & 0xffff;
+    }
+    h->a = c;
+}
+
+static uint32_t crc16_digest(Hash const* h) { return h->a; }
+
+// CRC-32 (ISO-HDLC): poly 0xedb88320 (reflected), init and xorout 0xffffffff.
+static uint32_t const crc32_table[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
+
+// CRC-32C (Castagnoli): poly 0x82f63b78 (reflected), init and xorout
+// 0xffffffff.
+static uint32_t const crc32c_table[256] = {
+    0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+    0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+    0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+    0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+    0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+    0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+    0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+    0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+    0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+    0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+    0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+    0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+    0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+    0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+    0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+    0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+    0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+    0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+    0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+    0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+    0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+    0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+    0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+    0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+    0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+    0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+    0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+    0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+    0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+    0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+    0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+    0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+    0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+    0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+    0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+    0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+    0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+    0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+    0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+    0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+    0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+    0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+    0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+
+#if MLUA_CRC_SLICE_BY_8
+
+// Additional tables for slice-by-8, computed when the module is loaded.
+static uint32_t crc32_slices[7][256];
+static uint32_t crc32c_slices[7][256];
+static bool slices_init;
+
+static void init_slices(uint32_t const* t0, uint32_t (*t)[256]) {
+    for (int i = 0; i < 256; ++i) {
+        uint32_t c = t0[i];
+        for (int k = 0; k < 7; ++k) {
+            c = (c >> 8) ^ t0[c & 0xff];
+            t[k][i] = c;
+        }
+    }
+}
+
+#endif  // MLUA_CRC_SLICE_BY_8
+
+static uint32_t crc32_update_table(
+        uint32_t const* t0, uint32_t const (*t)[256], uint32_t c,
+        uint8_t const* p, lua_Unsigned len) {
+#if MLUA_CRC_SLICE_BY_8
+    for (; len > 0 && ((uintptr_t)p & 7) != 0; --len) {
+        c = t0[(c ^ *p++) & 0xff] ^ (c >> 8);
+    }
+    for (; len >= 8; len -= 8, p += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 4, sizeof(hi));
+        lo ^= c;
+        c = t[6][lo & 0xff] ^ t[5][(lo >> 8) & 0xff]
+            ^ t[4][(lo >> 16) & 0xff] ^ t[3][lo >> 24]
+            ^ t[2][hi & 0xff] ^ t[1][(hi >> 8) & 0xff]
+            ^ t[0][(hi >> 16) & 0xff] ^ t0[hi >> 24];
+    }
+#endif
+    for (; len > 0; --len) c = t0[(c ^ *p++) & 0xff] ^ (c >> 8);
+    return c;
+}
+
+#if MLUA_CRC_SLICE_BY_8
+#define CRC32_SLICES crc32_slices
+#define CRC32C_SLICES crc32c_slices
+#else
+#define CRC32_SLICES NULL
+#define CRC32C_SLICES NULL
+#endif
+
+static void crc32_reset(Hash* h) { h->a = 0xffffffffu; }
+
+static void crc32_update(void* ctx, void const* data, lua_Unsigned len) {
+    Hash* h = ctx;
+    h->a = crc32_update_table(crc32_table, CRC32_SLICES, h->a, data, len);
+}
+
+static uint32_t crc32_digest(Hash const* h) { return h->a ^ 0xffffffffu; }
+
+static void crc32c_update(void* ctx, void const* data, lua_Unsigned len) {
+    Hash* h = ctx;
+    uint8_t const* p = data;
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+    uint32_t c = h->a;
+    for (; len > 0 && ((uintptr_t)p & 7) != 0; --len) {
+#if defined(__SSE4_2__)
+        c = _mm_crc32_u8(c, *p++);
+#else
+        c = __crc32cb(c, *p++);
+#endif
+    }
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+#if defined(__SSE4_2__)
+        c = (uint32_t)_mm_crc32_u64(c, v);
+#else
+        c = __crc32cd(c, v);
+#endif
+    }
+    h->a = crc32_update_table(crc32c_table, NULL, c, p, len);
+#else
+    h->a = crc32_update_table(crc32c_table, CRC32C_SLICES, h->a, p, len);
+#endif
+}
+
+// Adler-32, as defined in RFC 1950.
+#define ADLER_MOD 65521
+#define ADLER_NMAX 5552
+
+static void adler32_reset(Hash* h) {
+    h->a = 1;
+    h->b = 0;
+}
+
+static void adler32_update(void* ctx, void const* data, lua_Unsigned len) {
+    Hash* h = ctx;
+    uint8_t const* p = data;
+    uint32_t a = h->a, b = h->b;
+    while (len > 0) {
+        lua_Unsigned n = len < ADLER_NMAX ? len : ADLER_NMAX;
+        len -= n;
+        for (; n > 0; --n) {
+            a += *p++;
+            b += a;
+        }
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+    }
+    h->a = a;
+    h->b = b;
+}
+
+static uint32_t adler32_digest(Hash const* h) { return (h->b << 16) | h->a; }
+
+// Fletcher-16, over bytes.
+#define FLETCHER16_NMAX 5802
+
+static void fletcher_reset(Hash* h) {
+    h->a = 0;
+    h->b = 0;
+    h->pending = -1;
+}
+
+static void fletcher16_update(void* ctx, void const* data, lua_Unsigned len) {
+    Hash* h = ctx;
+    uint8_t const* p = data;
+    uint32_t a = h->a, b = h->b;
+    while (len > 0) {
+        lua_Unsigned n = len < FLETCHER16_NMAX ? len : FLETCHER16_NMAX;
+        len -= n;
+        for (; n > 0; --n) {
+            a += *p++;
+            b += a;
+        }
+        a %= 255;
+        b %= 255;
+    }
+    h->a = a;
+    h->b = b;
+}
+
+static uint32_t fletcher16_digest(Hash const* h) {
+    return (h->b << 8) | h->a;
+}
+
+// Fletcher-32, over little-endian 16-bit words. An odd trailing byte is padded
+// with zero.
+#define FLETCHER32_NMAX 359
+
+static void fletcher32_update(void* ctx, void const* data, lua_Unsigned len) {
+    Hash* h = ctx;
+    uint8_t const* p = data;
+    uint8_t const* end = p + len;
+    uint32_t a = h->a, b = h->b;
+    if (h->pending >= 0 && p < end) {
+        a = (a + ((uint32_t)h->pending | ((uint32_t)*p++ << 8))) % 65535;
+        b = (b + a) % 65535;
+        h->pending = -1;
+    }
+    while (end - p >= 2) {
+        lua_Unsigned n = (end - p) / 2;
+        if (n > FLETCHER32_NMAX) n = FLETCHER32_NMAX;
+        for (; n > 0; --n, p += 2) {
+            a += p[0] | ((uint32_t)p[1] << 8);
+            b += a;
+        }
+        a %= 65535;
+        b %= 65535;
+    }
+    if (p < end) h->pending = *p;
+    h->a = a;
+    h->b = b;
+}
+
+static uint32_t fletcher32_digest(Hash const* h) {
+    uint32_t a = h->a, b = h->b;
+    if (h->pending >= 0) {
+        a = (a + h->pending) % 65535;
+        b = (b + a) % 65535;
+    }
+    return (b << 16) | a;
+}
+
+// FNV-1a, 32 bits.
+static void fnv1a32_reset(Hash* h) { h->a = 0x811c9dc5u; }
+
+static void fnv1a32_update(void* ctx, void const* data, lua_Unsigned len) {
+    Hash* h = ctx;
+    uint8_t const* p = data;
+    uint32_t v = h->a;
+    for (; len > 0; --len) v = (v ^ *p++) * 0x01000193u;
+    h->a = v;
+}
+
+static uint32_t fnv1a32_digest(Hash const* h) { return h->a; }
+
+static char const* const algo_names[] = {
+    "crc16", "crc32", "crc32c", "adler32", "fletcher16", "fletcher32",
+    "fnv1a32", NULL,
+};
+
+static Algo const algos[] = {
+    {.reset = &crc16_reset, .update = &crc16_update, .digest = &crc16_digest},
+    {.reset = &crc32_reset, .update = &crc32_update, .digest = &crc32_digest},
+    {.reset = &crc32_reset, .update = &crc32c_update, .digest = &crc32_digest},
+    {.reset = &adler32_reset, .update = &adler32_update,
+     .digest = &adler32_digest},
+    {.reset = &fletcher_reset, .update = &fletcher16_update,
+     .digest = &fletcher16_digest},
+    {.reset = &fletcher_reset, .update = &fletcher32_update,
+     .digest = &fletcher32_digest},
+    {.reset = &fnv1a32_reset, .update = &fnv1a32_update,
+     .digest = &fnv1a32_digest},
+};
+
+// Feed the range of the buffer or string at the given argument to a hash.
+static void update(lua_State* ls, int arg, Hash* h) {
+    MLuaBuffer src;
+    if (!mlua_get_ro_buffer(ls, arg, &src)) {
+        luaL_typeerror(ls, arg, "string or buffer");
+    }
+    lua_Unsigned off = luaL_optinteger(ls, arg + 1, 0);
+    luaL_argcheck(ls, off <= src.size, arg + 1, "out of bounds");
+    lua_Unsigned len = src.size != (size_t)-1 ?
+        (lua_Unsigned)luaL_optinteger(ls, arg + 2, src.size - off) :
+        (lua_Unsigned)luaL_checkinteger(ls, arg + 2);
+    luaL_argcheck(ls, len <= src.size - off, arg + 2, "out of bounds");
+    mlua_buffer_visit(&src, off, len, h->algo->update, h);
+}
+
+static char const Hash_name[] = "mlua.hash.Hash";
+
+static Hash* check_Hash(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Hash_name);
+}
+
+static int Hash_update(lua_State* ls) {
+    update(ls, 2, check_Hash(ls, 1));
+    return lua_settop(ls, 1), 1;
+}
+
+static int Hash_digest(lua_State* ls) {
+    Hash const* h = check_Hash(ls, 1);
+    return lua_pushinteger(ls, (lua_Integer)h->algo->digest(h)), 1;
+}
+
+static int Hash_reset(lua_State* ls) {
+    Hash* h = check_Hash(ls, 1);
+    h->algo->reset(h);
+    return lua_settop(ls, 1), 1;
+}
+
+MLUA_SYMBOLS(Hash_syms) = {
+    MLUA_SYM_F(update, Hash_),
+    MLUA_SYM_F(digest, Hash_),
+    MLUA_SYM_F(reset, Hash_),
+};
+
+static int mod_new(lua_State* ls) {
+    Algo const* algo = &algos[luaL_checkoption(ls, 1, NULL, algo_names)];
+    Hash* h = lua_newuserdatauv(ls, sizeof(Hash), 0);
+    luaL_getmetatable(ls, Hash_name);
+    lua_setmetatable(ls, -2);
+    h->algo = algo;
+    algo->reset(h);
+    return 1;
+}
+
+static int hash(lua_State* ls, Algo const* algo) {
+    Hash h = {.algo = algo};
+    algo->reset(&h);
+    update(ls, 1, &h);
+    return lua_pushinteger(ls, (lua_Integer)algo->digest(&h)), 1;
+}
+
+static int mod_crc16(lua_State* ls) { return hash(ls, &algos[0]); }
+static int mod_crc32(lua_State* ls) { return hash(ls, &algos[1]); }
+static int mod_crc32c(lua_State* ls) { return hash(ls, &algos[2]); }
+static int mod_adler32(lua_State* ls) { return hash(ls, &algos[3]); }
+static int mod_fletcher16(lua_State* ls) { return hash(ls, &algos[4]); }
+static int mod_fletcher32(lua_State* ls) { return hash(ls, &algos[5]); }
+static int mod_fnv1a32(lua_State* ls) { return hash(ls, &algos[6]); }
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(new, mod_),
+    MLUA_SYM_F(crc16, mod_),
+    MLUA_SYM_F(crc32, mod_),
+    MLUA_SYM_F(crc32c, mod_),
+    MLUA_SYM_F(adler32, mod_),
+    MLUA_SYM_F(fletcher16, mod_),
+    MLUA_SYM_F(fletcher32, mod_),
+    MLUA_SYM_F(fnv1a32, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.hash) {
+#if MLUA_CRC_SLICE_BY_8
+    if (!slices_init) {
+        init_slices(crc32_table, crc32_slices);
+        init_slices(crc32c_table, crc32c_slices);
+        slices_init = true;
+    }
+#endif
+
+    // Create the module.
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Hash class.
+    mlua_new_class(ls, Hash_name, Hash_syms, mlua_nosyms);
+    lua_pop(ls, 1);
+    return 1;
+}
@@ -0,0 +1,95 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+local math = require 'math'
+local hash = require 'mlua.hash'
+local mem = require 'mlua.mem'
+local string = require 'string'
+local table = require 'table'
+
+local algos = {'crc16', 'crc32', 'crc32c', 'adler32', 'fletcher16',
+               'fletcher32', 'fnv1a32'}
+
+-- Known-answer vectors, in the order of algos.
+local vectors = {
+    {'', 0xffff, 0x00000000, 0x00000000, 0x00000001, 0x0000, 0x00000000,
+     0x811c9dc5},
+    {'123456789', 0x29b1, 0xcbf43926, 0xe3069283, 0x091e01de, 0x1ede,
+     0xdf09d509, 0xbb86b11c},
+    {'abcde', 0x2fed, 0x8587d865, 0xc450d697, 0x05c801f0, 0xc8f0, 0xf04fc729,
+     0x749bcf08},
+    {'abcdef', 0x34ed, 0x4b8e39ef, 0x53bceff1, 0x081e0256, 0x2057, 0x56502d2a,
+     0xff478a2a},
+    {'Wikipedia', 0xec0f, 0xadaac02e, 0x2d0e3663, 0x11e60398, 0xee9a,
+     0xb7dda1f8, 0xa1f3dd10},
+    {'foobar', 0xbe35, 0x9ef61f95, 0x0d5f5c7f, 0x08ab027a, 0xad7b, 0x85734437,
+     0xbf9cf968},
+}
+
+local function data(size)
+    local parts = {}
+    for i = 0, size - 1 do
+        parts[#parts + 1] = string.char((i * 7919 ~ i >> 5) & 0xff)
+    end
+    return table.concat(parts)
+end
+
+function test_known_answers(t)
+    for _, vec in ipairs(vectors) do
+        local input = vec[1]
+        for i, algo in ipairs(algos) do
+            t:expect(t.expr(hash)[algo](input)):eq(vec[i + 1])
+            local h = hash.new(algo)
+            t:expect(t.expr(h):update(input):digest()):eq(vec[i + 1])
+        end
+    end
+end
+
+function test_buffers(t)
+    local input = 'xx123456789yy'
+    local buf = mem.alloc(#input)
+    mem.write(buf, input)
+    for _, args in ipairs{{input, 2, 9}, {buf, 2, 9}, {buf:ptr(), 2, 9}} do
+        t:expect(t.expr(hash).crc32(table.unpack(args))):eq(0xcbf43926)
+    end
+    t:expect(t.expr(hash).crc32(input, 13)):eq(0)
+    t:expect(t.expr(hash).crc32(input, 14)):raises("out of bounds")
+    t:expect(t.expr(hash).crc32(input, 2, 12)):raises("out of bounds")
+    t:expect(t.expr(hash).crc32(input, 1, -1)):raises("out of bounds")
+    t:expect(t.expr(hash).crc32(buf, 13, -1)):raises("out of bounds")
+    t:expect(t.expr(hash.new('crc32')):update('abc', 1, -1))
+        :raises("out of bounds")
+    t:expect(t.expr(hash).crc32(buf:ptr())):raises("number expected")
+    t:expect(t.expr(hash).crc32(true)):raises("string or buffer expected")
+    t:expect(t.expr(hash).new('md5')):raises("invalid option")
+end
+
+function test_streaming(t)
+    local input = data(20000)
+    for _, algo in ipairs(algos) do
+        local want = hash[algo](input)
+        local h = hash.new(algo)
+        local pos, n = 0, 1
+        while pos < #input do
+            n = math.min(n, #input - pos)
+            h:update(input, pos, n)
+            pos, n = pos + n, n * 3 + 1
+        end
+        t:expect(t.expr(h):digest()):eq(want)
+        t:expect(t.expr(h):reset():update(input):digest()):eq(want)
+        t:expect(t.expr(h):reset():digest()):eq(hash[algo](''))
+    end
+end
+
+function bench_hash(t)
+    local size = 4096
+    local input = data(size)
+    for _, algo in ipairs(algos) do
+        local fn = hash[algo]
+        t:benchmark(algo, function(n)
+            for i = 1, n do fn(input) end
+        end, nil, size)
+    end
+end
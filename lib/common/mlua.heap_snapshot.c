@@ -0,0 +1,615 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "lstring.h"
+#include "ltable.h"
+#include "ltm.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The default number of objects reported per list.
+#ifndef MLUA_HEAP_SNAPSHOT_TOP
+#define MLUA_HEAP_SNAPSHOT_TOP 8
+#endif
+
+// The default maximum number of containers visited while computing retention
+// paths.
+#ifndef MLUA_HEAP_SNAPSHOT_NODES
+#define MLUA_HEAP_SNAPSHOT_NODES 1024
+#endif
+
+// The maximum number of path segments output per retention path. Longer paths
+// are truncated at the root side.
+#ifndef MLUA_HEAP_SNAPSHOT_DEPTH
+#define MLUA_HEAP_SNAPSHOT_DEPTH 24
+#endif
+
+// The maximum length of a string key output in a path.
+#define MAX_KEY_LEN 32
+
+#define NONE UINT32_MAX
+
+// Object types, as reported in snapshots.
+typedef enum Type {
+    TYPE_STRING,
+    TYPE_TABLE,
+    TYPE_FUNCTION,
+    TYPE_CFUNCTION,
+    TYPE_USERDATA,
+    TYPE_THREAD,
+    TYPE_PROTO,
+    TYPE_UPVALUE,
+    TYPE_COUNT,
+} Type;
+
+static char const* const type_names[TYPE_COUNT] = {
+    "string", "table", "function", "cfunction", "userdata", "thread", "proto",
+    "upvalue",
+};
+
+// The kind of reference from a container to an object.
+typedef enum Edge {
+    EDGE_ROOT,          // Root object; key.p: name, NULL for threads
+    EDGE_TYPE_MT,       // Root metatable of a basic type; key.i: type
+    EDGE_FIELD,         // Value at a string key; key.p: TString*
+    EDGE_INDEX,         // Value at an integer key; key.i: index
+    EDGE_LIGHT,         // Value at a light userdata key; key.p: pointer
+    EDGE_OBJECT,        // Value at an object key; key.p: GCObject*
+    EDGE_VALUE,         // Value at a key of another type
+    EDGE_KEY,           // Key in a table
+    EDGE_META,          // Metatable
+    EDGE_UPVAL,         // Upvalue; key.p: TString* name
+    EDGE_UPVAL_INDEX,   // Unnamed upvalue; key.i: index
+    EDGE_USER_VALUE,    // User value of a userdata; key.i: index
+    EDGE_STACK,         // Stack slot of a thread; key.i: index
+    EDGE_PROTO,         // Prototype of a Lua function
+} Edge;
+
+typedef union Key {
+    void const* p;
+    int32_t i;
+} Key;
+
+// A reference to an object from its parent.
+typedef struct Entry {
+    GCObject* obj;
+    uint32_t parent;
+    uint8_t edge;
+    Key key;
+} Entry;
+
+// An object reported in a snapshot.
+typedef struct Target {
+    GCObject* obj;
+    size_t size;
+    uint8_t type;
+    bool found;
+    unsigned int asize;     // Size of the array part of a table
+    unsigned int hsize;     // Size of the hash part of a table
+    Entry path;
+} Target;
+
+// The state of a snapshot. The entries form a breadth-first queue of the
+// containers visited from the roots, each with a reference to the container
+// through which it was first reached. "visited" is an open-addressing hash set
+// of entry indexes, keyed by object.
+typedef struct Snapshot {
+    lua_State* ls;
+    GCObject* self;
+    uint32_t nobjects;
+    uint32_t ntables;
+    uint32_t nodes;
+    uint32_t count;
+    uint32_t mask;
+    bool truncated;
+    size_t min_size;
+    size_t type_count[TYPE_COUNT];
+    size_t type_size[TYPE_COUNT];
+    Target* objects;
+    Target* tables;
+    Entry* entries;
+    uint32_t* visited;
+} Snapshot;
+
+static Type object_type(GCObject* o) {
+    switch (o->tt) {
+    case LUA_VSHRSTR: case LUA_VLNGSTR: return TYPE_STRING;
+    case LUA_VTABLE: return TYPE_TABLE;
+    case LUA_VLCL: return TYPE_FUNCTION;
+    case LUA_VCCL: return TYPE_CFUNCTION;
+    case LUA_VUSERDATA: return TYPE_USERDATA;
+    case LUA_VTHREAD: return TYPE_THREAD;
+    case LUA_VPROTO: return TYPE_PROTO;
+    case LUA_VUPVAL: return TYPE_UPVALUE;
+    default: return TYPE_COUNT;
+    }
+}
+
+static size_t object_size(GCObject* o) {
+    switch (o->tt) {
+    case LUA_VSHRSTR: case LUA_VLNGSTR:
+        return sizelstring(tsslen(gco2ts(o)));
+    case LUA_VTABLE: {
+        Table* h = gco2t(o);
+        return sizeof(Table) + sizeof(TValue) * luaH_realasize(h)
+               + sizeof(Node) * allocsizenode(h);
+    }
+    case LUA_VLCL:
+        return sizeLclosure(gco2lcl(o)->nupvalues);
+    case LUA_VCCL:
+        return sizeCclosure(gco2ccl(o)->nupvalues);
+    case LUA_VUSERDATA: {
+        Udata* u = gco2u(o);
+        return sizeudata(u->nuvalue, u->len);
+    }
+    case LUA_VTHREAD: {
+        lua_State* th = gco2th(o);
+        return LUA_EXTRASPACE + sizeof(lua_State)
+               + sizeof(StackValue) * (stacksize(th) + EXTRA_STACK)
+               + sizeof(CallInfo) * th->nci;
+    }
+    case LUA_VPROTO: {
+        Proto* p = gco2p(o);
+        return sizeof(Proto) + sizeof(Instruction) * p->sizecode
+               + sizeof(Proto*) * p->sizep + sizeof(TValue) * p->sizek
+               + sizeof(ls_byte) * p->sizelineinfo
+               + sizeof(AbsLineInfo) * p->sizeabslineinfo
+               + sizeof(LocVar) * p->sizelocvars
+               + sizeof(Upvaldesc) * p->sizeupvalues;
+    }
+    case LUA_VUPVAL:
+        return sizeof(UpVal);
+    default:
+        return 0;
+    }
+}
+
+static inline bool is_container(GCObject* o) {
+    switch (o->tt) {
+    case LUA_VTABLE: case LUA_VLCL: case LUA_VCCL: case LUA_VUSERDATA:
+    case LUA_VTHREAD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Insert an object into a list of targets sorted by decreasing size.
+static void add_target(Target* targets, uint32_t len, Target const* t) {
+    if (len == 0 || t->size <= targets[len - 1].size) return;
+    uint32_t i = len - 1;
+    for (; i > 0 && t->size > targets[i - 1].size; --i) {
+        targets[i] = targets[i - 1];
+    }
+    targets[i] = *t;
+}
+
+static void count_objects(Snapshot* s, GCObject* o) {
+    for (; o != NULL; o = o->next) {
+        if (o == s->self) continue;
+        Type type = object_type(o);
+        if (type == TYPE_COUNT) continue;
+        Target t = {.obj = o, .size = object_size(o), .type = type};
+        ++s->type_count[type];
+        s->type_size[type] += t.size;
+        if (type == TYPE_TABLE) {
+            Table* h = gco2t(o);
+            t.asize = luaH_realasize(h);
+            t.hsize = allocsizenode(h);
+            add_target(s->tables, s->ntables, &t);
+        }
+        add_target(s->objects, s->nobjects, &t);
+    }
+}
+
+static inline uint32_t* lookup(Snapshot* s, GCObject* o) {
+    uint32_t i = (uint32_t)(((uintptr_t)o >> 3) * 2654435761u) & s->mask;
+    for (;; i = (i + 1) & s->mask) {
+        uint32_t* slot = &s->visited[i];
+        if (*slot == NONE || s->entries[*slot].obj == o) return slot;
+    }
+}
+
+// Record a reference to an object. Containers are queued for traversal, other
+// objects are only recorded if they are reported.
+static void visit(Snapshot* s, uint32_t parent, GCObject* o, Edge edge,
+                  Key key) {
+    if (o == s->self) return;
+    if (is_container(o)) {
+        uint32_t* slot = lookup(s, o);
+        if (*slot != NONE) return;
+        if (s->count == s->nodes) {
+            s->truncated = true;
+            return;
+        }
+        *slot = s->count;
+        s->entries[s->count++] = (Entry){
+            .obj = o, .parent = parent, .edge = edge, .key = key};
+        return;
+    }
+    if (object_size(o) < s->min_size) return;
+    Entry path = {.obj = o, .parent = parent, .edge = edge, .key = key};
+    for (uint32_t i = 0; i < s->nobjects; ++i) {
+        Target* t = &s->objects[i];
+        if (t->obj == o && !t->found) t->path = path, t->found = true;
+    }
+}
+
+static inline void visit_value(Snapshot* s, uint32_t parent, TValue const* v,
+                               Edge edge, Key key) {
+    if (iscollectable(v)) visit(s, parent, gcvalue(v), edge, key);
+}
+
+static void visit_node(Snapshot* s, uint32_t parent, Node* n) {
+    Key key = {0};
+    Edge edge = EDGE_VALUE;
+    switch (keytt(n)) {
+    case LUA_VSHRSTR: case LUA_VLNGSTR:
+        edge = EDGE_FIELD;
+        key.p = keystrval(n);
+        break;
+    case LUA_VNUMINT: {
+        lua_Integer i = keyival(n);
+        if (INT32_MIN <= i && i <= INT32_MAX) {
+            edge = EDGE_INDEX;
+            key.i = (int32_t)i;
+        }
+        break;
+    }
+    case LUA_VLIGHTUSERDATA:
+        edge = EDGE_LIGHT;
+        key.p = keyval(n).p;
+        break;
+    default:
+        if (keyiscollectable(n)) {
+            edge = EDGE_OBJECT;
+            key.p = gckey(n);
+        }
+        break;
+    }
+    visit_value(s, parent, gval(n), edge, key);
+}
+
+static void traverse_table(Snapshot* s, uint32_t idx, Table* h) {
+    // References through weak keys or values don't retain objects.
+    bool weak_keys = false, weak_values = false;
+    if (h->metatable != NULL) {
+        visit(s, idx, obj2gco(h->metatable), EDGE_META, (Key){0});
+        TValue const* mode = gfasttm(G(s->ls), h->metatable, TM_MODE);
+        if (mode != NULL && ttisstring(mode)) {
+            char const* m = getstr(tsvalue(mode));
+            weak_keys = strchr(m, 'k') != NULL;
+            weak_values = strchr(m, 'v') != NULL;
+        }
+    }
+    if (!weak_values) {
+        unsigned int asize = luaH_realasize(h);
+        for (unsigned int i = 0; i < asize; ++i) {
+            visit_value(s, idx, &h->array[i], EDGE_INDEX,
+                        (Key){.i = (int32_t)(i + 1)});
+        }
+    }
+    for (size_t i = 0, size = sizenode(h); i < size; ++i) {
+        Node* n = gnode(h, i);
+        if (isempty(gval(n))) continue;
+        if (!weak_keys && keyiscollectable(n)) {
+            visit(s, idx, gckey(n), EDGE_KEY, (Key){0});
+        }
+        if (!weak_values) visit_node(s, idx, n);
+    }
+}
+
+static void traverse_lclosure(Snapshot* s, uint32_t idx, LClosure* cl) {
+    visit(s, idx, obj2gco(cl->p), EDGE_PROTO, (Key){0});
+    for (int i = 0; i < cl->nupvalues; ++i) {
+        UpVal* uv = cl->upvals[i];
+        if (uv == NULL) continue;
+        TString* name = cl->p->upvalues[i].name;
+        if (name != NULL) {
+            visit_value(s, idx, uv->v.p, EDGE_UPVAL, (Key){.p = name});
+        } else {
+            visit_value(s, idx, uv->v.p, EDGE_UPVAL_INDEX, (Key){.i = i + 1});
+        }
+    }
+}
+
+static void traverse_cclosure(Snapshot* s, uint32_t idx, CClosure* cl) {
+    for (int i = 0; i < cl->nupvalues; ++i) {
+        visit_value(s, idx, &cl->upvalue[i], EDGE_UPVAL_INDEX,
+                    (Key){.i = i + 1});
+    }
+}
+
+static void traverse_udata(Snapshot* s, uint32_t idx, Udata* u) {
+    if (u->metatable != NULL) {
+        visit(s, idx, obj2gco(u->metatable), EDGE_META, (Key){0});
+    }
+    for (int i = 0; i < u->nuvalue; ++i) {
+        visit_value(s, idx, &u->uv[i].uv, EDGE_USER_VALUE, (Key){.i = i + 1});
+    }
+}
+
+static void traverse_thread(Snapshot* s, uint32_t idx, lua_State* th) {
+    for (StkId o = th->stack.p; o < th->top.p; ++o) {
+        visit_value(s, idx, s2v(o), EDGE_STACK,
+                    (Key){.i = (int32_t)(o - th->stack.p)});
+    }
+}
+
+static void traverse(Snapshot* s, uint32_t idx) {
+    GCObject* o = s->entries[idx].obj;
+    switch (o->tt) {
+    case LUA_VTABLE: traverse_table(s, idx, gco2t(o)); break;
+    case LUA_VLCL: traverse_lclosure(s, idx, gco2lcl(o)); break;
+    case LUA_VCCL: traverse_cclosure(s, idx, gco2ccl(o)); break;
+    case LUA_VUSERDATA: traverse_udata(s, idx, gco2u(o)); break;
+    case LUA_VTHREAD: traverse_thread(s, idx, gco2th(o)); break;
+    }
+}
+
+// Add all threads as roots, so that objects that are only referenced from a
+// thread's stack get a short path.
+static void add_thread_roots(Snapshot* s, GCObject* o) {
+    for (; o != NULL; o = o->next) {
+        if (o->tt == LUA_VTHREAD) visit(s, NONE, o, EDGE_ROOT, (Key){0});
+    }
+}
+
+// Set the path of the targets that are containers from their entries.
+static void resolve_paths(Snapshot* s, Target* targets, uint32_t len) {
+    for (uint32_t i = 0; i < len; ++i) {
+        Target* t = &targets[i];
+        if (t->found || t->obj == NULL || !is_container(t->obj)) continue;
+        uint32_t idx = *lookup(s, t->obj);
+        if (idx == NONE) continue;
+        t->path = s->entries[idx];
+        t->found = true;
+    }
+}
+
+static void find_paths(Snapshot* s) {
+    global_State* g = G(s->ls);
+    visit_value(s, NONE, &hvalue(&g->l_registry)->array[LUA_RIDX_GLOBALS - 1],
+                EDGE_ROOT, (Key){.p = "_G"});
+    visit_value(s, NONE, &g->l_registry, EDGE_ROOT, (Key){.p = "registry"});
+    for (int i = 0; i < LUA_NUMTYPES; ++i) {
+        if (g->mt[i] == NULL) continue;
+        visit(s, NONE, obj2gco(g->mt[i]), EDGE_TYPE_MT, (Key){.i = i});
+    }
+    visit(s, NONE, obj2gco(g->mainthread), EDGE_ROOT, (Key){0});
+    add_thread_roots(s, g->allgc);
+    add_thread_roots(s, g->finobj);
+    for (uint32_t i = 0; i < s->count; ++i) traverse(s, i);
+    resolve_paths(s, s->objects, s->nobjects);
+    resolve_paths(s, s->tables, s->ntables);
+}
+
+static void add_key_string(luaL_Buffer* buf, TString* ts) {
+    char const* key = getstr(ts);
+    size_t len = tsslen(ts);
+    bool ident = len > 0 && !('0' <= key[0] && key[0] <= '9');
+    for (size_t i = 0; i < len && ident; ++i) {
+        char c = key[i];
+        ident = c == '_' || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z')
+                || ('0' <= c && c <= '9');
+    }
+    if (ident && len <= MAX_KEY_LEN) {
+        luaL_addchar(buf, '.');
+        luaL_addlstring(buf, key, len);
+        return;
+    }
+    luaL_addstring(buf, "[\"");
+    for (size_t i = 0; i < len && i < MAX_KEY_LEN; ++i) {
+        unsigned char c = key[i];
+        if (c < ' ' || c > '~' || c == '"' || c == '\\') {
+            lua_pushfstring(buf->L, "\\%d", c);
+            luaL_addvalue(buf);
+        } else {
+            luaL_addchar(buf, c);
+        }
+    }
+    if (len > MAX_KEY_LEN) luaL_addstring(buf, "...");
+    luaL_addstring(buf, "\"]");
+}
+
+static void add_segment(luaL_Buffer* buf, Entry const* e) {
+    lua_State* ls = buf->L;
+    switch (e->edge) {
+    case EDGE_ROOT:
+        if (e->key.p != NULL) {
+            luaL_addstring(buf, e->key.p);
+        } else if (gco2th(e->obj) == G(ls)->mainthread) {
+            luaL_addstring(buf, "<main>");
+        } else {
+            lua_pushfstring(ls, "<thread %p>", e->obj);
+            luaL_addvalue(buf);
+        }
+        return;
+    case EDGE_TYPE_MT:
+        lua_pushfstring(ls, "<%s metatable>", lua_typename(ls, e->key.i));
+        break;
+    case EDGE_FIELD:
+        add_key_string(buf, (TString*)e->key.p);
+        return;
+    case EDGE_INDEX:
+        lua_pushfstring(ls, "[%d]", e->key.i);
+        break;
+    case EDGE_LIGHT:
+        lua_pushfstring(ls, "[%p]", e->key.p);
+        break;
+    case EDGE_OBJECT: {
+        GCObject* k = (GCObject*)e->key.p;
+        lua_pushfstring(ls, "[%s %p]", type_names[object_type(k)], k);
+        break;
+    }
+    case EDGE_VALUE:
+        luaL_addstring(buf, "[?]");
+        return;
+    case EDGE_KEY:
+        luaL_addstring(buf, "<key>");
+        return;
+    case EDGE_META:
+        luaL_addstring(buf, "<metatable>");
+        return;
+    case EDGE_UPVAL:
+        lua_pushfstring(ls, "<upvalue %s>", getstr((TString*)e->key.p));
+        break;
+    case EDGE_UPVAL_INDEX:
+        lua_pushfstring(ls, "<upvalue %d>", e->key.i);
+        break;
+    case EDGE_USER_VALUE:
+        lua_pushfstring(ls, "<uservalue %d>", e->key.i);
+        break;
+    case EDGE_STACK:
+        lua_pushfstring(ls, "<stack %d>", e->key.i);
+        break;
+    case EDGE_PROTO:
+        luaL_addstring(buf, "<proto>");
+        return;
+    default:
+        return;
+    }
+    luaL_addvalue(buf);
+}
+
+static void add_path(luaL_Buffer* buf, Snapshot const* s, Target const* t) {
+    if (!t->found) {
+        luaL_addchar(buf, '?');
+        return;
+    }
+    Entry const* segs[MLUA_HEAP_SNAPSHOT_DEPTH];
+    int depth = 0;
+    Entry const* e = &t->path;
+    for (;;) {
+        segs[depth++] = e;
+        if (e->parent == NONE) break;
+        if (depth == MLUA_HEAP_SNAPSHOT_DEPTH) {
+            luaL_addstring(buf, "...");
+            break;
+        }
+        e = &s->entries[e->parent];
+    }
+    while (depth > 0) add_segment(buf, segs[--depth]);
+}
+
+static void add_targets(luaL_Buffer* buf, Snapshot const* s,
+                        Target const* targets, uint32_t len, bool tables) {
+    lua_State* ls = buf->L;
+    for (uint32_t i = 0; i < len; ++i) {
+        Target const* t = &targets[i];
+        if (t->obj == NULL) break;
+        if (tables) {
+            lua_pushfstring(ls, "table %I %I %I ", (lua_Integer)t->size,
+                            (lua_Integer)t->asize, (lua_Integer)t->hsize);
+        } else {
+            lua_pushfstring(ls, "object %s %I ", type_names[t->type],
+                            (lua_Integer)t->size);
+        }
+        luaL_addvalue(buf);
+        add_path(buf, s, t);
+        luaL_addchar(buf, '\n');
+    }
+}
+
+static int format_result(lua_State* ls) {
+    Snapshot const* s = lua_touserdata(ls, 1);
+    luaL_Buffer buf;
+    luaL_buffinit(ls, &buf);
+    size_t count = 0, size = 0;
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        count += s->type_count[i];
+        size += s->type_size[i];
+    }
+    lua_pushfstring(ls, "heap %I %I %I %s\n", (lua_Integer)count,
+                    (lua_Integer)size, (lua_Integer)s->count,
+                    s->truncated ? "truncated" : "complete");
+    luaL_addvalue(&buf);
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        if (s->type_count[i] == 0) continue;
+        lua_pushfstring(ls, "type %s %I %I\n", type_names[i],
+                        (lua_Integer)s->type_count[i],
+                        (lua_Integer)s->type_size[i]);
+        luaL_addvalue(&buf);
+    }
+    add_targets(&buf, s, s->objects, s->nobjects, false);
+    add_targets(&buf, s, s->tables, s->ntables, true);
+    luaL_pushresult(&buf);
+    return 1;
+}
+
+static int mod_take(lua_State* ls) {
+    lua_Integer top = luaL_optinteger(ls, 1, MLUA_HEAP_SNAPSHOT_TOP);
+    luaL_argcheck(ls, 0 <= top && top <= 256, 1, "out of range");
+    lua_Integer nodes = luaL_optinteger(ls, 2, MLUA_HEAP_SNAPSHOT_NODES);
+    luaL_argcheck(ls, 1 <= nodes && nodes <= (1 << 20), 2, "out of range");
+
+    // Allocate all the working memory upfront, so that the traversal doesn't
+    // allocate.
+    uint32_t cap = 1;
+    while (cap < 2 * (uint32_t)nodes) cap <<= 1;
+    size_t ntargets = 2 * top;
+    Snapshot* s = lua_newuserdatauv(
+        ls, sizeof(Snapshot) + ntargets * sizeof(Target)
+            + nodes * sizeof(Entry) + cap * sizeof(uint32_t), 0);
+    memset(s, 0, sizeof(*s));
+    s->ls = ls;
+    s->self = gcvalue(s2v(ls->top.p - 1));
+    s->nobjects = s->ntables = top;
+    s->nodes = nodes;
+    s->mask = cap - 1;
+    s->objects = (Target*)(s + 1);
+    s->tables = s->objects + top;
+    s->entries = (Entry*)(s->tables + top);
+    s->visited = (uint32_t*)(s->entries + nodes);
+    memset(s->objects, 0, ntargets * sizeof(Target));
+    memset(s->visited, 0xff, cap * sizeof(uint32_t));
+
+    // Collect garbage, so that only live objects are reported.
+    lua_gc(ls, LUA_GCCOLLECT);
+
+    // Account for all objects and find the largest ones.
+    global_State* g = G(ls);
+    count_objects(s, g->allgc);
+    count_objects(s, g->finobj);
+    count_objects(s, g->tobefnz);
+    count_objects(s, g->fixedgc);
+    s->min_size = SIZE_MAX;
+    for (uint32_t i = 0; i < s->nobjects; ++i) {
+        Target const* t = &s->objects[i];
+        if (t->obj != NULL && t->size < s->min_size) s->min_size = t->size;
+    }
+
+    // Find retention paths by traversing the object graph breadth-first from
+    // the roots.
+    find_paths(s);
+
+    // Format the result with the collector stopped, so that the objects
+    // referenced by the entries remain valid.
+    bool running = lua_gc(ls, LUA_GCISRUNNING);
+    lua_gc(ls, LUA_GCSTOP);
+    lua_pushcfunction(ls, &format_result);
+    lua_pushlightuserdata(ls, s);
+    int err = lua_pcall(ls, 1, 1, 0);
+    if (running) lua_gc(ls, LUA_GCRESTART);
+    if (err != LUA_OK) return lua_error(ls);
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(take, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.heap_snapshot) {
+    mlua_new_module(ls, 0, module_syms);
+    return 1;
+}
@@ -0,0 +1,101 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+local heap_snapshot = require 'mlua.heap_snapshot'
+local thread = require 'mlua.thread'
+local string = require 'string'
+
+-- Parse a snapshot into a table.
+local function parse(snap)
+    local res = {types = {}, objects = {}, tables = {}}
+    for line in snap:gmatch('([^\n]*)\n') do
+        local kind, rest = line:match('^(%w+) (.*)$')
+        if kind == 'heap' then
+            local count, size, nodes, status =
+                rest:match('^(%d+) (%d+) (%d+) (%w+)$')
+            res.count, res.size = tonumber(count), tonumber(size)
+            res.nodes, res.status = tonumber(nodes), status
+        elseif kind == 'type' then
+            local name, count, size = rest:match('^(%w+) (%d+) (%d+)$')
+            res.types[name] = {count = tonumber(count), size = tonumber(size)}
+        elseif kind == 'object' then
+            local typ, size, path = rest:match('^(%w+) (%d+) (.*)$')
+            res.objects[#res.objects + 1] =
+                {type = typ, size = tonumber(size), path = path}
+        elseif kind == 'table' then
+            local size, asize, hsize, path =
+                rest:match('^(%d+) (%d+) (%d+) (.*)$')
+            res.tables[#res.tables + 1] = {
+                size = tonumber(size), asize = tonumber(asize),
+                hsize = tonumber(hsize), path = path,
+            }
+        end
+    end
+    return res
+end
+
+local function find(list, path)
+    for _, obj in ipairs(list) do
+        if obj.path:find(path, 1, true) then return obj end
+    end
+end
+
+-- Create the test objects in a separate function, so that they aren't
+-- referenced from the stack of the running thread.
+local function create_objects()
+    heap_snapshot_test_big = {}
+    for i = 1, 1000 do heap_snapshot_test_big[i] = i end
+    heap_snapshot_test_str = string.rep('x', 10000)
+end
+
+function test_take(t)
+    create_objects()
+    t:cleanup(function()
+        heap_snapshot_test_big = nil
+        heap_snapshot_test_str = nil
+    end)
+    local snap = parse(heap_snapshot.take(16))
+    t:expect(snap.status):label("status"):eq('complete')
+    t:expect(snap.count):label("count"):gt(0)
+    t:expect(snap.types.table):label("types.table"):neq(nil)
+    t:expect(snap.types.string):label("types.string"):neq(nil)
+    local total = 0
+    for _, typ in pairs(snap.types) do total = total + typ.size end
+    t:expect(total):label("total size"):eq(snap.size)
+    t:expect(#snap.objects):label("#objects"):eq(16)
+    t:expect(#snap.tables):label("#tables"):gt(0)
+
+    local tab = find(snap.tables, '.heap_snapshot_test_big')
+    t:expect(tab):label("big table"):neq(nil)
+    t:expect(tab.asize):label("asize"):gte(1000)
+    local str = find(snap.objects, '.heap_snapshot_test_str')
+    t:expect(str):label("big string"):neq(nil)
+    t:expect(str.type):label("type"):eq('string')
+    t:expect(str.size):label("size"):gt(10000)
+end
+
+function test_thread_stack(t)
+    local th<close> = thread.start(function()
+        local data = string.rep('y', 20000)
+        thread.suspend()
+        return data
+    end)
+    thread.yield()
+    local snap = parse(heap_snapshot.take())
+    local str
+    for _, obj in ipairs(snap.objects) do
+        if obj.type == 'string' and obj.size > 20000 then str = obj end
+    end
+    t:expect(str):label("string"):neq(nil)
+    t:expect(str.path):label("path"):matches('^<thread 0?x?%x+><stack %d+>$')
+end
+
+function test_bounded(t)
+    local snap = parse(heap_snapshot.take(2, 1))
+    t:expect(snap.status):label("status"):eq('truncated')
+    t:expect(snap.nodes):label("nodes"):eq(1)
+    t:expect(t.expr(heap_snapshot).take(-1)):raises("out of range")
+    t:expect(t.expr(heap_snapshot).take(8, 0)):raises("out of range")
+end
@@ -0,0 +1,388 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The minimum non-zero capacity of a map.
+#define MIN_CAP 8
+
+// The maximum load factor of a map, as a fraction of 8.
+#define MAX_LOAD 7
+
+// Value types.
+typedef enum ValueType {
+    VALUE_INT32,
+    VALUE_INT64,
+    VALUE_DOUBLE,
+    VALUE_REF,
+} ValueType;
+
+// User value indexes for IntMap.
+typedef enum IntMapUserValueIndex {
+    UV_STORAGE = 1,
+    UV_REFS,
+    UV_COUNT = UV_REFS,
+} IntMapUserValueIndex;
+
+// A hash map from integers to typed values, using open addressing with linear
+// probing. The keys, values and the occupancy and deletion bitmaps are stored
+// in a separate userdata, which is replaced when the map grows. Deleted entries
+// are only marked as such, so that iteration isn't disturbed by deletions, and
+// their slots are reused by insertions. For maps holding Lua values, the values
+// are references into a table.
+typedef struct IntMap {
+    lua_Integer* keys;
+    void* values;
+    uint32_t* used;
+    uint32_t* dead;
+    lua_Integer count;
+    lua_Integer deleted;
+    lua_Integer cap;
+    size_t storage;
+    uint8_t type;
+    uint8_t size;
+    uint8_t bits;
+} IntMap;
+
+// A value to be stored into a map.
+typedef union Value {
+    int32_t i32;
+    int64_t i64;
+    double d;
+    int ref;
+} Value;
+
+static char const IntMap_name[] = "mlua.intmap.IntMap";
+
+static inline IntMap* check_IntMap(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, IntMap_name);
+}
+
+static inline lua_Integer slot_of(IntMap const* m, lua_Integer key) {
+    if (sizeof(lua_Unsigned) <= sizeof(uint32_t)) {
+        return ((uint32_t)key * UINT32_C(0x9e3779b9)) >> (32 - m->bits);
+    }
+    return ((uint64_t)key * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - m->bits);
+}
+
+static inline bool test_bit(uint32_t const* bm, lua_Integer i) {
+    return (bm[i >> 5] & (1u << (i & 31))) != 0;
+}
+
+static inline void set_bit(uint32_t* bm, lua_Integer i) {
+    bm[i >> 5] |= 1u << (i & 31);
+}
+
+static inline void clear_bit(uint32_t* bm, lua_Integer i) {
+    bm[i >> 5] &= ~(1u << (i & 31));
+}
+
+// Return true iff the given slot holds an entry that isn't deleted.
+static inline bool is_live(IntMap const* m, lua_Integer i) {
+    return test_bit(m->used, i) && !test_bit(m->dead, i);
+}
+
+static inline void* value_ptr(IntMap const* m, lua_Integer i) {
+    return (char*)m->values + i * m->size;
+}
+
+// Return the slot holding the given key, or -1 if the key isn't in the map.
+// If dead is true, the slot of a deleted entry is also returned.
+static lua_Integer find(IntMap const* m, lua_Integer key, bool dead) {
+    if (m->cap == 0) return -1;
+    lua_Integer mask = m->cap - 1;
+    for (lua_Integer i = slot_of(m, key);; i = (i + 1) & mask) {
+        if (!test_bit(m->used, i)) return -1;
+        if (m->keys[i] == key && (dead || !test_bit(m->dead, i))) return i;
+    }
+}
+
+// Return a free slot for the given key, which must not be in the map. The
+// first unused or deleted slot of the probe sequence is used.
+static lua_Integer insert(IntMap* m, lua_Integer key) {
+    lua_Integer mask = m->cap - 1;
+    lua_Integer i = slot_of(m, key);
+    while (is_live(m, i)) i = (i + 1) & mask;
+    if (test_bit(m->dead, i)) {
+        clear_bit(m->dead, i);
+        --m->deleted;
+    } else {
+        set_bit(m->used, i);
+    }
+    m->keys[i] = key;
+    ++m->count;
+    return i;
+}
+
+// Mark the entry in the given slot as deleted. The key is kept, so that an
+// ongoing iteration can continue from it.
+static void remove_slot(IntMap* m, lua_Integer i) {
+    set_bit(m->dead, i);
+    --m->count;
+    ++m->deleted;
+}
+
+// Replace the storage of a map with a new one of the given capacity.
+static void resize(lua_State* ls, int arg, IntMap* m, lua_Integer cap) {
+    int bits = 0;
+    while (((lua_Integer)1 << bits) < cap) ++bits;
+    size_t keys_size = cap * sizeof(lua_Integer);
+    size_t values_size = cap * m->size;
+    size_t bitmap_size = ((cap + 31) / 32) * sizeof(uint32_t);
+    size_t size = keys_size + values_size + 2 * bitmap_size;
+    char* storage = lua_newuserdatauv(ls, size, 0);
+    memset(storage + keys_size + values_size, 0, 2 * bitmap_size);
+
+    IntMap old = *m;
+    m->keys = (lua_Integer*)storage;
+    m->values = storage + keys_size;
+    m->used = (uint32_t*)(storage + keys_size + values_size);
+    m->dead = (uint32_t*)(storage + keys_size + values_size + bitmap_size);
+    m->count = 0;
+    m->deleted = 0;
+    m->cap = cap;
+    m->storage = size;
+    m->bits = bits;
+    for (lua_Integer i = 0; i < old.cap; ++i) {
+        if (!is_live(&old, i)) continue;
+        lua_Integer j = insert(m, old.keys[i]);
+        memcpy(value_ptr(m, j), value_ptr(&old, i), m->size);
+    }
+    lua_setiuservalue(ls, arg, UV_STORAGE);
+}
+
+// Ensure that the map can hold the given number of entries without growing.
+// Deleted slots count towards the load, and are dropped when the storage is
+// replaced.
+static void reserve(lua_State* ls, int arg, IntMap* m, lua_Integer count) {
+    if ((count + m->deleted) * 8 <= m->cap * MAX_LOAD) return;
+    lua_Integer cap = m->cap > 0 ? m->cap : MIN_CAP;
+    while (count * 8 > cap * MAX_LOAD) cap *= 2;
+    resize(ls, arg, m, cap);
+}
+
+static void push_value(lua_State* ls, int arg, IntMap const* m,
+                       lua_Integer i) {
+    void const* p = value_ptr(m, i);
+    switch (m->type) {
+    case VALUE_INT32:
+        lua_pushinteger(ls, *(int32_t const*)p);
+        break;
+    case VALUE_INT64:
+        mlua_push_int64(ls, *(int64_t const*)p);
+        break;
+    case VALUE_DOUBLE:
+        lua_pushnumber(ls, *(double const*)p);
+        break;
+    case VALUE_REF:
+        lua_getiuservalue(ls, arg, UV_REFS);
+        lua_rawgeti(ls, -1, *(int const*)p);
+        lua_remove(ls, -2);
+        break;
+    }
+}
+
+static void check_value(lua_State* ls, int arg, IntMap const* m, Value* v) {
+    switch (m->type) {
+    case VALUE_INT32: {
+        lua_Integer i = luaL_checkinteger(ls, arg);
+        luaL_argcheck(ls, INT32_MIN <= i && i <= INT32_MAX, arg,
+                      "out of range");
+        v->i32 = i;
+        break;
+    }
+    case VALUE_INT64: v->i64 = mlua_check_int64(ls, arg); break;
+    case VALUE_DOUBLE: v->d = luaL_checknumber(ls, arg); break;
+    case VALUE_REF: break;
+    }
+}
+
+static bool delete(lua_State* ls, int arg, IntMap* m, lua_Integer key) {
+    lua_Integer i = find(m, key, false);
+    if (i < 0) return false;
+    if (m->type == VALUE_REF) {
+        lua_getiuservalue(ls, arg, UV_REFS);
+        luaL_unref(ls, -1, *(int*)value_ptr(m, i));
+        lua_pop(ls, 1);
+    }
+    remove_slot(m, i);
+    return true;
+}
+
+static void set(lua_State* ls, int arg, IntMap* m, lua_Integer key, int val) {
+    if (lua_isnil(ls, val)) {
+        delete(ls, arg, m, key);
+        return;
+    }
+    Value v;
+    check_value(ls, val, m, &v);
+    lua_Integer i = find(m, key, false);
+    if (m->type == VALUE_REF) {
+        lua_getiuservalue(ls, arg, UV_REFS);
+        lua_pushvalue(ls, val);
+        if (i >= 0) {
+            lua_rawseti(ls, -2, *(int*)value_ptr(m, i));
+            lua_pop(ls, 1);
+            return;
+        }
+        reserve(ls, arg, m, m->count + 1);
+        v.ref = luaL_ref(ls, -2);
+        lua_pop(ls, 1);
+    } else if (i < 0) {
+        reserve(ls, arg, m, m->count + 1);
+    }
+    if (i < 0) i = insert(m, key);
+    memcpy(value_ptr(m, i), &v, m->size);
+}
+
+static int IntMap___new(lua_State* ls) {
+    lua_remove(ls, 1);  // Remove class
+    char const* fmt = luaL_checkstring(ls, 1);
+    uint8_t type, size;
+    if (strcmp(fmt, "i4") == 0) {
+        type = VALUE_INT32;
+        size = sizeof(int32_t);
+    } else if (strcmp(fmt, "i8") == 0) {
+        type = VALUE_INT64;
+        size = sizeof(int64_t);
+    } else if (strcmp(fmt, "d") == 0) {
+        type = VALUE_DOUBLE;
+        size = sizeof(double);
+    } else if (strcmp(fmt, "r") == 0) {
+        type = VALUE_REF;
+        size = sizeof(int);
+    } else {
+        return luaL_argerror(ls, 1, "invalid value format");
+    }
+    lua_Integer count = luaL_optinteger(ls, 2, 0);
+    luaL_argcheck(ls, 0 <= count && count <= (LUA_MAXINTEGER >> 4), 2,
+                  "out of range");
+
+    IntMap* m = lua_newuserdatauv(ls, sizeof(IntMap), UV_COUNT);
+    memset(m, 0, sizeof(*m));
+    m->type = type;
+    m->size = size;
+    luaL_getmetatable(ls, IntMap_name);
+    lua_setmetatable(ls, -2);
+    if (type == VALUE_REF) {
+        lua_createtable(ls, count, 0);
+        lua_setiuservalue(ls, -2, UV_REFS);
+    }
+    if (count > 0) reserve(ls, lua_absindex(ls, -1), m, count);
+    return 1;
+}
+
+static int IntMap_get(lua_State* ls) {
+    IntMap* m = check_IntMap(ls, 1);
+    lua_Integer i = find(m, luaL_checkinteger(ls, 2), false);
+    if (i < 0) return lua_pushnil(ls), 1;
+    return push_value(ls, 1, m, i), 1;
+}
+
+static int IntMap_set(lua_State* ls) {
+    IntMap* m = check_IntMap(ls, 1);
+    lua_Integer key = luaL_checkinteger(ls, 2);
+    luaL_checkany(ls, 3);
+    set(ls, 1, m, key, 3);
+    return lua_settop(ls, 1), 1;
+}
+
+static int IntMap_delete(lua_State* ls) {
+    IntMap* m = check_IntMap(ls, 1);
+    lua_Integer key = luaL_checkinteger(ls, 2);
+    return lua_pushboolean(ls, delete(ls, 1, m, key)), 1;
+}
+
+static int IntMap_reserve(lua_State* ls) {
+    IntMap* m = check_IntMap(ls, 1);
+    lua_Integer count = luaL_checkinteger(ls, 2);
+    luaL_argcheck(ls, 0 <= count && count <= (LUA_MAXINTEGER >> 4), 2,
+                  "out of range");
+    reserve(ls, 1, m, count);
+    return lua_settop(ls, 1), 1;
+}
+
+static int IntMap_memory(lua_State* ls) {
+    IntMap* m = check_IntMap(ls, 1);
+    mlua_push_size(ls, sizeof(IntMap) + m->storage);
+    lua_pushinteger(ls, m->count);
+    lua_pushinteger(ls, m->cap);
+    return 3;
+}
+
+static int IntMap___len(lua_State* ls) {
+    IntMap* m = check_IntMap(ls, 1);
+    return lua_pushinteger(ls, m->count), 1;
+}
+
+static int IntMap___index2(lua_State* ls) {
+    IntMap* m = check_IntMap(ls, 1);
+    int ok;
+    lua_Integer key = lua_tointegerx(ls, 2, &ok);
+    lua_Integer i = ok ? find(m, key, false) : -1;
+    if (i < 0) return lua_pushnil(ls), 1;
+    return push_value(ls, 1, m, i), 1;
+}
+
+static int IntMap___newindex(lua_State* ls) {
+    IntMap* m = check_IntMap(ls, 1);
+    set(ls, 1, m, luaL_checkinteger(ls, 2), 3);
+    return 0;
+}
+
+static int pairs_iter(lua_State* ls) {
+    IntMap* m = check_IntMap(ls, 1);
+    lua_Integer i = 0;
+    if (!lua_isnil(ls, 2)) {
+        // The current entry may have been deleted during the iteration.
+        i = find(m, luaL_checkinteger(ls, 2), true);
+        if (i < 0) return luaL_error(ls, "invalid key to 'next'");
+        ++i;
+    }
+    for (; i < m->cap; ++i) {
+        if (!is_live(m, i)) continue;
+        lua_pushinteger(ls, m->keys[i]);
+        push_value(ls, 1, m, i);
+        return 2;
+    }
+    return 0;
+}
+
+static int IntMap___pairs(lua_State* ls) {
+    check_IntMap(ls, 1);
+    lua_pushcfunction(ls, &pairs_iter);
+    lua_pushvalue(ls, 1);
+    lua_pushnil(ls);
+    return 3;
+}
+
+MLUA_SYMBOLS(IntMap_syms) = {
+    MLUA_SYM_F(get, IntMap_),
+    MLUA_SYM_F(set, IntMap_),
+    MLUA_SYM_F(delete, IntMap_),
+    MLUA_SYM_F(reserve, IntMap_),
+    MLUA_SYM_F(memory, IntMap_),
+};
+
+MLUA_SYMBOLS_NOHASH(IntMap_syms_nh) = {
+    MLUA_SYM_F_NH(__new, IntMap_),
+    MLUA_SYM_F_NH(__len, IntMap_),
+    MLUA_SYM_F_NH(__index2, IntMap_),
+    MLUA_SYM_F_NH(__newindex, IntMap_),
+    MLUA_SYM_F_NH(__pairs, IntMap_),
+};
+
+MLUA_OPEN_MODULE(mlua.intmap) {
+    mlua_require(ls, "mlua.int64", false);
+
+    // Create the IntMap class.
+    mlua_new_class(ls, IntMap_name, IntMap_syms, IntMap_syms_nh);
+    mlua_set_metaclass(ls);
+    return 1;
+}
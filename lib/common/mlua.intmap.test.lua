@@ -0,0 +1,170 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+local gc = require 'mlua.gc'
+local int64 = require 'mlua.int64'
+local intmap = require 'mlua.intmap'
+local platform = require 'mlua.platform'
+local util = require 'mlua.util'
+local string = require 'string'
+local table = require 'table'
+
+function test_types(t)
+    for _, test in ipairs{
+        {'i4', 123, -5},
+        {'i8', int64(123), int64(-5)},
+        {'d', 1.5, -2.25},
+        {'r', 'abc', {1, 2}},
+    } do
+        local fmt, v1, v2 = table.unpack(test)
+        t:context({fmt = fmt})
+        local m = intmap(fmt)
+        t:expect(#m):label("#m"):eq(0)
+        t:expect(t.expr(m):get(1)):eq(nil)
+        t:expect(t.expr(m):set(1, v1)):eq(m)
+        m[-7] = v2
+        t:expect(#m):label("#m"):eq(2)
+        t:expect(t.expr(m):get(1)):eq(v1)
+        t:expect(m[-7]):label("m[-7]"):eq(v2)
+        t:expect(m.abc):label("m.abc"):eq(nil)
+        t:expect(t.expr(m):delete(1)):eq(true)
+        t:expect(t.expr(m):delete(1)):eq(false)
+        m[-7] = nil
+        t:expect(#m):label("#m"):eq(0)
+    end
+    t:expect(t.expr(intmap)('x')):raises("invalid value format")
+    t:expect(t.expr(intmap('i4')):set(1, 'abc')):raises("number expected")
+end
+
+function test_int32_range(t)
+    local m = intmap('i4')
+    m[1] = 0x7fffffff
+    m[2] = -0x80000000
+    t:expect(m[1]):label("m[1]"):eq(0x7fffffff)
+    t:expect(m[2]):label("m[2]"):eq(-0x80000000)
+    if string.packsize('j') > 4 then
+        t:expect(t.expr(m):set(3, 0x80000000)):raises("out of range")
+        t:expect(t.expr(m):set(3, -0x80000001)):raises("out of range")
+        t:expect(function() m[3] = 1 << 31 end):raises("out of range")
+        t:expect(#m):label("#m"):eq(2)
+    end
+end
+
+function test_many(t)
+    local m, want = intmap('i4'), {}
+    for i = 1, 2000 do
+        local k = (i * 7919) % 5003 - 2500
+        local op = i % 5
+        if op == 0 and want[k] then
+            m:delete(k)
+            want[k] = nil
+        else
+            m[k] = i
+            want[k] = i
+        end
+    end
+    local got, n = {}, 0
+    for k, v in pairs(m) do
+        got[k] = v
+        n = n + 1
+    end
+    t:expect(got):label("entries"):eq(want, util.table_eq)
+    t:expect(#m):label("#m"):eq(n)
+end
+
+function test_delete_while_iterating(t)
+    local m, want = intmap('i4'), {}
+    for i = 1, 1000 do
+        local k = i * 7919
+        m[k] = i
+        if i % 3 ~= 0 then want[k] = i end
+    end
+    local seen, n = {}, 0
+    for k, v in pairs(m) do
+        t:expect(seen[k]):label("seen[%s]", k):eq(nil)
+        seen[k], n = true, n + 1
+        if v % 3 == 0 then m[k] = nil end
+    end
+    t:expect(n):label("visited"):eq(1000)
+    local got = {}
+    for k, v in pairs(m) do got[k] = v end
+    t:expect(got):label("entries"):eq(want, util.table_eq)
+    t:expect(#m):label("#m"):eq(667)
+
+    -- Deleted slots are reused.
+    local _, _, cap = m:memory()
+    for i = 1, 1000 do
+        if i % 3 == 0 then m[i * 7919] = i end
+    end
+    t:expect(#m):label("#m"):eq(1000)
+    t:expect(select(3, m:memory())):label("cap"):eq(cap)
+end
+
+function test_reserve_memory(t)
+    local m = intmap('i4')
+    local bytes, count, cap = m:memory()
+    t:expect(count):label("count"):eq(0)
+    t:expect(cap):label("cap"):eq(0)
+    t:expect(t.expr(m):reserve(100)):eq(m)
+    local bytes2, count2, cap2 = m:memory()
+    t:expect(cap2):label("cap"):gte(100)
+    t:expect(bytes2):label("bytes"):gt(bytes)
+    for i = 1, 100 do m[i] = i end
+    local bytes3, count3, cap3 = m:memory()
+    t:expect(count3):label("count"):eq(100)
+    t:expect(cap3):label("cap"):eq(cap2)
+    t:expect(bytes3):label("bytes"):eq(bytes2)
+    t:expect(t.expr(m):reserve(-1)):raises("out of range")
+end
+
+function test_refs(t)
+    local m = intmap('r', 4)
+    m[1] = 'a'
+    m[1] = 'b'
+    m[2] = 'c'
+    m:delete(1)
+    m[3] = 'd'
+    t:expect(m[2]):label("m[2]"):eq('c')
+    t:expect(m[3]):label("m[3]"):eq('d')
+    t:expect(m[1]):label("m[1]"):eq(nil)
+end
+
+-- Return the amount of memory used by the result of fn().
+local function measure(fn)
+    gc.collect()
+    local before = gc.count()
+    local res = fn()
+    gc.collect()
+    return res, gc.count() - before
+end
+
+function bench_lookup(t)
+    local sizes = {1000, 10000}
+    if platform.name == 'host' then sizes[#sizes + 1] = 100000 end
+    for _, size in ipairs(sizes) do
+        -- Sparse keys, as in routing tables and device registries.
+        local tab, tab_mem = measure(function()
+            local tab = {}
+            for i = 1, size do tab[i * 7919] = i end
+            return tab
+        end)
+        local m, m_mem = measure(function()
+            local m = intmap('i4')
+            for i = 1, size do m[i * 7919] = i end
+            return m
+        end)
+        t:printf("%d entries: table %.1f bytes / entry, intmap %.1f bytes / "
+                 .. "entry\n", size, tab_mem / size, m_mem / size)
+        t:benchmark(("table[k] (%d)"):format(size), function(n)
+            for i = 1, n do local v = tab[(i % size + 1) * 7919] end
+        end)
+        t:benchmark(("intmap[k] (%d)"):format(size), function(n)
+            for i = 1, n do local v = m[(i % size + 1) * 7919] end
+        end)
+        t:benchmark(("intmap:get(k) (%d)"):format(size), function(n)
+            for i = 1, n do local v = m:get((i % size + 1) * 7919) end
+        end)
+    end
+end
@@ -0,0 +1,70 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+-- Lazy loading of modules.
+--
+-- A lazy module is a proxy table that loads the real module on first use. Once
+-- loaded, the proxy forwards all accesses to the module through a table-valued
+-- __index, which the VM resolves without a function call.
+
+_ENV = module(...)
+
+local package = require 'package'
+
+local global_require = _G.require
+
+-- The names of the modules behind proxies.
+local names = setmetatable({}, {__mode = 'k'})
+
+-- Load the module behind a proxy, switch the proxy to forwarding to the
+-- module, and return the module.
+local function resolve(proxy)
+    local mod = global_require(names[proxy])
+    setmetatable(proxy, {
+        __name = 'mlua.lazy.Resolved',
+        __index = mod,
+        __newindex = mod,
+        __call = function(_, ...) return mod(...) end,
+        __len = function() return #mod end,
+        __pairs = function() return pairs(mod) end,
+        __tostring = function() return tostring(mod) end,
+    })
+    return mod
+end
+
+local Proxy = {
+    __name = 'mlua.lazy.Proxy',
+    __index = function(self, k) return resolve(self)[k] end,
+    __newindex = function(self, k, v) resolve(self)[k] = v end,
+    __call = function(self, ...) return resolve(self)(...) end,
+    __len = function(self) return #resolve(self) end,
+    __pairs = function(self) return pairs(resolve(self)) end,
+    __tostring = function(self) return 'lazy module: ' .. names[self] end,
+}
+
+-- Return a proxy for the module with the given name, which loads the module
+-- on first use. If the module is already loaded, or isn't compiled-in, it is
+-- loaded immediately and returned directly.
+function require(name)
+    local mod = package.loaded[name]
+    if mod ~= nil then return mod end
+    if package.preload[name] == nil then return global_require(name) end
+    local proxy = setmetatable({}, Proxy)
+    names[proxy] = name
+    return proxy
+end
+
+-- Return true iff the given value is a proxy whose module hasn't been loaded
+-- yet.
+function is_pending(value)
+    return getmetatable(value) == Proxy
+end
+
+-- Return the module behind a proxy, loading it if necessary. Other values are
+-- returned unchanged.
+function load(value)
+    if names[value] == nil then return value end
+    local mt = getmetatable(value)
+    if mt ~= Proxy then return mt.__index end  -- Already resolved
+    return resolve(value)
+end
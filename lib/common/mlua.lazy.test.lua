@@ -0,0 +1,98 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+local lazy = require 'mlua.lazy'
+local package = require 'package'
+
+local mod_name = 'mlua.lazy.test.mod'
+
+local function preload(t)
+    local loads = 0
+    t:patch(package.preload, mod_name, function(name)
+        loads = loads + 1
+        local mod = module(name)
+        mod.value = 42
+        mod.items = {1, 2, 3}
+        function mod.add(a, b) return a + b end
+        return mod
+    end)
+    t:patch(package.loaded, mod_name, nil)
+    return function() return loads end
+end
+
+function test_require(t)
+    local loads = preload(t)
+    local proxy = lazy.require(mod_name)
+    t:expect(t.expr.loads()):eq(0)
+    t:expect(t.expr(lazy).is_pending(proxy)):eq(true)
+    t:expect(t.expr(proxy).value):eq(42)
+    t:expect(t.expr.loads()):eq(1)
+    t:expect(t.expr(lazy).is_pending(proxy)):eq(false)
+    t:expect(t.expr(proxy).add(1, 2)):eq(3)
+    t:expect(t.expr(proxy).items):eq({1, 2, 3})
+    t:expect(t.expr.loads()):eq(1)
+    t:expect(t.expr(lazy).load(proxy)):eq(package.loaded[mod_name])
+
+    -- Assignments are forwarded to the module.
+    proxy.other = 'other'
+    t:expect(t.expr(package.loaded[mod_name]).other):eq('other')
+    t:expect(t.expr(proxy).other):eq('other')
+
+    -- Loaded modules are returned directly.
+    t:expect(t.expr(lazy).require(mod_name)):eq(package.loaded[mod_name])
+end
+
+function test_load(t)
+    local loads = preload(t)
+    local proxy = lazy.require(mod_name)
+    local mod = lazy.load(proxy)
+    t:expect(t.expr.loads()):eq(1)
+    t:expect(mod):label("mod"):eq(package.loaded[mod_name])
+    local mt = getmetatable(proxy)
+    t:expect(t.expr(lazy).load(proxy)):eq(mod)
+    t:expect(t.expr.getmetatable(proxy)):eq(mt)
+    t:expect(t.expr(lazy).load(mod)):eq(mod)
+    t:expect(t.expr(lazy).load(123)):eq(123)
+end
+
+function test_resolve_on_assignment(t)
+    local loads = preload(t)
+    local proxy = lazy.require(mod_name)
+    proxy.value = 7
+    t:expect(t.expr.loads()):eq(1)
+    t:expect(t.expr(package.loaded[mod_name]).value):eq(7)
+end
+
+function test_pairs(t)
+    preload(t)
+    local proxy = lazy.require(mod_name)
+    local got = {}
+    for k, v in pairs(proxy) do got[k] = v end
+    t:expect(got.value):label("value"):eq(42)
+    t:expect(got.items):label("items"):eq({1, 2, 3})
+end
+
+function test_tostring(t)
+    preload(t)
+    local proxy = lazy.require(mod_name)
+    t:expect(t.expr.tostring(proxy)):eq('lazy module: ' .. mod_name)
+    local _ = proxy.value
+    t:expect(t.expr.tostring(proxy))
+        :eq(tostring(package.loaded[mod_name]))
+end
+
+function test_strict(t)
+    preload(t)
+    local proxy = lazy.require(mod_name)
+    t:expect(function() return proxy.UNKNOWN end)
+        :label("pending attribute access"):raises("undefined symbol: UNKNOWN$")
+    t:expect(function() return proxy.UNKNOWN end)
+        :label("resolved attribute access"):raises("undefined symbol: UNKNOWN$")
+end
+
+function test_unknown(t)
+    t:expect(t.expr(lazy).require('mlua.lazy.test.unknown'))
+        :raises("module 'mlua.lazy.test.unknown' not found")
+end
@@ -1,11 +1,17 @@
 // Copyright 2023 Remy Blank <remy@c-space.org>
 // SPDX-License-Identifier: MIT
 
+#include <limits.h>
 #include <malloc.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "mlua/alloc.h"
 #include "mlua/int64.h"
 #include "mlua/module.h"
+#include "mlua/thread.h"
 #include "mlua/util.h"
 
 // TODO: Use Buffer for read operations (I2C, SPI, UART, stdio). Allow providing
@@ -139,6 +145,16 @@ static int mod_get(lua_State* ls) {
     if (luai_unlikely(!lua_checkstack(ls, len))) {
         return luaL_error(ls, "too many results");
     }
+    if (mlua_buffer_has_spans(&src)) {
+        MLuaBufferIter it;
+        mlua_buffer_iter_init(&it, &src, off, len);
+        uint8_t const* ptr;
+        lua_Unsigned size;
+        while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+            for (lua_Unsigned i = 0; i < size; ++i) lua_pushinteger(ls, ptr[i]);
+        }
+        return len;
+    }
     for (lua_Unsigned i = 0; i < len; ++i, ++off) {
         uint8_t value;
         mlua_buffer_read(&src, off, 1, &value);
@@ -154,6 +170,19 @@ static int mod_set(lua_State* ls) {
     int top = lua_gettop(ls);
     check_bounds(ls, &dest, off, 2, top - 2, 3 + (dest.size - off));
 
+    if (mlua_buffer_has_spans(&dest)) {
+        MLuaBufferIter it;
+        mlua_buffer_iter_init(&it, &dest, off, top - 2);
+        uint8_t* ptr;
+        lua_Unsigned size;
+        int i = 3;
+        while ((ptr = mlua_buffer_iter_next(&it, &size)) != NULL) {
+            for (lua_Unsigned j = 0; j < size; ++j, ++i) {
+                ptr[j] = luaL_checkinteger(ls, i);
+            }
+        }
+        return 0;
+    }
     for (int i = 3; i <= top; ++i, ++off) {
         uint8_t value = luaL_checkinteger(ls, i);
         mlua_buffer_write(&dest, off, 1, &value);
@@ -161,6 +190,409 @@ static int mod_set(lua_State* ls) {
     return 0;
 }
 
+static int mod_copy(lua_State* ls) {
+    MLuaBuffer dest, src;
+    luaL_argexpected(ls, mlua_get_buffer(ls, 1, &dest), 1, "buffer");
+    lua_Unsigned off = luaL_checkinteger(ls, 2);
+    check_ro_buffer(ls, 3, &src);
+    lua_Unsigned src_off = luaL_optinteger(ls, 4, 0);
+    lua_Unsigned len = optlen(ls, &src, 5, src.size - src_off);
+    check_bounds(ls, &src, src_off, 4, len, 5);
+    check_bounds(ls, &dest, off, 2, len, 5);
+
+    mlua_buffer_copy(&dest, off, &src, src_off, len);
+    return 0;
+}
+
+static int mod_compare(lua_State* ls) {
+    MLuaBuffer a, b;
+    check_ro_buffer(ls, 1, &a);
+    lua_Unsigned a_off = luaL_checkinteger(ls, 2);
+    check_ro_buffer(ls, 3, &b);
+    lua_Unsigned b_off = luaL_optinteger(ls, 4, 0);
+    lua_Unsigned len = optlen(ls, &b, 5, b.size - b_off);
+    check_bounds(ls, &b, b_off, 4, len, 5);
+    check_bounds(ls, &a, a_off, 2, len, 5);
+
+    return lua_pushinteger(ls, mlua_buffer_compare(&a, a_off, &b, b_off, len)),
+           1;
+}
+
+// The maximum size of integers in pack formats, as in lstrlib.c.
+#define MAXINTSIZE 16
+
+#ifndef LUAL_PACKPADBYTE
+#define LUAL_PACKPADBYTE 0
+#endif
+
+// The maximum alignment for native alignment, as in lstrlib.c.
+struct cD {
+    char c;
+    union { LUAI_MAXALIGN; } u;
+};
+#define MAXALIGN (offsetof(struct cD, u))
+
+static union { int dummy; char little; } const native_endian = {1};
+
+// The kinds of pack format options.
+typedef enum KOption {
+    Kint, Kuint, Kfloat, Knumber, Kdouble, Kchar, Kstring, Kzstr, Kpadding,
+    Kpaddalign, Knop,
+} KOption;
+
+// The state of pack format parsing.
+typedef struct PackHeader {
+    lua_State* ls;
+    bool little;
+    int max_align;
+} PackHeader;
+
+static bool is_digit(char c) { return '0' <= c && c <= '9'; }
+
+static int get_num(char const** fmt, int def) {
+    if (!is_digit(**fmt)) return def;
+    int a = 0;
+    do {
+        a = a * 10 + (*(*fmt)++ - '0');
+    } while (is_digit(**fmt) && a <= (INT_MAX - 9) / 10);
+    return a;
+}
+
+static int get_num_limit(PackHeader* h, char const** fmt, int def) {
+    int size = get_num(fmt, def);
+    if (luai_unlikely(size > MAXINTSIZE || size <= 0)) {
+        return luaL_error(h->ls, "integral size (%d) out of limits [1,%d]",
+                          size, MAXINTSIZE);
+    }
+    return size;
+}
+
+static KOption get_option(PackHeader* h, char const** fmt, int* size) {
+    int opt = *(*fmt)++;
+    *size = 0;
+    switch (opt) {
+    case 'b': *size = sizeof(char); return Kint;
+    case 'B': *size = sizeof(char); return Kuint;
+    case 'h': *size = sizeof(short); return Kint;
+    case 'H': *size = sizeof(short); return Kuint;
+    case 'l': *size = sizeof(long); return Kint;
+    case 'L': *size = sizeof(long); return Kuint;
+    case 'j': *size = sizeof(lua_Integer); return Kint;
+    case 'J': *size = sizeof(lua_Integer); return Kuint;
+    case 'T': *size = sizeof(size_t); return Kuint;
+    case 'f': *size = sizeof(float); return Kfloat;
+    case 'n': *size = sizeof(lua_Number); return Knumber;
+    case 'd': *size = sizeof(double); return Kdouble;
+    case 'i': *size = get_num_limit(h, fmt, sizeof(int)); return Kint;
+    case 'I': *size = get_num_limit(h, fmt, sizeof(int)); return Kuint;
+    case 's': *size = get_num_limit(h, fmt, sizeof(size_t)); return Kstring;
+    case 'c':
+        *size = get_num(fmt, -1);
+        if (luai_unlikely(*size == -1)) {
+            luaL_error(h->ls, "missing size for format option 'c'");
+        }
+        return Kchar;
+    case 'z': return Kzstr;
+    case 'x': *size = 1; return Kpadding;
+    case 'X': return Kpaddalign;
+    case ' ': break;
+    case '<': h->little = true; break;
+    case '>': h->little = false; break;
+    case '=': h->little = native_endian.little; break;
+    case '!': h->max_align = get_num_limit(h, fmt, MAXALIGN); break;
+    default: luaL_error(h->ls, "invalid format option '%c'", opt);
+    }
+    return Knop;
+}
+
+static KOption get_details(PackHeader* h, lua_Unsigned total,
+                           char const** fmt, int* size, int* to_align) {
+    KOption opt = get_option(h, fmt, size);
+    int align = *size;
+    if (opt == Kpaddalign) {
+        if (**fmt == '\0' || get_option(h, fmt, &align) == Kchar
+                || align == 0) {
+            luaL_argerror(h->ls, 3, "invalid next option for option 'X'");
+        }
+    }
+    if (align <= 1 || opt == Kchar) {
+        *to_align = 0;
+    } else {
+        if (align > h->max_align) align = h->max_align;
+        if (luai_unlikely((align & (align - 1)) != 0)) {
+            luaL_argerror(h->ls, 3, "format asks for alignment not power of 2");
+        }
+        *to_align = (align - (int)(total & (align - 1))) & (align - 1);
+    }
+    return opt;
+}
+
+static void copy_with_endian(void* dest, void const* src, int size,
+                             bool little) {
+    if (little == native_endian.little) {
+        memcpy(dest, src, size);
+        return;
+    }
+    uint8_t* d = (uint8_t*)dest + size - 1;
+    uint8_t const* s = src;
+    while (size-- != 0) *d-- = *s++;
+}
+
+static void pack_int(MLuaBuffer const* buf, lua_Unsigned off, lua_Unsigned v,
+                     bool little, int size, bool neg) {
+    uint8_t data[MAXINTSIZE];
+    data[little ? 0 : size - 1] = (uint8_t)v;
+    for (int i = 1; i < size; ++i) {
+        v >>= 8;
+        data[little ? i : size - 1 - i] = (uint8_t)v;
+    }
+    if (neg && size > (int)sizeof(lua_Integer)) {
+        for (int i = sizeof(lua_Integer); i < size; ++i) {
+            data[little ? i : size - 1 - i] = 0xff;
+        }
+    }
+    mlua_buffer_write(buf, off, size, data);
+}
+
+static lua_Integer unpack_int(lua_State* ls, uint8_t const* data, bool little,
+                              int size, bool is_signed) {
+    lua_Unsigned res = 0;
+    int limit = size <= (int)sizeof(lua_Integer) ? size
+                                                 : (int)sizeof(lua_Integer);
+    for (int i = limit - 1; i >= 0; --i) {
+        res <<= 8;
+        res |= (lua_Unsigned)data[little ? i : size - 1 - i];
+    }
+    if (size < (int)sizeof(lua_Integer)) {
+        if (is_signed) {
+            lua_Unsigned mask = (lua_Unsigned)1 << (size * 8 - 1);
+            res = (res ^ mask) - mask;  // Perform sign extension
+        }
+    } else if (size > (int)sizeof(lua_Integer)) {
+        int mask = !is_signed || (lua_Integer)res >= 0 ? 0 : 0xff;
+        for (int i = limit; i < size; ++i) {
+            if (luai_unlikely(data[little ? i : size - 1 - i] != mask)) {
+                luaL_error(ls, "%d-byte integer does not fit into Lua Integer",
+                           size);
+            }
+        }
+    }
+    return (lua_Integer)res;
+}
+
+static inline void check_room(lua_State* ls, MLuaBuffer const* buf,
+                              lua_Unsigned pos, lua_Unsigned len) {
+    if (luai_unlikely(pos > buf->size || len > buf->size - pos)) {
+        luaL_error(ls, "out of bounds");
+    }
+}
+
+static int mod_pack(lua_State* ls) {
+    MLuaBuffer dest;
+    luaL_argexpected(ls, mlua_get_buffer(ls, 1, &dest), 1, "buffer");
+    lua_Unsigned off = luaL_checkinteger(ls, 2);
+    char const* fmt = luaL_checkstring(ls, 3);
+    luaL_argcheck(ls, off <= dest.size, 2, "out of bounds");
+
+    PackHeader h = {.ls = ls, .little = native_endian.little,
+                    .max_align = 1};
+    lua_Unsigned pos = off;
+    int arg = 3;
+    while (*fmt != '\0') {
+        int size, to_align;
+        KOption opt = get_details(&h, pos - off, &fmt, &size, &to_align);
+        check_room(ls, &dest, pos, (lua_Unsigned)to_align + size);
+        if (to_align > 0) {
+            mlua_buffer_fill(&dest, pos, to_align, LUAL_PACKPADBYTE);
+            pos += to_align;
+        }
+        ++arg;
+        switch (opt) {
+        case Kint: {
+            lua_Integer v = luaL_checkinteger(ls, arg);
+            if (size < (int)sizeof(lua_Integer)) {
+                lua_Integer lim = (lua_Integer)1 << (size * 8 - 1);
+                luaL_argcheck(ls, -lim <= v && v < lim, arg,
+                              "integer overflow");
+            }
+            pack_int(&dest, pos, (lua_Unsigned)v, h.little, size, v < 0);
+            break;
+        }
+        case Kuint: {
+            lua_Integer v = luaL_checkinteger(ls, arg);
+            if (size < (int)sizeof(lua_Integer)) {
+                luaL_argcheck(ls,
+                    (lua_Unsigned)v < ((lua_Unsigned)1 << (size * 8)), arg,
+                    "unsigned overflow");
+            }
+            pack_int(&dest, pos, (lua_Unsigned)v, h.little, size, false);
+            break;
+        }
+        case Kfloat: {
+            float v = (float)luaL_checknumber(ls, arg);
+            uint8_t data[sizeof(v)];
+            copy_with_endian(data, &v, sizeof(v), h.little);
+            mlua_buffer_write(&dest, pos, sizeof(v), data);
+            break;
+        }
+        case Knumber: {
+            lua_Number v = luaL_checknumber(ls, arg);
+            uint8_t data[sizeof(v)];
+            copy_with_endian(data, &v, sizeof(v), h.little);
+            mlua_buffer_write(&dest, pos, sizeof(v), data);
+            break;
+        }
+        case Kdouble: {
+            double v = (double)luaL_checknumber(ls, arg);
+            uint8_t data[sizeof(v)];
+            copy_with_endian(data, &v, sizeof(v), h.little);
+            mlua_buffer_write(&dest, pos, sizeof(v), data);
+            break;
+        }
+        case Kchar: {
+            size_t len;
+            char const* s = luaL_checklstring(ls, arg, &len);
+            luaL_argcheck(ls, len <= (size_t)size, arg,
+                          "string longer than given size");
+            mlua_buffer_write(&dest, pos, len, s);
+            if (len < (size_t)size) {
+                mlua_buffer_fill(&dest, pos + len, size - len,
+                                 LUAL_PACKPADBYTE);
+            }
+            break;
+        }
+        case Kstring: {
+            size_t len;
+            char const* s = luaL_checklstring(ls, arg, &len);
+            luaL_argcheck(ls, size >= (int)sizeof(size_t)
+                              || len < ((size_t)1 << (size * 8)),
+                          arg, "string length does not fit in given size");
+            check_room(ls, &dest, pos + size, len);
+            pack_int(&dest, pos, (lua_Unsigned)len, h.little, size, false);
+            mlua_buffer_write(&dest, pos + size, len, s);
+            pos += len;
+            break;
+        }
+        case Kzstr: {
+            size_t len;
+            char const* s = luaL_checklstring(ls, arg, &len);
+            luaL_argcheck(ls, strlen(s) == len, arg, "string contains zeros");
+            check_room(ls, &dest, pos, len + 1);
+            mlua_buffer_write(&dest, pos, len + 1, s);
+            pos += len + 1;
+            break;
+        }
+        case Kpadding:
+            mlua_buffer_fill(&dest, pos, 1, LUAL_PACKPADBYTE);
+            __attribute__((fallthrough));
+        case Kpaddalign:
+        case Knop:
+            --arg;
+            break;
+        }
+        pos += size;
+    }
+    return lua_pushinteger(ls, pos), 1;
+}
+
+static int mod_unpack(lua_State* ls) {
+    MLuaBuffer src;
+    check_ro_buffer(ls, 1, &src);
+    lua_Unsigned off = luaL_checkinteger(ls, 2);
+    char const* fmt = luaL_checkstring(ls, 3);
+    luaL_argcheck(ls, off <= src.size, 2, "out of bounds");
+
+    PackHeader h = {.ls = ls, .little = native_endian.little,
+                    .max_align = 1};
+    lua_Unsigned pos = off;
+    int cnt = 0;
+    while (*fmt != '\0') {
+        int size, to_align;
+        KOption opt = get_details(&h, pos - off, &fmt, &size, &to_align);
+        check_room(ls, &src, pos, (lua_Unsigned)to_align + size);
+        pos += to_align;
+        luaL_checkstack(ls, 2, "too many results");
+        ++cnt;
+        switch (opt) {
+        case Kint:
+        case Kuint: {
+            uint8_t data[MAXINTSIZE];
+            mlua_buffer_read(&src, pos, size, data);
+            lua_pushinteger(ls, unpack_int(ls, data, h.little, size,
+                                           opt == Kint));
+            break;
+        }
+        case Kfloat: {
+            float v;
+            uint8_t data[sizeof(v)];
+            mlua_buffer_read(&src, pos, sizeof(v), data);
+            copy_with_endian(&v, data, sizeof(v), h.little);
+            lua_pushnumber(ls, (lua_Number)v);
+            break;
+        }
+        case Knumber: {
+            lua_Number v;
+            uint8_t data[sizeof(v)];
+            mlua_buffer_read(&src, pos, sizeof(v), data);
+            copy_with_endian(&v, data, sizeof(v), h.little);
+            lua_pushnumber(ls, v);
+            break;
+        }
+        case Kdouble: {
+            double v;
+            uint8_t data[sizeof(v)];
+            mlua_buffer_read(&src, pos, sizeof(v), data);
+            copy_with_endian(&v, data, sizeof(v), h.little);
+            lua_pushnumber(ls, (lua_Number)v);
+            break;
+        }
+        case Kchar: {
+            luaL_Buffer buf;
+            void* dest = luaL_buffinitsize(ls, &buf, size);
+            mlua_buffer_read(&src, pos, size, dest);
+            luaL_pushresultsize(&buf, size);
+            break;
+        }
+        case Kstring: {
+            uint8_t data[MAXINTSIZE];
+            mlua_buffer_read(&src, pos, size, data);
+            lua_Unsigned len = (lua_Unsigned)unpack_int(ls, data, h.little,
+                                                        size, false);
+            check_room(ls, &src, pos + size, len);
+            luaL_Buffer buf;
+            void* dest = luaL_buffinitsize(ls, &buf, len);
+            mlua_buffer_read(&src, pos + size, len, dest);
+            luaL_pushresultsize(&buf, len);
+            pos += len;
+            break;
+        }
+        case Kzstr: {
+            uint8_t zero = 0;
+            lua_Unsigned end = mlua_buffer_find(&src, pos, src.size - pos,
+                                                &zero, 1);
+            if (luai_unlikely(end == LUA_MAXUNSIGNED)) {
+                return luaL_error(ls, "unfinished string for format 'z'");
+            }
+            lua_Unsigned len = end - pos;
+            luaL_Buffer buf;
+            void* dest = luaL_buffinitsize(ls, &buf, len);
+            mlua_buffer_read(&src, pos, len, dest);
+            luaL_pushresultsize(&buf, len);
+            pos += len + 1;
+            break;
+        }
+        case Kpaddalign:
+        case Kpadding:
+        case Knop:
+            --cnt;
+            break;
+        }
+        pos += size;
+    }
+    lua_pushinteger(ls, pos);
+    return cnt + 1;
+}
+
 static int mod_alloc(lua_State* ls) {
     lua_newuserdatauv(ls, luaL_checkinteger(ls, 1), 0);
     luaL_getmetatable(ls, Buffer_name);
@@ -179,6 +611,301 @@ static int mod_mallinfo(lua_State* ls) {
     return 2;
 }
 
+static int mod_pool_stats(lua_State* ls) {
+#if MLUA_ALLOC_POOL
+    MLuaPoolStats stats;
+    mlua_pool_stats(mlua_global(ls)->alloc_pool, &stats);
+    mlua_push_size(ls, stats.size);
+    mlua_push_size(ls, stats.free);
+    mlua_push_size(ls, stats.largest);
+    mlua_push_size(ls, stats.cached);
+    return 4;
+#else
+    return 0;
+#endif
+}
+
+static int mod_budget(lua_State* ls) {
+#if MLUA_ALLOC_BUDGET
+    MLuaGlobal* g = mlua_global(ls);
+    size_t limit = g->alloc_limit, watermark = g->alloc_watermark;
+    if (!lua_isnoneornil(ls, 1)) {
+        lua_Integer v = luaL_checkinteger(ls, 1);
+        luaL_argcheck(ls, v >= 0, 1, "out of range");
+        g->alloc_limit = v;
+    }
+    if (!lua_isnoneornil(ls, 2)) {
+        lua_Integer v = luaL_checkinteger(ls, 2);
+        luaL_argcheck(ls, v >= 0, 2, "out of range");
+        g->alloc_watermark = v;
+    }
+    mlua_push_size(ls, limit);
+    mlua_push_size(ls, watermark);
+    mlua_push_size(ls, g->alloc_used);
+    return 3;
+#else
+    return 0;
+#endif
+}
+
+#if MLUA_ALLOC_BUDGET
+
+static int watermark_loop(lua_State* ls, bool timeout) {
+    MLuaGlobal* g = mlua_global(ls);
+    if (g->alloc_watermark != 0 && g->alloc_used >= g->alloc_watermark) {
+        return lua_pushboolean(ls, true), 1;
+    }
+    if (timeout) return lua_pushboolean(ls, false), 1;
+    return -1;
+}
+
+static bool timed_out(lua_State* ls) {
+    return !lua_isnil(ls, 1) && mlua_time_reached(ls, 1);
+}
+
+static int wait_watermark_1(lua_State* ls, int status, lua_KContext ctx) {
+    // Busy loop, as the event isn't available.
+    int res = watermark_loop(ls, timed_out(ls));
+    if (res >= 0) return res;
+    return mlua_thread_yield(ls, 0, &wait_watermark_1, ctx);
+}
+
+#endif  // MLUA_ALLOC_BUDGET
+
+static int mod_wait_watermark(lua_State* ls) {
+#if MLUA_ALLOC_BUDGET
+    if (lua_isnoneornil(ls, 1)) {
+        lua_settop(ls, 0);
+        lua_pushnil(ls);
+    } else {
+        uint64_t timeout = mlua_check_int64(ls, 1);
+        lua_settop(ls, 0);
+        mlua_push_deadline(ls, timeout);
+    }
+#if LIB_MLUA_MOD_MLUA_THREAD
+    MLuaEvent* ev = &mlua_global(ls)->alloc_event;
+    if (mlua_event_can_wait(ls, ev, 0)) {
+        return mlua_event_wait(ls, ev, 0, &watermark_loop, 1);
+    }
+#endif
+    if (!mlua_thread_blocking(ls)) {
+        return wait_watermark_1(ls, LUA_OK, 0);
+    }
+    for (;;) {
+        int res = watermark_loop(ls, timed_out(ls));
+        if (res >= 0) return res;
+    }
+#else
+    return 0;
+#endif
+}
+
+static int mod_profile_start(lua_State* ls) {
+#if MLUA_ALLOC_PROFILE
+    lua_Integer interval = luaL_optinteger(ls, 1, MLUA_ALLOC_PROFILE_INTERVAL);
+    luaL_argcheck(ls, interval > 0, 1, "out of range");
+    if (!mlua_alloc_profile_start(ls, interval)) {
+        return luaL_error(ls, "out of memory");
+    }
+    return lua_pushboolean(ls, true), 1;
+#else
+    return 0;
+#endif
+}
+
+static int mod_profile_stop(lua_State* ls) {
+#if MLUA_ALLOC_PROFILE
+    mlua_alloc_profile_stop(ls);
+#endif
+    return 0;
+}
+
+#if MLUA_ALLOC_PROFILE
+
+static void add_folded(luaL_Buffer* buf, MLuaAllocProfile const* prof,
+                       MLuaAllocStack const* st, size_t value) {
+    lua_State* ls = buf->L;
+    if (st->truncated) luaL_addstring(buf, "...;");
+    if (st->depth == 0) luaL_addstring(buf, "[no stack]");
+    for (int i = st->depth - 1; i >= 0; --i) {
+        uint16_t f = st->frames[i];
+        luaL_addstring(buf, f != MLUA_ALLOC_PROFILE_NO_FRAME ?
+                            prof->frames[f].name : "?");
+        if (i > 0) luaL_addchar(buf, ';');
+    }
+    lua_pushfstring(ls, " %I\n", (lua_Integer)value);
+    luaL_addvalue(buf);
+}
+
+#endif  // MLUA_ALLOC_PROFILE
+
+static int mod_profile_dump(lua_State* ls) {
+#if MLUA_ALLOC_PROFILE
+    bool counts = mlua_to_cbool(ls, 1);
+    MLuaAllocProfile const* prof = mlua_alloc_profile(ls);
+    if (prof == NULL) return 0;
+    // The profile may grow while the result is built, so only the stacks that
+    // exist now are dumped.
+    uint16_t nstacks = prof->nstacks;
+    luaL_Buffer buf;
+    luaL_buffinit(ls, &buf);
+    for (uint16_t i = 0; i < nstacks; ++i) {
+        MLuaAllocStack const* st = &prof->stacks[i];
+        add_folded(&buf, prof, st, counts ? st->count : st->size);
+    }
+    size_t dropped = counts ? prof->dropped_count : prof->dropped_size;
+    if (dropped != 0) {
+        lua_pushfstring(ls, "[dropped] %I\n", (lua_Integer)dropped);
+        luaL_addvalue(&buf);
+    }
+    luaL_pushresult(&buf);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+static int mod_require_report(lua_State* ls) {
+    mlua_push_require_report(ls);
+    return 1;
+}
+
+char const Arena_name[] = "mlua.mem.Arena";
+char const ArenaBuffer_name[] = "mlua.mem.ArenaBuffer";
+
+// An arena, from which sub-buffers are allocated sequentially, and released
+// all at once. Incrementing the generation invalidates all sub-buffers.
+typedef struct Arena {
+    size_t size;
+    size_t used;
+    size_t high;
+    uint32_t gen;
+    max_align_t data[];
+} Arena;
+
+// A sub-buffer of an arena. The arena is kept alive by the user value.
+typedef struct ArenaBuffer {
+    Arena* arena;
+    uint32_t gen;
+    void* ptr;
+    size_t size;
+} ArenaBuffer;
+
+static inline Arena* check_Arena(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Arena_name);
+}
+
+static int Arena___new(lua_State* ls) {
+    lua_remove(ls, 1);  // Remove class
+    lua_Integer size = luaL_checkinteger(ls, 1);
+    luaL_argcheck(ls, size >= 0, 1, "out of range");
+    Arena* arena = lua_newuserdatauv(ls, sizeof(Arena) + size, 0);
+    arena->size = size;
+    arena->used = 0;
+    arena->high = 0;
+    arena->gen = 0;
+    luaL_getmetatable(ls, Arena_name);
+    lua_setmetatable(ls, -2);
+    return 1;
+}
+
+static int Arena_alloc(lua_State* ls) {
+    Arena* arena = check_Arena(ls, 1);
+    lua_Integer size = luaL_checkinteger(ls, 2);
+    luaL_argcheck(ls, size >= 0, 2, "out of range");
+    lua_Integer align = luaL_optinteger(ls, 3, alignof(max_align_t));
+    luaL_argcheck(ls, align > 0 && (align & (align - 1)) == 0, 3,
+                  "not a power of 2");
+    uintptr_t base = (uintptr_t)arena->data;
+    uintptr_t ptr = (base + arena->used + (align - 1)) & ~(uintptr_t)(align - 1);
+    size_t off = ptr - base;
+    if (off > arena->size || (size_t)size > arena->size - off) return 0;
+    arena->used = off + size;
+    if (arena->used > arena->high) arena->high = arena->used;
+
+    ArenaBuffer* buf = lua_newuserdatauv(ls, sizeof(ArenaBuffer), 1);
+    buf->arena = arena;
+    buf->gen = arena->gen;
+    buf->ptr = (void*)ptr;
+    buf->size = size;
+    luaL_getmetatable(ls, ArenaBuffer_name);
+    lua_setmetatable(ls, -2);
+    lua_pushvalue(ls, 1);
+    lua_setiuservalue(ls, -2, 1);
+    return 1;
+}
+
+static int Arena_reset(lua_State* ls) {
+    Arena* arena = check_Arena(ls, 1);
+    arena->used = 0;
+    ++arena->gen;
+    return 0;
+}
+
+static int Arena_stats(lua_State* ls) {
+    Arena* arena = check_Arena(ls, 1);
+    mlua_push_size(ls, arena->used);
+    mlua_push_size(ls, arena->high);
+    mlua_push_size(ls, arena->size);
+    return 3;
+}
+
+MLUA_SYMBOLS(Arena_syms) = {
+    MLUA_SYM_F(alloc, Arena_),
+    MLUA_SYM_F(reset, Arena_),
+    MLUA_SYM_F(stats, Arena_),
+};
+
+#define Arena___close Arena_reset
+
+MLUA_SYMBOLS_NOHASH(Arena_syms_nh) = {
+    MLUA_SYM_F_NH(__new, Arena_),
+    MLUA_SYM_F_NH(__close, Arena_),
+};
+
+static inline bool is_valid(ArenaBuffer const* buf) {
+    return buf->gen == buf->arena->gen;
+}
+
+static ArenaBuffer* check_ArenaBuffer(lua_State* ls, int arg) {
+    ArenaBuffer* buf = luaL_checkudata(ls, arg, ArenaBuffer_name);
+    if (luai_unlikely(!is_valid(buf))) {
+        luaL_error(ls, "stale arena buffer");
+        return NULL;
+    }
+    return buf;
+}
+
+static int ArenaBuffer_ptr(lua_State* ls) {
+    return lua_pushlightuserdata(ls, check_ArenaBuffer(ls, 1)->ptr), 1;
+}
+
+static int ArenaBuffer_is_valid(lua_State* ls) {
+    ArenaBuffer* buf = luaL_checkudata(ls, 1, ArenaBuffer_name);
+    return lua_pushboolean(ls, is_valid(buf)), 1;
+}
+
+static int ArenaBuffer___len(lua_State* ls) {
+    return mlua_push_size(ls, check_ArenaBuffer(ls, 1)->size), 1;
+}
+
+static int ArenaBuffer___buffer(lua_State* ls) {
+    ArenaBuffer* buf = check_ArenaBuffer(ls, 1);
+    lua_pushlightuserdata(ls, buf->ptr);
+    mlua_push_size(ls, buf->size);
+    return 2;
+}
+
+MLUA_SYMBOLS(ArenaBuffer_syms) = {
+    MLUA_SYM_F(ptr, ArenaBuffer_),
+    MLUA_SYM_F(is_valid, ArenaBuffer_),
+};
+
+MLUA_SYMBOLS_NOHASH(ArenaBuffer_syms_nh) = {
+    MLUA_SYM_F_NH(__len, ArenaBuffer_),
+    MLUA_SYM_F_NH(__buffer, ArenaBuffer_),
+};
+
 MLUA_SYMBOLS(module_syms) = {
     MLUA_SYM_F(read, mod_),
     MLUA_SYM_F(read_cstr, mod_),
@@ -187,8 +914,19 @@ MLUA_SYMBOLS(module_syms) = {
     MLUA_SYM_F(find, mod_),
     MLUA_SYM_F(get, mod_),
     MLUA_SYM_F(set, mod_),
+    MLUA_SYM_F(copy, mod_),
+    MLUA_SYM_F(compare, mod_),
+    MLUA_SYM_F(pack, mod_),
+    MLUA_SYM_F(unpack, mod_),
     MLUA_SYM_F(alloc, mod_),
     MLUA_SYM_F(mallinfo, mod_),
+    MLUA_SYM_F(pool_stats, mod_),
+    MLUA_SYM_F(budget, mod_),
+    MLUA_SYM_F(wait_watermark, mod_),
+    MLUA_SYM_F(profile_start, mod_),
+    MLUA_SYM_F(profile_stop, mod_),
+    MLUA_SYM_F(profile_dump, mod_),
+    MLUA_SYM_F(require_report, mod_),
 };
 
 MLUA_OPEN_MODULE(mlua.mem) {
@@ -202,5 +940,15 @@ MLUA_OPEN_MODULE(mlua.mem) {
     // Create the Buffer class.
     mlua_new_class(ls, Buffer_name, Buffer_syms, Buffer_syms_nh);
     lua_pop(ls, 1);
+
+    // Create the Arena class.
+    mlua_new_class(ls, Arena_name, Arena_syms, Arena_syms_nh);
+    mlua_set_metaclass(ls);
+    lua_setfield(ls, -2, "Arena");
+
+    // Create the ArenaBuffer class.
+    mlua_new_class(ls, ArenaBuffer_name, ArenaBuffer_syms,
+                   ArenaBuffer_syms_nh);
+    lua_pop(ls, 1);
     return 1;
 }
@@ -3,7 +3,9 @@
 
 _ENV = module(...)
 
+local math = require 'math'
 local mem = require 'mlua.mem'
+local thread = require 'mlua.thread'
 local string = require 'string'
 local table = require 'table'
 
@@ -205,3 +207,320 @@ function _test_set(t)
         else exp:raises("out of bounds") end
     end
 end
+
+function test_pack_unpack(t)
+    local buf = mem.alloc(24)
+    for _, test in ipairs{
+        {0, '<I2I2I4', 1, 2, 3},
+        {3, '>i3h', -5, 1000},
+        {1, '<!4bi4', 7, -1},
+        {2, 'c5', 'abcde'},
+        {0, 's1z', 'abc', 'def'},
+        {4, '<dB', 1.5, 255},
+        {20, '<I4', 0xdeadbeef},
+    } do
+        local off, fmt = test[1], test[2]
+        local args = table.pack(table.unpack(test, 3))
+        local want = string.pack(fmt, table.unpack(args, 1, args.n))
+        mem.write(buf, ('\0'):rep(#buf))
+        t:expect(t.expr(mem).pack(buf, off, fmt, table.unpack(args, 1, args.n)))
+            :eq(off + #want)
+        t:expect(t.expr(mem).read(buf, off, #want)):eq(want)
+        local res = table.pack(mem.unpack(buf, off, fmt))
+        t:expect(res.n):label("#results"):eq(args.n + 1)
+        for i = 1, args.n do
+            t:expect(res[i]):label("results[%s]", i):eq(args[i])
+        end
+        t:expect(res[res.n]):label("end"):eq(off + #want)
+        t:expect(t.mexpr(mem).unpack(buf:ptr(), off, fmt))
+            :eq{table.unpack(res, 1, res.n)}
+        t:expect(t.mexpr(mem).unpack(mem.read(buf), off, fmt))
+            :eq{table.unpack(res, 1, res.n)}
+    end
+end
+
+function test_pack_unpack_errors(t)
+    local buf = mem.alloc(8)
+    t:expect(t.expr(mem).pack(buf, 0, '<I4I4', 1, 2)):eq(8)
+    t:expect(t.expr(mem).pack(buf, 6, '<I4', 1)):raises("out of bounds")
+    t:expect(t.expr(mem).pack(buf, 9, '')):raises("out of bounds")
+    t:expect(t.expr(mem).pack(buf, 0, 'B', 256)):raises("overflow")
+    t:expect(t.expr(mem).pack(buf, 0, 'z', 'a\0b'))
+        :raises("string contains zeros")
+    t:expect(t.expr(mem).pack('abcd', 0, 'B', 1)):raises("buffer expected")
+    t:expect(t.expr(mem).unpack(buf, 6, '<I4')):raises("out of bounds")
+    t:expect(t.expr(mem).unpack('abc', 0, 'z'))
+        :raises("unfinished string for format 'z'")
+    t:expect(t.expr(mem).unpack(buf, 0, 'y')):raises("invalid format option")
+end
+
+local hdr_fmt, hdr_size = '<I2I2I4', string.packsize('<I2I2I4')
+
+function bench_pack(t)
+    local buf = mem.alloc(hdr_size)
+    t:benchmark("string.pack+write", function(n)
+        for i = 1, n do mem.write(buf, string.pack(hdr_fmt, 1, 2, i)) end
+    end)
+    t:benchmark("mem.pack", function(n)
+        for i = 1, n do mem.pack(buf, 0, hdr_fmt, 1, 2, i) end
+    end)
+end
+
+function bench_unpack(t)
+    local buf = mem.alloc(hdr_size)
+    mem.pack(buf, 0, hdr_fmt, 1, 2, 3)
+    t:benchmark("read+string.unpack", function(n)
+        for i = 1, n do string.unpack(hdr_fmt, mem.read(buf)) end
+    end)
+    t:benchmark("mem.unpack", function(n)
+        for i = 1, n do mem.unpack(buf, 0, hdr_fmt) end
+    end)
+end
+
+function test_copy(t)
+    local src = mem.alloc(6)
+    mem.write(src, 'abcdef')
+    local buf = mem.alloc(10)
+    for _, test in ipairs{
+        {{0, src}, 'abcdef____'},
+        {{4, src}, '____abcdef'},
+        {{5, src}, raise},
+        {{2, src, 3}, '__def_____'},
+        {{2, src, 1, 2}, '__bc______'},
+        {{2, src, 5, 2}, raise},
+        {{8, 'xyz', 1}, '________yz'},
+        {{10, src, 6}, '__________'},
+        {{11, src, 6}, raise},
+    } do
+        local args, want = table.unpack(test)
+        mem.write(buf, '__________')
+        local exp = t:expect(t.expr(mem).copy(buf, table.unpack(args)))
+        if want ~= raise then
+            exp:eq(nil)
+            t:expect(t.expr(mem).read(buf)):eq(want)
+            mem.write(buf, '__________')
+            mem.copy(buf:ptr(), table.unpack(args))
+            t:expect(t.expr(mem).read(buf)):eq(want)
+        else exp:raises("out of bounds") end
+    end
+    mem.write(buf, 'abcdefghij')
+    mem.copy(buf, 2, buf, 0, 6)
+    t:expect(t.expr(mem).read(buf)):eq('ababcdefij')
+end
+
+function test_compare(t)
+    local buf = mem.alloc(6)
+    mem.write(buf, 'abcdef')
+    for _, test in ipairs{
+        {{0, 'abcdef'}, 0},
+        {{0, 'abcdeg'}, -1},
+        {{0, 'abcdee'}, 1},
+        {{2, 'cde'}, 0},
+        {{2, 'xcd', 1}, 0},
+        {{2, 'xcdx', 1, 3}, -1},
+        {{4, 'efg'}, raise},
+        {{0, 'abc', 2, 2}, raise},
+        {{6, ''}, 0},
+    } do
+        local args, want = table.unpack(test)
+        local exp = t:expect(t.expr(mem).compare(buf, table.unpack(args)))
+        if want ~= raise then
+            exp:eq(want)
+            t:expect(t.expr(mem).compare(buf:ptr(), table.unpack(args)))
+                :eq(want)
+            t:expect(t.expr(mem).compare(mem.read(buf), table.unpack(args)))
+                :eq(want)
+        else exp:raises("out of bounds") end
+    end
+end
+
+function test_arena(t)
+    local arena = mem.Arena(64)
+    local a = arena:alloc(10, 1)
+    local b = arena:alloc(16)
+    t:expect(#a):label("#a"):eq(10)
+    t:expect(#b):label("#b"):eq(16)
+    t:expect(t.expr(b):ptr()):neq(a:ptr())
+    mem.write(a, 'abcdefghij')
+    mem.fill(b, ('x'):byte())
+    t:expect(t.expr(mem).read(a)):eq('abcdefghij')
+    t:expect(t.expr(mem).read(b)):eq(('x'):rep(16))
+    t:expect(t.expr(arena):alloc(64)):eq(nil)
+    t:expect(t.expr(arena):alloc(1, 3)):raises("not a power of 2")
+    local used, high, size = arena:stats()
+    t:expect(used):label("used"):gte(26)
+    t:expect(high):label("high"):eq(used)
+    t:expect(size):label("size"):eq(64)
+
+    arena:reset()
+    t:expect(t.expr(a):is_valid()):eq(false)
+    t:expect(t.expr(mem).read(a)):raises("stale arena buffer")
+    t:expect(t.expr(mem).write(b, 'abc')):raises("stale arena buffer")
+    local c = arena:alloc(64)
+    t:expect(#c):label("#c"):eq(64)
+    t:expect(t.expr(c):is_valid()):eq(true)
+    local used2, high2 = arena:stats()
+    t:expect(used2):label("used"):eq(64)
+    t:expect(high2):label("high"):eq(64)
+
+    do
+        local arena2<close> = arena
+    end
+    t:expect(t.expr(c):is_valid()):eq(false)
+    t:expect(arena:stats()):label("used"):eq(0)
+end
+
+function bench_arena(t)
+    local arena = mem.Arena(4096)
+    t:benchmark("alloc", function(n)
+        for i = 1, n do
+            local buf = mem.alloc(64)
+            mem.fill(buf, i)
+        end
+    end)
+    t:benchmark("Arena:alloc", function(n)
+        for i = 1, n do
+            if i % 64 == 0 then arena:reset() end
+            local buf = arena:alloc(64)
+            mem.fill(buf, i)
+        end
+    end)
+end
+
+function test_pool_stats(t)
+    local size, free, largest, cached = mem.pool_stats()
+    if not size then t:skip("pool allocator disabled") end
+    t:expect(free):label("free"):gt(0):lte(size)
+    t:expect(largest):label("largest"):gt(0):lte(free)
+    t:expect(cached):label("cached"):gte(0):lt(size)
+end
+
+function test_pool_pages(t)
+    if not mem.pool_stats() then t:skip("pool allocator disabled") end
+    collectgarbage()
+    local _, free = mem.pool_stats()
+
+    -- Small blocks are allocated from pages taken from the heap.
+    local tabs = {}
+    for i = 1, 4096 do tabs[i] = {i} end
+    local _, free2 = mem.pool_stats()
+    t:expect(free2):label("free after allocation"):lt(free - 4096 * 32)
+
+    -- Pages that become empty are returned to the heap.
+    tabs = nil
+    collectgarbage()
+    local _, free3 = mem.pool_stats()
+    t:expect(free3):label("free after collection"):gte(free - (32 << 10))
+end
+
+function test_budget(t)
+    local limit, watermark = mem.budget()
+    if not limit then t:skip("memory budget disabled") end
+    t:cleanup(function() mem.budget(limit, watermark) end)
+    collectgarbage()
+    local _, _, used = mem.budget()
+
+    -- A workload that exceeds the limit fails with a memory error.
+    mem.budget(used + (64 << 10))
+    local ok, err = pcall(function()
+        local tab = {}
+        for i = 1, 1 << 20 do tab[i] = {i} end
+    end)
+    mem.budget(limit)
+    t:expect(ok):label("ok"):eq(false)
+    t:expect(err):label("err"):eq("not enough memory")
+
+    -- A workload that produces garbage is kept below the limit by emergency
+    -- collections.
+    collectgarbage()
+    _, _, used = mem.budget()
+    mem.budget(used + (64 << 10))
+    local ok, err = pcall(function()
+        for i = 1, 10000 do local tab = {i, i, i, i} end
+    end)
+    local _, _, after = mem.budget(limit)
+    t:expect(ok):label("ok"):eq(true)
+    t:expect(err):label("err"):eq(nil)
+    t:expect(after):label("after"):lte(used + (64 << 10))
+end
+
+function test_wait_watermark(t)
+    local limit, watermark = mem.budget()
+    if not limit then t:skip("memory budget disabled") end
+    t:cleanup(function() mem.budget(limit, watermark) end)
+    collectgarbage()
+    local _, _, used = mem.budget()
+    mem.budget(nil, used + (16 << 10))
+    t:expect(t.expr(mem).wait_watermark(0)):eq(false)
+    local reached
+    local monitor<close> = thread.start(function()
+        reached = mem.wait_watermark()
+    end)
+    local keep = {}
+    for i = 1, 1000 do keep[i] = {i} end
+    monitor:join()
+    t:expect(reached):label("reached"):eq(true)
+end
+
+local function alloc_tables(n)
+    local res = {}
+    for i = 1, n do res[i] = {i} end
+    return res
+end
+
+local function folded_total(dump)
+    local total = 0
+    for v in dump:gmatch(' (%d+)\n') do total = total + tonumber(v) end
+    return total
+end
+
+function test_profile(t)
+    if not mem.profile_start(64) then t:skip("allocation profiler disabled") end
+    t:cleanup(mem.profile_stop)
+    alloc_tables(1000)
+    mem.profile_stop()
+    local dump = mem.profile_dump()
+    t:expect(dump):label("dump"):matches('alloc_tables %([^)]+%) %d+\n')
+    t:expect(folded_total(dump)):label("bytes"):gte(1000 * 16)
+    t:expect(folded_total(mem.profile_dump(true))):label("count"):gte(1000)
+end
+
+function test_require_report(t)
+    local report = mem.require_report()
+    if not report then t:skip("module loading statistics disabled") end
+    t:expect(report):label("report"):matches('^ +time +self +allocs ')
+    t:expect(report):label("report"):matches('%d  mlua%.mem%.test[ \n]')
+end
+
+function bench_alloc(t)
+    t:benchmark("string", function(n)
+        for i = 1, n do local s = 'abc' .. i end
+    end)
+    t:benchmark("table", function(n)
+        for i = 1, n do local tab = {i, i} end
+    end)
+    t:benchmark("closure", function(n)
+        for i = 1, n do local f = function() return i end end
+    end)
+end
+
+function bench_alloc_churn(t)
+    -- Replace random slots with objects of random sizes, most of them small.
+    local slots, size = {}, 512
+    local function churn(n)
+        for i = 1, n do
+            local r, v = math.random(100)
+            if r <= 50 then v = ('x'):rep(math.random(40)) .. i
+            elseif r <= 80 then v = {i, i, i}
+            elseif r <= 95 then v = ('y'):rep(math.random(100, 1000)) .. i
+            else v = table.pack(('z'):rep(math.random(1000, 8000)) .. i) end
+            slots[math.random(size)] = v
+        end
+    end
+    t:benchmark("churn", churn)
+    collectgarbage()
+    local psize, free, largest, cached = mem.pool_stats()
+    if not psize then return end
+    t:printf("pool: free %d, largest %d (%.1f%% fragmentation), cached %d\n",
+             free, largest, 100 * (1 - largest / free), cached)
+end
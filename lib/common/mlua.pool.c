@@ -0,0 +1,177 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lobject.h"
+#include "ltable.h"
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The default maximum number of free objects held by a pool.
+#ifndef MLUA_POOL_MAX
+#define MLUA_POOL_MAX 64
+#endif
+
+// Remove all entries from a table, keeping its array and hash parts allocated.
+static void clear_table(Table* h) {
+    unsigned int asize = luaH_realasize(h);
+    for (unsigned int i = 0; i < asize; ++i) setempty(&h->array[i]);
+    if (isdummy(h)) return;
+    // Reset the hash part to the state of a newly allocated node vector, so
+    // that new keys can use all the nodes without a rehash.
+    size_t size = sizenode(h);
+    for (size_t i = 0; i < size; ++i) {
+        Node* n = gnode(h, i);
+        gnext(n) = 0;
+        setnilkey(n);
+        setempty(gval(n));
+    }
+    h->lastfree = gnode(h, size);
+}
+
+static int mod_new_table(lua_State* ls) {
+    lua_Integer narr = luaL_optinteger(ls, 1, 0);
+    luaL_argcheck(ls, 0 <= narr && narr <= INT_MAX, 1, "out of range");
+    lua_Integer nrec = luaL_optinteger(ls, 2, 0);
+    luaL_argcheck(ls, 0 <= nrec && nrec <= INT_MAX, 2, "out of range");
+    lua_createtable(ls, narr, nrec);
+    return 1;
+}
+
+static int mod_clear(lua_State* ls) {
+    luaL_checktype(ls, 1, LUA_TTABLE);
+    clear_table((Table*)lua_topointer(ls, 1));
+    lua_settop(ls, 1);
+    return 1;
+}
+
+static char const Pool_name[] = "mlua.pool.Pool";
+
+// User value indexes for Pool.
+typedef enum PoolUserValueIndex {
+    UV_FACTORY = 1,
+    UV_RESET,
+    UV_FREE,
+    UV_COUNT = UV_FREE,
+} PoolUserValueIndex;
+
+typedef struct Pool {
+    uint64_t hits;
+    uint64_t misses;
+    lua_Integer free;
+    lua_Integer max;
+} Pool;
+
+static inline Pool* check_Pool(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Pool_name);
+}
+
+static int Pool___new(lua_State* ls) {
+    lua_remove(ls, 1);  // Remove class
+    luaL_checkany(ls, 1);
+    lua_Integer max = luaL_optinteger(ls, 3, MLUA_POOL_MAX);
+    luaL_argcheck(ls, 0 <= max && max <= INT_MAX, 3, "out of range");
+    Pool* pool = lua_newuserdatauv(ls, sizeof(Pool), UV_COUNT);
+    pool->hits = 0;
+    pool->misses = 0;
+    pool->free = 0;
+    pool->max = max;
+    luaL_getmetatable(ls, Pool_name);
+    lua_setmetatable(ls, -2);
+    lua_pushvalue(ls, 1);
+    lua_setiuservalue(ls, -2, UV_FACTORY);
+    lua_pushvalue(ls, 2);
+    lua_setiuservalue(ls, -2, UV_RESET);
+    lua_createtable(ls, max < 16 ? max : 16, 0);
+    lua_setiuservalue(ls, -2, UV_FREE);
+    return 1;
+}
+
+static int Pool_acquire(lua_State* ls) {
+    Pool* pool = check_Pool(ls, 1);
+    if (pool->free > 0) {
+        ++pool->hits;
+        lua_getiuservalue(ls, 1, UV_FREE);
+        lua_rawgeti(ls, -1, pool->free);
+        lua_pushnil(ls);
+        lua_rawseti(ls, -3, pool->free);
+        --pool->free;
+        return 1;
+    }
+    ++pool->misses;
+    int nargs = lua_gettop(ls) - 1;
+    lua_getiuservalue(ls, 1, UV_FACTORY);
+    lua_replace(ls, 1);
+    lua_call(ls, nargs, 1);
+    return 1;
+}
+
+static int Pool_release(lua_State* ls) {
+    Pool* pool = check_Pool(ls, 1);
+    luaL_checkany(ls, 2);
+    lua_settop(ls, 2);
+    if (pool->free >= pool->max) return 0;
+    switch (lua_getiuservalue(ls, 1, UV_RESET)) {
+    case LUA_TNIL:
+        lua_pop(ls, 1);
+        break;
+    case LUA_TFUNCTION:
+        // Clear tables directly if the reset function is clear().
+        if (lua_tocfunction(ls, -1) == &mod_clear
+                && lua_type(ls, 2) == LUA_TTABLE) {
+            lua_pop(ls, 1);
+            clear_table((Table*)lua_topointer(ls, 2));
+            break;
+        }
+        __attribute__((fallthrough));
+    default:
+        lua_pushvalue(ls, 2);
+        lua_call(ls, 1, 0);
+        break;
+    }
+    lua_getiuservalue(ls, 1, UV_FREE);
+    lua_pushvalue(ls, 2);
+    lua_rawseti(ls, -2, ++pool->free);
+    return 0;
+}
+
+static int Pool_stats(lua_State* ls) {
+    Pool* pool = check_Pool(ls, 1);
+    mlua_push_int64(ls, pool->hits);
+    mlua_push_int64(ls, pool->misses);
+    lua_pushinteger(ls, pool->free);
+    return 3;
+}
+
+MLUA_SYMBOLS(Pool_syms) = {
+    MLUA_SYM_F(acquire, Pool_),
+    MLUA_SYM_F(release, Pool_),
+    MLUA_SYM_F(stats, Pool_),
+};
+
+MLUA_SYMBOLS_NOHASH(Pool_syms_nh) = {
+    MLUA_SYM_F_NH(__new, Pool_),
+};
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(new_table, mod_),
+    MLUA_SYM_F(clear, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.pool) {
+    mlua_require(ls, "mlua.int64", false);
+
+    // Create the module.
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Pool class.
+    mlua_new_class(ls, Pool_name, Pool_syms, Pool_syms_nh);
+    mlua_set_metaclass(ls);
+    lua_setfield(ls, -2, "Pool");
+    return 1;
+}
@@ -0,0 +1,106 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+local gc = require 'mlua.gc'
+local pool = require 'mlua.pool'
+local util = require 'mlua.util'
+local table = require 'table'
+
+function test_new_table(t)
+    local tab = pool.new_table(4, 2)
+    t:expect(next(tab)):label("next(tab)"):eq(nil)
+    tab[1], tab.a = 1, 2
+    t:expect(#tab):label("#tab"):eq(1)
+    t:expect(t.expr(pool).new_table(-1)):raises("out of range")
+    t:expect(t.expr(pool).new_table(0, -1)):raises("out of range")
+end
+
+function test_clear(t)
+    local tab = {1, 2, 3, a = 1, b = 2, [5.5] = 3}
+    t:expect(t.expr(pool).clear(tab)):eq(tab)
+    t:expect(next(tab)):label("next(tab)"):eq(nil)
+    t:expect(#tab):label("#tab"):eq(0)
+
+    -- The cleared table accepts new keys without growing.
+    local count = gc.count()
+    for i = 1, 3 do tab[i] = i end
+    tab.c, tab.d, tab.e = 4, 5, 6
+    t:expect(gc.count()):label("count"):eq(count)
+    t:expect(tab):label("tab"):eq({1, 2, 3, c = 4, d = 5, e = 6}, util.table_eq)
+    t:expect(t.expr(pool).clear(1)):raises("table expected")
+end
+
+function test_Pool(t)
+    local created, resets = 0, 0
+    local p = pool.Pool(function(v)
+        created = created + 1
+        return {v = v}
+    end, function(obj)
+        resets = resets + 1
+        obj.v = nil
+    end, 2)
+    local a, b, c = p:acquire(1), p:acquire(2), p:acquire(3)
+    t:expect(a.v):label("a.v"):eq(1)
+    t:expect(created):label("created"):eq(3)
+    p:release(a)
+    p:release(b)
+    p:release(c)  -- Dropped, the pool is full
+    t:expect(resets):label("resets"):eq(2)
+    t:expect(t.expr(p):acquire(4)):eq(b)
+    t:expect(b.v):label("b.v"):eq(nil)
+    t:expect(t.expr(p):acquire(5)):eq(a)
+    t:expect(t.expr(p):acquire(6)):neq(c)
+    local hits, misses, free = p:stats()
+    t:expect(hits):label("hits"):eq(2)
+    t:expect(misses):label("misses"):eq(4)
+    t:expect(free):label("free"):eq(0)
+end
+
+function test_Pool_clear(t)
+    local p = pool.Pool(pool.new_table, pool.clear)
+    local tab = p:acquire(0, 4)
+    tab.a, tab.b = 1, 2
+    p:release(tab)
+    t:expect(t.expr(p):acquire()):eq(tab)
+    t:expect(next(tab)):label("next(tab)"):eq(nil)
+end
+
+-- Decode a message into a table.
+local function decode(msg, i)
+    msg.id, msg.kind, msg.temp, msg.status = i, 'temp', i % 40, 'ok'
+    return msg
+end
+
+function bench_messages(t)
+    local p = pool.Pool(pool.new_table, pool.clear)
+    local variants = {
+        {"new", function(n)
+            for i = 1, n do decode({}, i) end
+        end},
+        {"new_table", function(n)
+            for i = 1, n do decode(pool.new_table(0, 4), i) end
+        end},
+        {"Pool", function(n)
+            for i = 1, n do p:release(decode(p:acquire(0, 4), i)) end
+        end},
+    }
+    local count = 20000
+    for _, v in ipairs(variants) do
+        local name, fn = table.unpack(v)
+        gc.collect()
+        gc_stats(true)
+        local _, before = alloc_stats()
+        t:benchmark(name, fn, count)
+        local _, after = alloc_stats()
+        local pauses, time = gc_stats()
+        if before then
+            t:printf("%s: %.1f bytes allocated / message\n", name,
+                     (after - before) / count)
+        end
+        if pauses then
+            t:printf("%s: %.3f us GC time / message\n", name, time / count)
+        end
+    end
+end
@@ -0,0 +1,349 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include "mlua/ring.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/thread.h"
+#include "mlua/util.h"
+
+size_t mlua_ring_write(MLuaRing* ring, void const* src, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        size_t size;
+        void* ptr = mlua_ring_write_span(ring, done, &size);
+        if (ptr == NULL) break;
+        if (size > len - done) size = len - done;
+        memcpy(ptr, src + done, size);
+        done += size;
+    }
+    if (done > 0) mlua_ring_commit(ring, done);
+    return done;
+}
+
+size_t mlua_ring_peek(MLuaRing* ring, size_t off, void* dest, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        size_t size;
+        void* ptr = mlua_ring_read_span(ring, off + done, &size);
+        if (ptr == NULL) break;
+        if (size > len - done) size = len - done;
+        memcpy(dest + done, ptr, size);
+        done += size;
+    }
+    return done;
+}
+
+size_t mlua_ring_read(MLuaRing* ring, void* dest, size_t len) {
+    size_t done = mlua_ring_peek(ring, 0, dest, len);
+    if (done > 0) mlua_ring_consume(ring, done);
+    return done;
+}
+
+size_t mlua_ring_discard(MLuaRing* ring, size_t len) {
+    size_t count = mlua_ring_count(ring);
+    if (len > count) len = count;
+    if (len > 0) mlua_ring_consume(ring, len);
+    return len;
+}
+
+typedef struct Ring {
+    MLuaRing ring;
+    MLuaEvent data_event;
+    MLuaEvent space_event;
+    uint8_t data[0];
+} Ring;
+
+static char const Ring_name[] = "mlua.ring.Ring";
+
+static inline Ring* check_Ring(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Ring_name);
+}
+
+static inline Ring* to_Ring(lua_State* ls, int arg) {
+    return lua_touserdata(ls, arg);
+}
+
+MLuaRing* mlua_ring_check(lua_State* ls, int arg) {
+    return &check_Ring(ls, arg)->ring;
+}
+
+#if LIB_MLUA_MOD_MLUA_THREAD
+
+static void notify(MLuaRing* ring, bool space) {
+    Ring* r = (Ring*)ring;
+    mlua_event_set(space ? &r->space_event : &r->data_event);
+}
+
+#endif  // LIB_MLUA_MOD_MLUA_THREAD
+
+// The buffer protocol exposes the data that is readable when __buffer is
+// called. The producer may append more data concurrently.
+static void* Ring_span(void* ptr, lua_Unsigned off, lua_Unsigned* len,
+                       void** state) {
+    size_t size;
+    void* span = mlua_ring_read_span(ptr, off, &size);
+    if (span != NULL) *len = size;
+    return span;
+}
+
+static MLuaBufferVt const Ring_vt = {.span = &Ring_span};
+
+static int Ring___buffer(lua_State* ls) {
+    Ring* r = check_Ring(ls, 1);
+    lua_pushlightuserdata(ls, &r->ring);
+    mlua_push_size(ls, mlua_ring_count(&r->ring));
+    lua_pushlightuserdata(ls, (void*)&Ring_vt);
+    return 3;
+}
+
+static int Ring___len(lua_State* ls) {
+    return mlua_push_size(ls, mlua_ring_count(&check_Ring(ls, 1)->ring)), 1;
+}
+
+static int Ring_size(lua_State* ls) {
+    return mlua_push_size(ls, check_Ring(ls, 1)->ring.size), 1;
+}
+
+static int Ring_space(lua_State* ls) {
+    return mlua_push_size(ls, mlua_ring_space(&check_Ring(ls, 1)->ring)), 1;
+}
+
+static int Ring_set_thresholds(lua_State* ls) {
+    MLuaRing* ring = &check_Ring(ls, 1)->ring;
+    lua_Integer data = luaL_optinteger(ls, 2, ring->data_threshold);
+    lua_Integer space = luaL_optinteger(ls, 3, ring->space_threshold);
+    luaL_argcheck(ls, 1 <= data && (lua_Unsigned)data <= ring->size, 2,
+                  "out of range");
+    luaL_argcheck(ls, 1 <= space && (lua_Unsigned)space <= ring->size, 3,
+                  "out of range");
+    ring->data_threshold = data;
+    ring->space_threshold = space;
+    return 0;
+}
+
+static int Ring_write(lua_State* ls) {
+    MLuaRing* ring = &check_Ring(ls, 1)->ring;
+    MLuaBuffer src;
+    if (!mlua_get_ro_buffer(ls, 2, &src)) {
+        return luaL_typeerror(ls, 2, "string or buffer");
+    }
+    lua_Unsigned off = luaL_optinteger(ls, 3, 0);
+    luaL_argcheck(ls, off <= src.size, 3, "out of bounds");
+    lua_Unsigned len = src.size - off;
+    if (!lua_isnoneornil(ls, 4)) {
+        len = luaL_checkinteger(ls, 4);
+        luaL_argcheck(ls, off + len <= src.size, 4, "out of bounds");
+    }
+    size_t done = 0;
+    while (done < len) {
+        size_t size;
+        void* ptr = mlua_ring_write_span(ring, done, &size);
+        if (ptr == NULL) break;
+        if (size > len - done) size = len - done;
+        mlua_buffer_read(&src, off + done, size, ptr);
+        done += size;
+    }
+    if (done > 0) mlua_ring_commit(ring, done);
+    return mlua_push_size(ls, done), 1;
+}
+
+static size_t check_len(lua_State* ls, MLuaRing* ring, int arg, size_t off) {
+    size_t count = mlua_ring_count(ring);
+    count = off < count ? count - off : 0;
+    if (lua_isnoneornil(ls, arg)) return count;
+    lua_Integer len = luaL_checkinteger(ls, arg);
+    luaL_argcheck(ls, len >= 0, arg, "out of range");
+    return (lua_Unsigned)len < count ? (size_t)len : count;
+}
+
+static int push_peek(lua_State* ls, MLuaRing* ring, size_t off, size_t len) {
+    if (len == 0) return lua_pushliteral(ls, ""), 1;
+    luaL_Buffer buf;
+    void* dest = luaL_buffinitsize(ls, &buf, len);
+    mlua_ring_peek(ring, off, dest, len);
+    return luaL_pushresultsize(&buf, len), 1;
+}
+
+static int Ring_read(lua_State* ls) {
+    MLuaRing* ring = &check_Ring(ls, 1)->ring;
+    size_t len = check_len(ls, ring, 2, 0);
+    push_peek(ls, ring, 0, len);
+    if (len > 0) mlua_ring_consume(ring, len);
+    return 1;
+}
+
+static int Ring_peek(lua_State* ls) {
+    MLuaRing* ring = &check_Ring(ls, 1)->ring;
+    lua_Integer off = luaL_optinteger(ls, 2, 0);
+    luaL_argcheck(ls, off >= 0, 2, "out of range");
+    size_t len = check_len(ls, ring, 3, off);
+    return push_peek(ls, ring, off, len);
+}
+
+static int Ring_read_into(lua_State* ls) {
+    MLuaRing* ring = &check_Ring(ls, 1)->ring;
+    MLuaBuffer dest;
+    if (!mlua_get_buffer(ls, 2, &dest)) return luaL_typeerror(ls, 2, "buffer");
+    lua_Unsigned off = luaL_optinteger(ls, 3, 0);
+    luaL_argcheck(ls, off <= dest.size, 3, "out of bounds");
+    lua_Unsigned len = dest.size - off;
+    if (!lua_isnoneornil(ls, 4)) {
+        len = luaL_checkinteger(ls, 4);
+        luaL_argcheck(ls, off + len <= dest.size, 4, "out of bounds");
+    }
+    size_t done = 0;
+    while (done < len) {
+        size_t size;
+        void* ptr = mlua_ring_read_span(ring, done, &size);
+        if (ptr == NULL) break;
+        if (size > len - done) size = len - done;
+        mlua_buffer_write(&dest, off + done, size, ptr);
+        done += size;
+    }
+    if (done > 0) mlua_ring_consume(ring, done);
+    return mlua_push_size(ls, done), 1;
+}
+
+static int Ring_discard(lua_State* ls) {
+    MLuaRing* ring = &check_Ring(ls, 1)->ring;
+    size_t len = check_len(ls, ring, 2, 0);
+    return mlua_push_size(ls, mlua_ring_discard(ring, len)), 1;
+}
+
+static int data_loop(lua_State* ls, bool timeout) {
+    MLuaRing* ring = &to_Ring(ls, 1)->ring;
+    if (mlua_ring_count(ring) >= ring->data_threshold) {
+        return lua_pushboolean(ls, true), 1;
+    }
+    if (timeout) return lua_pushboolean(ls, false), 1;
+    return -1;
+}
+
+static int space_loop(lua_State* ls, bool timeout) {
+    MLuaRing* ring = &to_Ring(ls, 1)->ring;
+    if (mlua_ring_space(ring) >= ring->space_threshold) {
+        return lua_pushboolean(ls, true), 1;
+    }
+    if (timeout) return lua_pushboolean(ls, false), 1;
+    return -1;
+}
+
+static bool timed_out(lua_State* ls) {
+    return !lua_isnil(ls, 2) && mlua_time_reached(ls, 2);
+}
+
+static int wait_1(lua_State* ls, int status, lua_KContext ctx) {
+    // Busy loop, as the events aren't available.
+    MLuaEventLoopFn loop = (MLuaEventLoopFn)ctx;
+    int res = loop(ls, timed_out(ls));
+    if (res >= 0) return res;
+    return mlua_thread_yield(ls, 0, &wait_1, ctx);
+}
+
+static int wait(lua_State* ls, MLuaEvent* ev, MLuaEventLoopFn loop) {
+    if (lua_isnoneornil(ls, 2)) {
+        lua_settop(ls, 1);
+        lua_pushnil(ls);
+    } else {
+        uint64_t timeout = mlua_check_int64(ls, 2);
+        lua_settop(ls, 1);
+        mlua_push_deadline(ls, timeout);
+    }
+    if (mlua_event_can_wait(ls, ev, 0)) {
+        return mlua_event_wait(ls, ev, 0, loop, 2);
+    }
+    if (!mlua_thread_blocking(ls)) {
+        return wait_1(ls, LUA_OK, (lua_KContext)loop);
+    }
+    for (;;) {
+        int res = loop(ls, timed_out(ls));
+        if (res >= 0) return res;
+    }
+}
+
+static int Ring_wait_data(lua_State* ls) {
+    Ring* r = check_Ring(ls, 1);
+    return wait(ls, &r->data_event, &data_loop);
+}
+
+static int Ring_wait_space(lua_State* ls) {
+    Ring* r = check_Ring(ls, 1);
+    return wait(ls, &r->space_event, &space_loop);
+}
+
+static int Ring_close(lua_State* ls) {
+    Ring* r = check_Ring(ls, 1);
+    if (r->ring.notify == NULL) return 0;
+    r->ring.notify = NULL;
+#if LIB_MLUA_MOD_MLUA_THREAD
+    mlua_event_disable(ls, &r->data_event);
+    mlua_event_disable(ls, &r->space_event);
+#endif
+    return 0;
+}
+
+MLUA_SYMBOLS(Ring_syms) = {
+    MLUA_SYM_F(size, Ring_),
+    MLUA_SYM_F(space, Ring_),
+    MLUA_SYM_F(set_thresholds, Ring_),
+    MLUA_SYM_F(write, Ring_),
+    MLUA_SYM_F(read, Ring_),
+    MLUA_SYM_F(read_into, Ring_),
+    MLUA_SYM_F(peek, Ring_),
+    MLUA_SYM_F(discard, Ring_),
+    MLUA_SYM_F(wait_data, Ring_),
+    MLUA_SYM_F(wait_space, Ring_),
+    MLUA_SYM_F(close, Ring_),
+};
+
+#define Ring___close Ring_close
+#define Ring___gc Ring_close
+
+MLUA_SYMBOLS_NOHASH(Ring_syms_nh) = {
+    MLUA_SYM_F_NH(__len, Ring_),
+    MLUA_SYM_F_NH(__buffer, Ring_),
+    MLUA_SYM_F_NH(__close, Ring_),
+    MLUA_SYM_F_NH(__gc, Ring_),
+};
+
+static int mod_new(lua_State* ls) {
+    lua_Integer size = luaL_checkinteger(ls, 1);
+    luaL_argcheck(ls, 0 < size && (lua_Unsigned)size <= SIZE_MAX / 2, 1,
+                  "out of range");
+    Ring* r = lua_newuserdatauv(ls, sizeof(Ring) + size, 0);
+    mlua_ring_init(&r->ring, r->data, size);
+    luaL_getmetatable(ls, Ring_name);
+    lua_setmetatable(ls, -2);
+#if LIB_MLUA_MOD_MLUA_THREAD
+    mlua_event_init(&r->data_event);
+    mlua_event_init(&r->space_event);
+    mlua_event_enable(ls, &r->data_event);
+    mlua_event_enable(ls, &r->space_event);
+    r->ring.notify = &notify;
+#endif
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(new, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.ring) {
+    mlua_thread_require(ls);
+    if (sizeof(size_t) > sizeof(lua_Integer)) {
+        mlua_require(ls, "mlua.int64", false);
+    }
+
+    // Create the module.
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Ring class.
+    mlua_new_class(ls, Ring_name, Ring_syms, Ring_syms_nh);
+    lua_pop(ls, 1);
+    return 1;
+}
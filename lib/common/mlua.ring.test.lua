@@ -0,0 +1,152 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+local mem = require 'mlua.mem'
+local ring = require 'mlua.ring'
+local thread = require 'mlua.thread'
+local string = require 'string'
+
+function test_write_read(t)
+    local r = ring.new(8)
+    t:expect(t.expr(r):size()):eq(8)
+    t:expect(#r):label("#r"):eq(0)
+    t:expect(t.expr(r):space()):eq(8)
+    t:expect(t.expr(r):read()):eq('')
+    t:expect(t.expr(r):write('abcde')):eq(5)
+    t:expect(#r):label("#r"):eq(5)
+    t:expect(t.expr(r):space()):eq(3)
+    t:expect(t.expr(r):write('fghij')):eq(3)
+    t:expect(t.expr(r):write('k')):eq(0)
+    t:expect(t.expr(r):read(3)):eq('abc')
+    t:expect(t.expr(r):write('klmnop', 2, 3)):eq(3)
+    t:expect(t.expr(r):read()):eq('defghmno')
+    t:expect(#r):label("#r"):eq(0)
+    t:expect(t.expr(r):write('abc', 4)):raises("out of bounds")
+    t:expect(t.expr(r):write('abc', 1, 3)):raises("out of bounds")
+    t:expect(t.expr(r):read(-1)):raises("out of range")
+end
+
+function test_wrap_around(t)
+    local r = ring.new(5)
+    local want = ''
+    for i = 1, 40 do
+        local data = string.rep(string.char(0x40 + i % 26), i % 4 + 1)
+        local n = r:write(data)
+        want = want .. data:sub(1, n)
+        local got = r:read(i % 3 + 1)
+        t:expect(got):label("read"):eq(want:sub(1, #got))
+        want = want:sub(#got + 1)
+        t:expect(#r):label("#r"):eq(#want)
+    end
+end
+
+function test_peek_discard(t)
+    local r = ring.new(6)
+    r:write('abcd')
+    r:discard(3)
+    r:write('efghi')
+    t:expect(t.expr(r):peek()):eq('defghi')
+    t:expect(t.expr(r):peek(2)):eq('fghi')
+    t:expect(t.expr(r):peek(1, 3)):eq('efg')
+    t:expect(t.expr(r):peek(7)):eq('')
+    t:expect(t.expr(r):discard(2)):eq(2)
+    t:expect(t.expr(r):peek()):eq('fghi')
+    t:expect(t.expr(r):discard()):eq(4)
+    t:expect(t.expr(r):discard(3)):eq(0)
+end
+
+function test_read_into(t)
+    local r = ring.new(6)
+    r:write('abcd')
+    r:discard(3)
+    r:write('efghi')
+    local buf = mem.alloc(8)
+    mem.fill(buf, ('.'):byte())
+    t:expect(t.expr(r):read_into(buf, 1, 4)):eq(4)
+    t:expect(t.expr(mem).read(buf)):eq('.defg...')
+    t:expect(t.expr(r):read_into(buf, 6)):eq(2)
+    t:expect(t.expr(mem).read(buf)):eq('.defg.hi')
+    t:expect(t.expr(r):read_into(buf)):eq(0)
+    t:expect(t.expr(r):read_into(buf, 9)):raises("out of bounds")
+    t:expect(t.expr(r):read_into('abc')):raises("buffer expected")
+end
+
+function test_buffer(t)
+    local r = ring.new(6)
+    r:write('abcd')
+    r:discard(3)
+    r:write('efghi')
+    t:expect(t.expr(mem).read(r)):eq('defghi')
+    t:expect(t.expr(mem).read(r, 2, 3)):eq('fgh')
+    t:expect(t.expr(mem).find(r, 'hi')):eq(4)
+    t:expect(t.expr(mem).get(r, 2)):eq(('f'):byte())
+    t:expect(t.expr(mem).compare(r, 0, 'defghi')):eq(0)
+    local dest = ring.new(8)
+    t:expect(t.expr(dest):write(r, 1)):eq(5)
+    t:expect(t.expr(dest):read()):eq('efghi')
+    t:expect(#r):label("#r"):eq(6)
+end
+
+function test_thresholds(t)
+    local r = ring.new(8)
+    t:expect(t.expr(r):set_thresholds(0)):raises("out of range")
+    t:expect(t.expr(r):set_thresholds(1, 9)):raises("out of range")
+    r:set_thresholds(3, 6)
+    t:expect(t.expr(r):wait_data(0)):eq(false)
+    r:write('ab')
+    t:expect(t.expr(r):wait_data(0)):eq(false)
+    r:write('c')
+    t:expect(t.expr(r):wait_data(0)):eq(true)
+    t:expect(t.expr(r):wait_space(0)):eq(false)
+    r:discard(1)
+    t:expect(t.expr(r):wait_space(0)):eq(true)
+end
+
+function test_wait(t)
+    local r<close> = ring.new(4)
+    r:set_thresholds(2, 3)
+    local got = ''
+    local consumer<close> = thread.start(function()
+        while #got < 26 do
+            r:wait_data()
+            got = got .. r:read()
+        end
+    end)
+    local data = 'abcdefghijklmnopqrstuvwxyz'
+    local off = 0
+    while off < #data do
+        r:wait_space()
+        off = off + r:write(data, off)
+    end
+    consumer:join()
+    t:expect(got):label("got"):eq(data)
+end
+
+function test_stress(t)
+    local stress = try(require, 'mlua.testing.ring')
+    if not stress then t:skip("no concurrent producer / consumer") end
+    for _, size in ipairs{1, 3, 64, 4096} do
+        t:expect(t.expr(stress).stress(size, 1 << 20)):gt(0)
+    end
+end
+
+function bench_ring(t)
+    local size = 256
+    local data = string.rep('x', size)
+    local r = ring.new(4096)
+    local buf = mem.alloc(size)
+    t:benchmark("write+read", function(n)
+        for i = 1, n do
+            r:write(data)
+            r:read()
+        end
+    end, nil, size)
+    t:benchmark("write+read_into", function(n)
+        for i = 1, n do
+            r:write(data)
+            r:read_into(buf)
+        end
+    end, nil, size)
+end
@@ -48,6 +48,49 @@ function test_alloc_stats(t)
     t:expect(peak2):label("peak2"):gte(peak1)
 end
 
+function test_alloc_stats_detail(t)
+    local types, sizes = alloc_stats_detail()
+    if not types then t:skip("detailed allocation statistics disabled") end
+    t:expect(t.expr(types).table.count):gt(0)
+    t:expect(t.expr(types).string.count):gt(0)
+    local tcount, tsize, scount, ssize = 0, 0, 0, 0
+    for _, c in pairs(types) do
+        tcount, tsize = tcount + c.count, tsize + c.size
+    end
+    for _, c in pairs(sizes) do
+        scount, ssize = scount + c.count, ssize + c.size
+    end
+    t:expect(scount):label("size bucket count"):eq(tcount)
+    t:expect(ssize):label("size bucket size"):eq(tsize)
+
+    local types, sizes = t:alloc_delta(function()
+        local a, b = {}, {}
+        local s = ('x'):rep(100)
+    end)
+    t:expect(t.expr(types).table.count):eq(2)
+    t:expect(t.expr(types).string.count):gte(1)
+    t:expect(t.expr(types).string.size):gte(100)
+    t:expect(t.expr(types).thread):eq(nil)
+    t:expect(t.expr(sizes)[128].count):gte(1)
+end
+
+function test_require_stats(t)
+    local stats = require_stats()
+    if not stats then t:skip("module loading statistics disabled") end
+    local st = stats[module_name]
+    t:expect(st):label("stats[%q]", module_name):neq(nil)
+    t:expect(st.order):label("order"):gt(0)
+    t:expect(st.time):label("time"):gte(st.self_time)
+    t:expect(st.count):label("count"):gte(st.self_count)
+    for name, st in pairs(stats) do
+        local parent = stats[st.parent]
+        if parent then
+            t:expect(st.order):label("%s order", name):lt(parent.order)
+            t:expect(st.time):label("%s time", name):lte(parent.time)
+        end
+    end
+end
+
 function test_with_traceback(t)
     for _, test in ipairs{
         {function(a, b, c) return c, b, a end, {1, 2, 3}, {3, 2, 1}, nil},
@@ -169,3 +212,39 @@ function test_Function_close(t)
     end)
     t:expect(called, "To-be-closed function wasn't called on error")
 end
+
+-- Return the names of all compiled-in modules.
+local function module_names()
+    local names = {}
+    for name in pairs(package.preload) do names[#names + 1] = name end
+    return names
+end
+
+function test_preload(t)
+    local names = module_names()
+    t:expect(#names):label("#names"):gt(0)
+    local missing = 0
+    for _, name in ipairs(names) do
+        if type(package.preload[name]) ~= 'function' then
+            missing = missing + 1
+        end
+    end
+    t:expect(missing):label("missing"):eq(0)
+    t:expect(t.expr(package.preload)['mlua.test']):neq(nil)
+    t:expect(t.expr(package.preload)['mlua.unknown']):eq(nil)
+    t:expect(t.expr(package.preload)['']):eq(nil)
+end
+
+function bench_preload_lookup(t)
+    local names = module_names()
+    local preload = package.preload
+    t:printf("%d modules\n", #names)
+    t:benchmark("all modules", function(n)
+        for i = 1, n do
+            for _, name in ipairs(names) do local _ = preload[name] end
+        end
+    end)
+    t:benchmark("missing module", function(n)
+        for i = 1, n do local _ = preload['mlua.unknown'] end
+    end)
+end
@@ -18,6 +18,7 @@ local string = require 'string'
 
 local def_mod_pat = '^(.*)%.test$'
 local def_func_pat = '^test_'
+local def_bench_pat = '^bench_'
 local blocking_pat = '_BNB$'
 local err_terminate = {}
 
@@ -418,8 +419,93 @@ end
 
 function Test:run(name, fn) return Test(name, self):_run(fn) end
 
+local function bench_run(fn, n)
+    collectgarbage()
+    local count = alloc_stats()
+    local start = time.ticks()
+    fn(n)
+    local dt = time.ticks() - start
+    if count then count = alloc_stats() - count end
+    return dt, count
+end
+
+function Test:benchmark(name, fn, n, bytes)
+    return self:run(name, function(t)
+        local dt, allocs
+        if n then
+            dt, allocs = bench_run(fn, n)
+        else
+            local min = t._root._opts.bench_time * time.sec
+            n = 1
+            while true do
+                dt, allocs = bench_run(fn, n)
+                if dt >= min or n >= math.maxinteger // 100 then break end
+                local next = dt > 0 and math.floor(n * min * 1.2 / dt)
+                             or n * 100
+                n = math.max(n + 1, math.min(next, n * 100))
+            end
+        end
+        t._bench = ('%d x %.3f us'):format(n, dt / n)
+        if allocs then
+            t._bench = ('%s, %.1f allocs'):format(t._bench, allocs / n)
+        end
+        if bytes and dt > 0 then
+            t._bench = ('%s, %.2f MB/s'):format(t._bench, bytes * n / dt)
+        end
+    end)
+end
+
+-- Compute s2 - s1 - (s1 - s0) for detailed allocation statistics, i.e. the
+-- change between s1 and s2, minus the cost of taking a snapshot.
+local function detail_delta(s0, s1, s2)
+    local delta = {}
+    for _, s in ipairs{s0, s1, s2} do
+        for k in pairs(s) do delta[k] = false end
+    end
+    for k in pairs(delta) do
+        local c0, c1, c2 = s0[k], s1[k], s2[k]
+        local count = (c2 and c2.count or 0) - 2 * (c1 and c1.count or 0)
+                      + (c0 and c0.count or 0)
+        local size = (c2 and c2.size or 0) - 2 * (c1 and c1.size or 0)
+                     + (c0 and c0.size or 0)
+        delta[k] = (count ~= 0 or size ~= 0) and {count = count, size = size}
+                   or nil
+    end
+    return delta
+end
+
+local function print_detail(out, label, delta)
+    local keys = util.keys(delta):sort()
+    if keys:len() == 0 then return end
+    local parts = list()
+    for _, k in keys:ipairs() do
+        local d = delta[k]
+        parts:append(('%s: %+d (%+d B)'):format(k, d.count, d.size))
+    end
+    io.fprintf(out, "%s: %s\n", label, parts:concat(', '))
+end
+
+function Test:alloc_delta(fn, ...)
+    collectgarbage()
+    collectgarbage('stop')
+    local types0, sizes0 = alloc_stats_detail()
+    local types1, sizes1 = alloc_stats_detail()
+    local ok, err = pcall(fn, ...)
+    local types2, sizes2 = alloc_stats_detail()
+    collectgarbage('restart')
+    if not ok then error(err, 0) end
+    if not types0 then return end
+    return detail_delta(types0, types1, types2),
+           detail_delta(sizes0, sizes1, sizes2)
+end
+
 function Test:_pre_run()
     collectgarbage()
+    if self._root._opts.alloc_detail then
+        local types0, sizes0 = alloc_stats_detail()
+        local types1, sizes1 = alloc_stats_detail()
+        if types0 then self._alloc_detail = {types0, sizes0, types1, sizes1} end
+    end
     local count, size, used = alloc_stats(true)
     if not count then return end
     self._alloc_count, self._alloc_size = count, size
@@ -437,6 +523,13 @@ function Test:_post_run()
         self._th_resumes = resumes - self._th_resumes
     end
     collectgarbage()
+    local detail = self._alloc_detail
+    if detail then
+        local types2, sizes2 = alloc_stats_detail()
+        self._alloc_types = detail_delta(detail[1], detail[3], types2)
+        self._alloc_sizes = detail_delta(detail[2], detail[4], sizes2)
+        self._alloc_detail = nil
+    end
     local count, size, used, peak = alloc_stats()
     if not count then return end
     self._alloc_count = count - self._alloc_count
@@ -454,6 +547,10 @@ function Test:_print_stats(out)
             self._alloc_count, self._alloc_size, self._alloc_peak,
             self._alloc_peak - self._alloc_base, self._alloc_used)
     end
+    if self._alloc_types then
+        print_detail(out, "Live types", self._alloc_types)
+        print_detail(out, "Live sizes", self._alloc_sizes)
+    end
     if self._th_disps and self._th_disps ~= 0 then
         io.fprintf(out, "Thread: %s dispatches, %s waits, %s resumes\n",
                    self._th_disps, self._th_waits, self._th_resumes)
@@ -483,11 +580,11 @@ function Test:_run(fn)
 
     -- Output results and stats.
     local level, opts = self._level, root._opts
-    if level >= 0 and level < opts.results then
+    if level >= 0 and (level < opts.results or self._bench) then
         local out = root._stdout
         local indent = (' '):rep(2 * level)
         local left = ('%s%s: %s'):format(indent, self:_result(), self.name)
-        local right = ('%.3f s'):format(duration / time.sec)
+        local right = self._bench or ('%.3f s'):format(duration / time.sec)
         io.fprintf(out, "%s%s %s\n", io.ansi(left),
                    (' '):rep(78 - #io.ansi(left, io.empty_tags) - #right),
                    right)
@@ -592,8 +689,9 @@ function Test:run_module(name, pat)
     local ok, fn = pcall(function() return module.set_up end)
     if ok and fn then fn(self) end
     local fns = list()
+    local bench = root._opts.bench
     for name, fn in pairs(module) do
-        if name:find(pat) then
+        if name:find(pat) or (bench and name:find(def_bench_pat)) then
             local info = debug.getinfo(fn, 'S')
             fns:append({info and info.linedefined or 0, name, fn})
         end
@@ -700,6 +798,14 @@ end
 -- TODO: Terminate on first failure
 -- TODO: Launch repl on failure
 
+function Runner:cmd_ad()
+    self.opts.alloc_detail = not self.opts.alloc_detail
+end
+
+function Runner:cmd_b()
+    self.opts.bench = not self.opts.bench
+end
+
 function Runner:cmd_out()
     self.opts.output = not self.opts.output
 end
@@ -742,6 +848,9 @@ local function pmain(opts, args)
     local argv = util.get(_G, 'arg')
     local opts, args = cli.parse_args(argv)
     cli.parse_opts(opts, {
+        alloc_detail = cli.bool_opt(false),
+        bench = cli.bool_opt(false),
+        bench_time = cli.num_opt(1),
         output = cli.bool_opt(false),
         prompt = cli.bool_opt(true),
         results = cli.int_opt(0),
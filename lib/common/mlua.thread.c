@@ -623,8 +623,17 @@ static int mod_main(lua_State* ls) {
         ++mlua_global(ls)->thread_resumes;
 #endif
         lua_pop(running, FP_COUNT);
+#if MLUA_ALLOC_PROFILE
+        MLuaGlobal* g = mlua_global(ls);
+        lua_State* prev = g->alloc_running;
+        g->alloc_running = running;
+#endif
         int nres;
-        if (lua_resume(running, ls, 0, &nres) != LUA_YIELD) {
+        int status = lua_resume(running, ls, 0, &nres);
+#if MLUA_ALLOC_PROFILE
+        g->alloc_running = prev;
+#endif
+        if (status != LUA_YIELD) {
             // Close the Lua thread and store the termination below NEXT.
             if (lua_closethread(running, ls) == LUA_OK) lua_pushnil(running);
             thread_extra(running)->state = STATE_DEAD;
@@ -19,9 +19,23 @@ typedef struct MLuaEvent {
     uintptr_t dummy;
 } MLuaEvent;
 
+// Initialize an event.
+static inline void mlua_event_init(MLuaEvent* ev) {}
+
+// Enable an event. Events are never triggered on the host, so this is a no-op.
+static inline bool mlua_event_enable(lua_State* ls, MLuaEvent* ev) {
+    return true;
+}
+
+// Disable an event.
+static inline void mlua_event_disable(lua_State* ls, MLuaEvent* ev) {}
+
 // Return true iff the event is enabled.
 static inline bool mlua_event_enabled(MLuaEvent const* ev) { return false; }
 
+// Set an event pending.
+static inline void mlua_event_set(MLuaEvent* ev) {}
+
 // Dispatch pending events.
 void mlua_event_dispatch(lua_State* ls, uint64_t deadline);
 
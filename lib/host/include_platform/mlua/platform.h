@@ -17,6 +17,8 @@ extern "C" {
 #endif
 
 #define MLUA_HASH_SYMBOL_TABLES_DEFAULT 0
+#define MLUA_ALLOC_POOL_SIZE_DEFAULT (64 << 20)
+#define MLUA_CRC_SLICE_BY_8_DEFAULT 1
 
 #define MLUA_PLATFORM_REGISTER_MODULE(n)
 
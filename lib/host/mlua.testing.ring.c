@@ -0,0 +1,184 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mlua/module.h"
+#include "mlua/ring.h"
+#include "mlua/util.h"
+
+typedef struct Stress {
+    MLuaRing ring;
+    size_t len;
+    size_t error;
+    unsigned long data_notifications;
+    unsigned long space_notifications;
+} Stress;
+
+// Return the value of the byte at the given offset in the stream.
+static inline uint8_t stream_byte(size_t off) {
+    return (uint8_t)(off ^ (off >> 8) ^ (off >> 16));
+}
+
+// Return a pseudo-random chunk size in [1, max].
+static inline size_t chunk(uint32_t* seed, size_t max) {
+    *seed = *seed * 1103515245u + 12345u;
+    return 1 + (*seed >> 8) % max;
+}
+
+static inline bool failed(Stress* s) {
+    return __atomic_load_n(&s->error, __ATOMIC_RELAXED) != SIZE_MAX;
+}
+
+static inline void fail(Stress* s, size_t off) {
+    __atomic_store_n(&s->error, off, __ATOMIC_RELAXED);
+}
+
+static void notify(MLuaRing* ring, bool space) {
+    Stress* s = (Stress*)ring;
+    if (space) {
+        __atomic_add_fetch(&s->space_notifications, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&s->data_notifications, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void* producer(void* arg) {
+    Stress* s = arg;
+    MLuaRing* ring = &s->ring;
+    uint32_t seed = 1;
+    uint8_t tmp[64];
+    size_t off = 0;
+    while (off < s->len && !failed(s)) {
+        size_t len = chunk(&seed, sizeof(tmp));
+        if (len > s->len - off) len = s->len - off;
+        if (seed & 0x10000) {
+            // Write through the spans.
+            size_t done = 0;
+            while (done < len) {
+                size_t size;
+                uint8_t* ptr = mlua_ring_write_span(ring, done, &size);
+                if (ptr == NULL) break;
+                if (size > len - done) size = len - done;
+                for (size_t i = 0; i < size; ++i) {
+                    ptr[i] = stream_byte(off + done + i);
+                }
+                done += size;
+            }
+            if (done > 0) mlua_ring_commit(ring, done);
+            off += done;
+        } else {
+            // Write from a temporary buffer.
+            for (size_t i = 0; i < len; ++i) tmp[i] = stream_byte(off + i);
+            off += mlua_ring_write(ring, tmp, len);
+        }
+        if (mlua_ring_space(ring) == 0) sched_yield();
+    }
+    return NULL;
+}
+
+static void* consumer(void* arg) {
+    Stress* s = arg;
+    MLuaRing* ring = &s->ring;
+    uint32_t seed = 2;
+    uint8_t tmp[64];
+    size_t off = 0;
+    while (off < s->len) {
+        size_t len = chunk(&seed, sizeof(tmp));
+        size_t done;
+        int mode = (seed >> 16) % 3;
+        switch (mode) {
+        case 0: {  // Read through the spans
+            done = 0;
+            while (done < len) {
+                size_t size;
+                uint8_t const* ptr = mlua_ring_read_span(ring, done, &size);
+                if (ptr == NULL) break;
+                if (size > len - done) size = len - done;
+                for (size_t i = 0; i < size; ++i) {
+                    if (ptr[i] != stream_byte(off + done + i)) {
+                        fail(s, off + done + i);
+                        return NULL;
+                    }
+                }
+                done += size;
+            }
+            if (done > 0) mlua_ring_consume(ring, done);
+            break;
+        }
+        case 1:  // Read into a temporary buffer
+            done = mlua_ring_read(ring, tmp, len);
+            break;
+        default:  // Peek, then discard
+            done = mlua_ring_peek(ring, 0, tmp, len);
+            if (mlua_ring_discard(ring, done) != done) {
+                fail(s, off);
+                return NULL;
+            }
+            break;
+        }
+        if (mode != 0) {
+            for (size_t i = 0; i < done; ++i) {
+                if (tmp[i] != stream_byte(off + i)) {
+                    fail(s, off + i);
+                    return NULL;
+                }
+            }
+        }
+        off += done;
+        if (mlua_ring_count(ring) == 0) sched_yield();
+    }
+    return NULL;
+}
+
+static int mod_stress(lua_State* ls) {
+    lua_Integer size = luaL_checkinteger(ls, 1);
+    luaL_argcheck(ls, size > 0, 1, "out of range");
+    lua_Integer len = luaL_checkinteger(ls, 2);
+    luaL_argcheck(ls, len >= 0, 2, "out of range");
+    Stress* s = lua_newuserdatauv(ls, sizeof(Stress) + size, 0);
+    mlua_ring_init(&s->ring, s + 1, size);
+    s->ring.data_threshold = (size + 1) / 2;
+    s->ring.space_threshold = (size + 1) / 2;
+    s->ring.notify = &notify;
+    s->len = len;
+    s->error = SIZE_MAX;
+    s->data_notifications = s->space_notifications = 0;
+
+    pthread_t prod, cons;
+    if (pthread_create(&cons, NULL, &consumer, s) != 0) {
+        return luaL_error(ls, "failed to start consumer");
+    }
+    if (pthread_create(&prod, NULL, &producer, s) != 0) {
+        pthread_cancel(cons);
+        pthread_join(cons, NULL);
+        return luaL_error(ls, "failed to start producer");
+    }
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    if (s->error != SIZE_MAX) {
+        return luaL_error(ls, "stream mismatch at offset %I",
+                          (lua_Integer)s->error);
+    }
+    if (mlua_ring_count(&s->ring) != 0) {
+        return luaL_error(ls, "ring not empty: %I",
+                          (lua_Integer)mlua_ring_count(&s->ring));
+    }
+    lua_pushinteger(ls, s->data_notifications);
+    lua_pushinteger(ls, s->space_notifications);
+    return 2;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(stress, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.testing.ring) {
+    mlua_new_module(ls, 0, module_syms);
+    return 1;
+}
@@ -0,0 +1,29 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+-- This module is optimized, and the integer constants of the header modules
+-- below are folded (see mlua_fold_constants() in CMakeLists.txt).
+
+local debug = require 'debug'
+local package = require 'package'
+local sio = require 'hardware.regs.sio'
+local table = require 'table'
+local uart = require 'hardware.regs.uart'
+
+local function uartfr_txff() return uart.UARTFR_TXFF_BITS end
+
+function test_fold(t)
+    t:expect(debug.getupvalue(uartfr_txff, 1)):label("upvalue"):eq(nil)
+    for _, test in ipairs{
+        {'hardware.regs.sio', 'CPUID_OFFSET', sio.CPUID_OFFSET},
+        {'hardware.regs.sio', 'GPIO_IN_OFFSET', sio.GPIO_IN_OFFSET},
+        {'hardware.regs.uart', 'UARTFR_OFFSET', uart.UARTFR_OFFSET},
+        {'hardware.regs.uart', 'UARTFR_TXFF_BITS', uartfr_txff()},
+    } do
+        local mod, name, got = table.unpack(test)
+        t:expect(got):label("%s.%s", mod, name)
+            :eq(package.loaded[mod][name])
+    end
+end
@@ -4,6 +4,7 @@
 _ENV = module(...)
 
 local addressmap = require 'hardware.regs.addressmap'
+local config = require 'mlua.config'
 local intctrl = require 'hardware.regs.intctrl'
 local vreg_and_chip_reset = require 'hardware.regs.vreg_and_chip_reset'
 local package = require 'package'
@@ -25,3 +26,24 @@ function test_symbols(t)
     t:expect(t.expr(vreg_and_chip_reset).CHIP_RESET_PSM_RESTART_FLAG_BITS)
         :eq(0x01000000)
 end
+
+function test_symbol_cache(t)
+    -- Resolved symbols may be cached, but lookups with non-string keys must not
+    -- store anything into the module table.
+    local _ = intctrl.UART0_IRQ
+    pcall(function() local _ = intctrl[20] end)
+    t:expect(t.expr(_G).rawget(intctrl, 20)):eq(nil)
+    t:expect(t.expr(intctrl).UART0_IRQ):eq(20)
+end
+
+function bench_attribute_access(t)
+    t:printf("Hashed symbol tables: %s, symbol cache: %s bytes\n",
+             config.HASH_SYMBOL_TABLES, config.SYMBOL_CACHE_SIZE)
+    t:benchmark("module attribute", function(n)
+        for i = 1, n do local _ = addressmap.UART0_BASE end
+    end)
+    local uart0_base = addressmap.UART0_BASE
+    t:benchmark("local", function(n)
+        for i = 1, n do local _ = uart0_base end
+    end)
+end
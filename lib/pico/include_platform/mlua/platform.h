@@ -23,6 +23,8 @@ extern "C" {
 #endif
 
 #define MLUA_HASH_SYMBOL_TABLES_DEFAULT 1
+#define MLUA_ALLOC_POOL_SIZE_DEFAULT (64 << 10)
+#define MLUA_CRC_SLICE_BY_8_DEFAULT 0
 
 #define MLUA_BI_TAG BINARY_INFO_MAKE_TAG('M', 'L')
 #define MLUA_BI_FROZEN_MODULE 0xcb9305cf
@@ -83,8 +83,29 @@ static lua_Unsigned PBUF_find(void* ptr, lua_Unsigned off, lua_Unsigned len,
     return pos;
 }
 
+static void* PBUF_span(void* ptr, lua_Unsigned off, lua_Unsigned* len,
+                       void** state) {
+    mlua_lwip_lock();
+    struct pbuf* pb;
+    u16_t poff = 0;
+    if (*state != NULL) {
+        pb = ((struct pbuf*)*state)->next;
+    } else {
+        pb = pbuf_skip((struct pbuf*)ptr, off, &poff);
+    }
+    *state = pb;
+    void* span = NULL;
+    if (pb != NULL) {
+        *len = pb->len - poff;
+        span = pb->payload + poff;
+    }
+    mlua_lwip_unlock();
+    return span;
+}
+
 MLuaBufferVt const PBUF_vt = {.read = &PBUF_read, .write = &PBUF_write,
-                              .fill = &PBUF_fill, .find = &PBUF_find};
+                              .fill = &PBUF_fill, .find = &PBUF_find,
+                              .span = &PBUF_span};
 
 static int PBUF___buffer(lua_State* ls) {
     struct pbuf* pb = mlua_check_PBUF(ls, 1);
@@ -5,6 +5,8 @@ _ENV = module(...)
 
 local pbuf = require 'lwip.pbuf'
 local mem = require 'mlua.mem'
+local string = require 'string'
+local table = require 'table'
 
 function test_PBUF(t)
     local p<close> = pbuf.alloc(pbuf.TRANSPORT, 10)
@@ -14,3 +16,50 @@ function test_PBUF(t)
     mem.write(p, 'abc', 5)
     t:expect(t.expr(mem).read(p)):eq('_____abc__')
 end
+
+function test_PBUF_chained(t)
+    local size = 4000
+    local p<close> = pbuf.alloc(pbuf.RAW, size, pbuf.POOL)
+    t:expect(#p):label("#p"):eq(size)
+    local data = {}
+    for i = 0, size - 1 do data[#data + 1] = string.char(i % 251) end
+    data = table.concat(data)
+    mem.write(p, data)
+    t:expect(t.expr(mem).read(p)):eq(data)
+    t:expect(t.expr(mem).compare(p, 0, data)):eq(0)
+    t:expect(t.expr(mem).compare(p, 1, data, 0, size - 1)):eq(1)
+    t:expect(t.expr(mem).find(p, data:sub(2001, 2600))):eq(2000 % 251)
+    t:expect(t.mexpr(mem).get(p, 1998, 4)):eq{data:byte(1999, 2002)}
+    mem.set(p, 1998, 1, 2, 3, 4)
+    t:expect(t.expr(mem).read(p, 1996, 8))
+        :eq(data:sub(1997, 1998) .. '\1\2\3\4' .. data:sub(2003, 2004))
+    local buf = mem.alloc(size)
+    mem.copy(buf, 0, p)
+    t:expect(t.expr(mem).compare(buf, 0, p)):eq(0)
+    mem.fill(p, ('_'):byte(), 100)
+    t:expect(t.expr(mem).read(p, 98, 4)):eq(data:sub(99, 100) .. '__')
+    t:expect(t.expr(mem).find(p, ('_'):rep(size - 100))):eq(100)
+end
+
+function bench_PBUF_chained(t)
+    local size = 4000
+    local p<close> = pbuf.alloc(pbuf.RAW, size, pbuf.POOL)
+    local buf = mem.alloc(size)
+    mem.fill(p, 1)
+    mem.fill(buf, 1)
+    t:benchmark("read+write", function(n)
+        for i = 1, n do mem.write(buf, mem.read(p)) end
+    end)
+    t:benchmark("copy", function(n)
+        for i = 1, n do mem.copy(buf, 0, p) end
+    end)
+    t:benchmark("read+compare", function(n)
+        for i = 1, n do local eq = mem.read(p) == mem.read(buf) end
+    end)
+    t:benchmark("compare", function(n)
+        for i = 1, n do mem.compare(p, 0, buf) end
+    end)
+    t:benchmark("get", function(n)
+        for i = 1, n do mem.get(p, 1900, 200) end
+    end)
+end
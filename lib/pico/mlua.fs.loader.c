@@ -10,7 +10,6 @@
 
 #include "lua.h"
 #include "lauxlib.h"
-#include "mlua/errors.h"
 #include "mlua/block.flash.h"
 #include "mlua/fs.h"
 #include "mlua/fs.lfs.h"
@@ -29,6 +28,12 @@
 #ifndef MLUA_FS_LOADER_FLAT
 #define MLUA_FS_LOADER_FLAT 1
 #endif
+#ifndef MLUA_FS_LOADER_CACHE
+#define MLUA_FS_LOADER_CACHE 1
+#endif
+#ifndef MLUA_FS_LOADER_CACHE_STRIP
+#define MLUA_FS_LOADER_CACHE_STRIP 0
+#endif
 
 static_assert(((MLUA_FS_LOADER_OFFSET) & (FLASH_SECTOR_SIZE - 1)) == 0,
               "MLUA_FS_LOADER_OFFSET must be a multiple of FLASH_SECTOR_SIZE");
@@ -60,30 +65,6 @@ static __attribute__((constructor)) void init(void) {
     mlua_fs_lfs_mount(fs);
 }
 
-typedef struct Loader {
-    void* buffer;
-    int file;
-    lua_Integer err;
-} Loader;
-
-static char const* load_block(lua_State* ls, void* buf, size_t* size) {
-    Loader* l = buf;
-    lua_getfield(ls, l->file, "read");
-    lua_pushvalue(ls, l->file);
-    lua_pushinteger(ls, sizeof(luaL_Buffer));
-    if (lua_pcall(ls, 2, 3, 0) != LUA_OK) {
-        l->err = MLUA_EIO;
-        return lua_pop(ls, 1), NULL;
-    } else if (!lua_toboolean(ls, -3)) {
-        l->err = lua_tointeger(ls, -1);
-        return lua_pop(ls, 3), NULL;
-    }
-    char const* data = lua_tolstring(ls, -3, size);
-    memcpy(l->buffer, data, *size);
-    lua_pop(ls, 3);
-    return l->buffer;
-}
-
 static int mod_search(lua_State* ls) {
     size_t len;
     char const* mod = luaL_checklstring(ls, 1, &len);
@@ -116,47 +97,34 @@ static int mod_search(lua_State* ls) {
         char* sep = strchr(path, *LUA_PATH_SEP);
         *sep = '\0';
 
-        // Try to open the file.
-        lua_getfield(ls, fs_index, "open");
+        // Try to load the file.
+        lua_getfield(ls, fs_index, "load");
         lua_pushvalue(ls, fs_index);
         lua_pushstring(ls, path);
-        lua_pushinteger(ls, MLUA_FS_O_RDONLY);
-        if (lua_pcall(ls, 3, 2, 0) != LUA_OK) {  // open() raised an error
+        lua_pushnil(ls);
+        lua_pushboolean(ls, MLUA_FS_LOADER_CACHE);
+        lua_pushboolean(ls, MLUA_FS_LOADER_CACHE_STRIP);
+        if (lua_pcall(ls, 5, 3, 0) != LUA_OK) {  // load() raised an error
             err = lua_pushfstring(ls, "%s%s%s: %s", err, esep, path,
                                   lua_tostring(ls, -1));
             lua_replace(ls, fs_index + 1);
             esep = "\n\t";
             lua_pop(ls, 1);
-        } else if (!lua_toboolean(ls, -2)) {  // open() failed
+        } else if (!lua_isnil(ls, -3)) {  // load() succeeded
+            lua_pop(ls, 2);
+            lua_pushstring(ls, path);
+            return 2;
+        } else if (lua_isnil(ls, -1)) {  // The file failed to compile
+            return lua_pop(ls, 1), 1;
+        } else {  // load() failed
             err = lua_pushfstring(ls, "%s%s%s: %s", err, esep, path,
-                                  lua_tostring(ls, -1));
+                                  lua_tostring(ls, -2));
             lua_replace(ls, fs_index + 1);
             esep = "\n\t";
-            lua_pop(ls, 2);
-        } else {  // open() succeeded
-            lua_pop(ls, 1);
-            lua_replace(ls, fs_index + 1);
-            lua_pushstring(ls, path);
-            lua_replace(ls, fs_index + 2);
-            lua_settop(ls, fs_index + 2);  // Closes buf
-            lua_toclose(ls, fs_index + 1);
-            break;
+            lua_pop(ls, 3);
         }
         path = sep + 1;
     }
-
-    // Load the module from the file. Re-use buf as a data buffer.
-    Loader l = {.buffer = &buf, .file = fs_index + 1, .err = MLUA_EOK};
-    lua_pushfstring(ls, "@%s", lua_tostring(ls, fs_index + 2));
-    if (lua_load(ls, &load_block, &l, lua_tostring(ls, -1), NULL) != LUA_OK) {
-        return 1;
-    } else if (l.err != MLUA_EOK) {
-        lua_pop(ls, 2);
-        return lua_pushfstring(ls, "%s: %s", lua_tostring(ls, fs_index + 2),
-                               mlua_err_msg(l.err)), 1;
-    }
-    lua_pushvalue(ls, fs_index + 2);
-    return 2;
 }
 
 MLUA_SYMBOLS(module_syms) = {
@@ -53,6 +53,8 @@ function test_loading(t)
     local m, p = require(prefix .. '.a')
     t:expect(t.expr(m).value):eq('a')
     t:expect(p):label("a.path"):eq(('/lua/%s.a.lua'):format(prefix))
+    t:expect(t.expr(loader.fs):stat(('/lua/%s.a.luac'):format(prefix)))
+        :neq(nil)
 
     local m, p = require(prefix .. '.b')
     t:expect(t.expr(m).value):eq('b')
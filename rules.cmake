@@ -38,6 +38,21 @@ mlua_set(MLUA_FLOAT "FLOAT" CACHE STRING
     "The type of Lua numbers, one of (FLOAT, DOUBLE, LONGDOUBLE)")
 set_property(CACHE MLUA_FLOAT PROPERTY STRINGS FLOAT DOUBLE LONGDOUBLE)
 
+# Symbol table configuration.
+mlua_set(MLUA_SYMBOL_HASH "byte" CACHE STRING
+    "The hash function of hashed symbol tables, one of (byte, word)")
+set_property(CACHE MLUA_SYMBOL_HASH PROPERTY STRINGS byte word)
+
+# Lua module compilation.
+mlua_set(MLUA_STRIP_LUA "OFF" CACHE BOOL
+    "Strip debug information from compiled Lua modules by default")
+mlua_set(MLUA_COMPRESS_LUA "OFF" CACHE BOOL
+    "Compress compiled Lua modules by default")
+mlua_set(MLUA_OPTIMIZE_LUA "OFF" CACHE BOOL
+    "Optimize Lua modules at build time by default")
+mlua_set(MLUA_OPTIMIZE_LUA_NOASSERT "OFF" CACHE BOOL
+    "Remove assert() statements when optimizing Lua modules")
+
 # Fennel compiler configuration.
 mlua_set(MLUA_FENNEL "fennel" CACHE PATH "Path to the fennel compiler")
 
@@ -134,6 +149,8 @@ function(mlua_add_gen_target TARGET PREFIX SCOPE)
     mlua_num_target(gtarget "${PREFIX}")
     add_custom_target("${gtarget}" DEPENDS "${ARGN}")
     add_dependencies("${TARGET}" "${gtarget}")
+    set_property(TARGET "${TARGET}" APPEND PROPERTY MLUA_GEN_TARGETS
+                 "${gtarget}")
     target_sources("${TARGET}" "${SCOPE}" "${ARGN}")
 endfunction()
 
@@ -188,10 +205,12 @@ function(mlua_add_c_module TARGET)
             DEPENDS mlua_tool_gen "${src}"
             OUTPUT "${output}"
             COMMAND mlua_tool_gen
-                "cmod" "${src}" "${output}"
+                "cmod" "${src}" "${output}" HASH "${MLUA_SYMBOL_HASH}"
             VERBATIM
         )
         mlua_add_gen_target("${TARGET}" mlua_gen_c INTERFACE "${output}")
+        set_property(TARGET "${TARGET}" APPEND PROPERTY MLUA_REQUIRE_SOURCES
+                     "${src}")
     endforeach()
     target_link_libraries("${TARGET}" INTERFACE mlua_core mlua_core_main)
 endfunction()
@@ -206,45 +225,96 @@ function(mlua_add_header_module TARGET MOD SRC)
     add_custom_command(
         COMMENT "Generating $<PATH:RELATIVE_PATH,${output},${CMAKE_BINARY_DIR}>"
         DEPENDS mlua_tool_gen "${SRC}" "${template}"
-        OUTPUT "${output}"
+        OUTPUT "${output}" "${output}.consts"
         COMMAND "${CMAKE_C_COMPILER}" -E -dD
             "$<$<BOOL:${incdirs}>:-I$<JOIN:${incdirs},;-I>>"
             -o "${output}.syms" "${SRC}"
         COMMAND mlua_tool_gen
             "headermod" "${MOD}" "${SRC}" "${output}.syms" "${template}"
             "${output}" EXCLUDE "${args_EXCLUDE}" STRIP "${args_STRIP}"
-            TYPES "${args_TYPES}"
+            TYPES "${args_TYPES}" CONSTS "${output}.consts"
+            HASH "${MLUA_SYMBOL_HASH}"
         COMMAND_EXPAND_LISTS
         VERBATIM
     )
     mlua_add_gen_target("${TARGET}" mlua_gen_header INTERFACE "${output}")
+    set_property(TARGET "${TARGET}" PROPERTY MLUA_CONSTS "${output}.consts")
     target_link_libraries("${TARGET}" INTERFACE mlua_core mlua_core_main)
 endfunction()
 
 function(mlua_add_lua_modules TARGET)
     mlua_add_library("${TARGET}")
     set(compile 1)
+    set(strip "${MLUA_STRIP_LUA}")
+    set(compress "${MLUA_COMPRESS_LUA}")
+    set(optimize "${MLUA_OPTIMIZE_LUA}")
+    set(consts "$<TARGET_GENEX_EVAL:${TARGET},$<TARGET_PROPERTY:${TARGET},MLUA_CONSTS>>")
+    set(consts_deps "$<TARGET_GENEX_EVAL:${TARGET},$<TARGET_PROPERTY:${TARGET},MLUA_CONSTS_DEPS>>")
     foreach(SRC IN LISTS ARGN)
         if(SRC STREQUAL "NOCOMPILE")
             set(compile 0)
             continue()
+        elseif(SRC STREQUAL "STRIP")
+            set(strip ON)
+            continue()
+        elseif(SRC STREQUAL "NOSTRIP")
+            set(strip OFF)
+            continue()
+        elseif(SRC STREQUAL "COMPRESS")
+            set(compress ON)
+            continue()
+        elseif(SRC STREQUAL "NOCOMPRESS")
+            set(compress OFF)
+            continue()
+        elseif(SRC STREQUAL "OPTIMIZE")
+            set(optimize ON)
+            continue()
+        elseif(SRC STREQUAL "NOOPTIMIZE")
+            set(optimize OFF)
+            continue()
         endif()
         cmake_path(ABSOLUTE_PATH SRC)
         cmake_path(GET SRC STEM LAST_ONLY MOD)
+        set_property(TARGET "${TARGET}" APPEND PROPERTY MLUA_REQUIRE_SOURCES
+                     "${SRC}")
         set(template "${MLUA_PATH}/core/module_lua.in.c")
         set(output "${CMAKE_CURRENT_BINARY_DIR}/${MOD}.c")
         if("${compile}")
+            set(outputs "${output}")
+            set(strip_args)
+            if("${strip}")
+                set(line_map "${CMAKE_CURRENT_BINARY_DIR}/${MOD}.lines")
+                list(APPEND outputs "${line_map}")
+                set(strip_args "STRIP" "${line_map}")
+            endif()
+            set(compress_args)
+            if("${compress}")
+                set(compress_args "COMPRESS" "lz")
+            endif()
+            set(opt_args)
+            set(opt_deps)
+            if("${optimize}")
+                set(opt_args "OPTIMIZE" "hoist" "fold")
+                if("${MLUA_OPTIMIZE_LUA_NOASSERT}")
+                    list(APPEND opt_args "noassert")
+                endif()
+                list(APPEND opt_args "CONSTS" "${consts}")
+                set(opt_deps "${consts}" "${consts_deps}")
+            endif()
             add_custom_command(
                 COMMENT "Generating $<PATH:RELATIVE_PATH,${output},${CMAKE_BINARY_DIR}>"
-                DEPENDS mlua_tool_gen "${SRC}" "${template}"
-                OUTPUT "${output}"
+                DEPENDS mlua_tool_gen "${SRC}" "${template}" ${opt_deps}
+                OUTPUT ${outputs}
                 COMMAND mlua_tool_gen
                     "luamod" "${MOD}" "${SRC}" "${template}" "${output}"
+                    ${strip_args} ${compress_args} ${opt_args}
+                COMMAND_EXPAND_LISTS
                 VERBATIM
             )
             mlua_add_gen_target("${TARGET}" mlua_gen_lua INTERFACE "${output}")
         else()
             set(INCBIN "1")
+            set(COMPRESS "0")
             configure_file("${template}" "${output}")
             set_source_files_properties("${output}" OBJECT_DEPENDS "${SRC}")
             target_sources("${TARGET}" INTERFACE "${output}")
@@ -253,6 +323,18 @@ function(mlua_add_lua_modules TARGET)
     target_link_libraries("${TARGET}" INTERFACE mlua_core mlua_core_main)
 endfunction()
 
+# Fold the integer constants of the given header modules into the optimized Lua
+# modules of TARGET.
+function(mlua_fold_constants TARGET)
+    foreach(dep IN LISTS ARGN)
+        set_property(TARGET "${TARGET}" APPEND PROPERTY MLUA_CONSTS
+                     "$<TARGET_PROPERTY:${dep},MLUA_CONSTS>")
+        set_property(TARGET "${TARGET}" APPEND PROPERTY MLUA_CONSTS_DEPS
+                     "$<TARGET_PROPERTY:${dep},MLUA_GEN_TARGETS>")
+    endforeach()
+    target_link_libraries("${TARGET}" INTERFACE ${ARGN})
+endfunction()
+
 function(mlua_add_fnl_modules TARGET)
     mlua_want_fennel()
     set(srcs)
@@ -271,6 +353,11 @@ function(mlua_add_fnl_modules TARGET)
         list(APPEND srcs "${output}")
     endforeach()
     mlua_add_lua_modules("${TARGET}" "${srcs}")
+    foreach(src IN LISTS ARGN)
+        cmake_path(ABSOLUTE_PATH src)
+        set_property(TARGET "${TARGET}" APPEND PROPERTY MLUA_REQUIRE_SOURCES
+                     "${src}")
+    endforeach()
 endfunction()
 
 # TARGET must be a binary target.
@@ -283,7 +370,8 @@ function(mlua_add_config_module TARGET)
         OUTPUT "${output}"
         COMMAND mlua_tool_gen
             "configmod" "mlua.config" "${template}" "${output}"
-            "$<TARGET_PROPERTY:${TARGET},mlua_config_symbols>"
+            HASH "${MLUA_SYMBOL_HASH}"
+            SYMBOLS "$<TARGET_PROPERTY:${TARGET},mlua_config_symbols>"
         COMMAND_EXPAND_LISTS
         VERBATIM
     )
@@ -306,6 +394,106 @@ function(mlua_add_executable TARGET)
     mlua_add_config_module("${TARGET}")
 endfunction()
 
+# Link only the modules of TARGET that can be reached from its main module.
+# Modules that are required dynamically must be listed after ALLOW.
+function(mlua_prune_modules TARGET)
+    cmake_parse_arguments(PARSE_ARGV 1 args "" "" "ALLOW")
+    set_property(TARGET "${TARGET}" APPEND PROPERTY MLUA_PRUNE_ALLOW
+                 ${args_ALLOW})
+    get_property(set TARGET "${TARGET}" PROPERTY MLUA_PRUNE SET)
+    if(NOT set)
+        set_property(TARGET "${TARGET}" PROPERTY MLUA_PRUNE ON)
+        # The module graph is only complete once all directories have been
+        # processed.
+        cmake_language(EVAL CODE "
+            cmake_language(DEFER DIRECTORY [[${CMAKE_SOURCE_DIR}]]
+                CALL mlua_prune_modules_deferred [[${TARGET}]])
+        ")
+    endif()
+endfunction()
+
+# Return the names of the modules required by a Lua, Fennel or C source file.
+function(mlua_scan_requires VAR SRC)
+    cmake_path(GET SRC EXTENSION LAST_ONLY ext)
+    if(ext STREQUAL ".fnl")
+        set(re "\\(require[ \t\r\n]+[:\"]([A-Za-z0-9_.-]+)")
+    elseif(ext STREQUAL ".c")
+        set(re "mlua_require\\([A-Za-z0-9_]+,[ \t\r\n]*\"([A-Za-z0-9_.-]+)\"")
+    else()
+        set(re "require[ \t\r\n]*\\(?[ \t\r\n]*['\"]([A-Za-z0-9_.-]+)['\"]")
+    endif()
+    file(READ "${SRC}" text)
+    string(REGEX MATCHALL "${re}" matches "${text}")
+    set(mods)
+    foreach(match IN LISTS matches)
+        string(REGEX REPLACE "${re}" "\\1" mod "${match}")
+        list(APPEND mods "${mod}")
+    endforeach()
+    list(REMOVE_DUPLICATES mods)
+    set("${VAR}" "${mods}" PARENT_SCOPE)
+endfunction()
+
+function(mlua_prune_modules_deferred TARGET)
+    get_target_property(libs "${TARGET}" LINK_LIBRARIES)
+    get_property(allow TARGET "${TARGET}" PROPERTY MLUA_PRUNE_ALLOW)
+    get_property(defs TARGET "${TARGET}" PROPERTY COMPILE_DEFINITIONS)
+    set(main "main")
+    foreach(def IN LISTS defs)
+        if(def MATCHES "^MLUA_MAIN_MODULE=(.+)$")
+            set(main "${CMAKE_MATCH_1}")
+        endif()
+    endforeach()
+
+    # Walk the dependency graph, starting from the main module, the allowed
+    # modules and the libraries that aren't modules. Both declared link
+    # dependencies and require() calls in module sources are followed.
+    set(queue)
+    foreach(lib IN LISTS libs)
+        if(NOT lib MATCHES "^mlua_mod_")
+            list(APPEND queue "${lib}")
+        endif()
+    endforeach()
+    foreach(mod IN LISTS main allow)
+        list(APPEND queue "mlua_mod_${mod}")
+    endforeach()
+    set(seen)
+    while(NOT "${queue}" STREQUAL "")
+        list(POP_FRONT queue tgt)
+        if(NOT TARGET "${tgt}" OR "${tgt}" IN_LIST seen)
+            continue()
+        endif()
+        list(APPEND seen "${tgt}")
+        get_target_property(deps "${tgt}" INTERFACE_LINK_LIBRARIES)
+        if(deps)
+            list(APPEND queue ${deps})
+        endif()
+        get_property(srcs TARGET "${tgt}" PROPERTY MLUA_REQUIRE_SOURCES)
+        foreach(src IN LISTS srcs)
+            if(EXISTS "${src}")
+                mlua_scan_requires(mods "${src}")
+                list(TRANSFORM mods PREPEND "mlua_mod_")
+                list(APPEND queue ${mods})
+            endif()
+        endforeach()
+    endwhile()
+
+    # Remove the unreachable modules from the link libraries.
+    set(kept)
+    set(pruned)
+    foreach(lib IN LISTS libs)
+        if(lib MATCHES "^mlua_mod_" AND NOT lib IN_LIST seen)
+            list(APPEND pruned "${lib}")
+        else()
+            list(APPEND kept "${lib}")
+        endif()
+    endforeach()
+    set_property(TARGET "${TARGET}" PROPERTY LINK_LIBRARIES "${kept}")
+    list(LENGTH pruned count)
+    list(TRANSFORM pruned REPLACE "^mlua_mod_" "")
+    list(JOIN pruned " " pruned)
+    message("${TARGET}: pruned ${count} unreachable modules: ${pruned}")
+endfunction()
+
 function(mlua_add_tool TARGET BIN)
     if(CMAKE_HOST_WIN32)
         string(APPEND BIN ".exe")
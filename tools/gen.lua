@@ -8,12 +8,15 @@
 --  - configmod: Generate a C module providing symbols defined in the build
 --    system.
 --  - headermod: Generate a C module providing the preprocessor symbols defined
---    by a header file.
---  - luamod: Generate a C module from a Lua source file.
+--    by a header file, and optionally a list of its integer constants.
+--  - luamod: Generate a C module from a Lua source file, optionally optimizing
+--    the source before compiling it, and compressing the compiled chunk.
 
 _ENV = module(...)
 
 local io = require 'io'
+local luaopt = require 'luaopt'
+local math = require 'math'
 local os = require 'os'
 local string = require 'string'
 local table = require 'table'
@@ -160,18 +163,76 @@ end
 -- just as well and is faster to compute (fewer 1 bits).
 local hash_mult = 0x13
 
--- Compute an FNV-1a style hash of the given key, with a specific seed value.
-local function hash(key, seed)
-    for i = 1, #key do
-        seed = (seed ~ key:byte(i)) * hash_mult
-    end
-    return seed & 0x7fffffff  -- Avoid negative numbers
+-- The multiplier of the word hash: 2^32 divided by the golden ratio.
+local word_hash_mult = 0x9e3779b1
+
+-- The hash functions, indexed by scheme. Each function takes the hash units of
+-- a key (see hash_units()), the length of the key and a seed value.
+local hashes = {
+    -- Compute an FNV-1a style hash of the key, one byte at a time.
+    byte = function(units, len, seed)
+        for i = 1, #units do seed = (seed ~ units[i]) * hash_mult end
+        return seed & 0x7fffffff  -- Avoid negative numbers
+    end,
+
+    -- Compute a hash of the key, one 32-bit word at a time.
+    word = function(units, len, seed)
+        seed = seed ~ len
+        for i = 1, #units do
+            seed = ((seed ~ units[i]) * word_hash_mult) & 0xffffffff
+            seed = seed ~ (seed >> 15)
+        end
+        return seed & 0x7fffffff
+    end,
+}
+
+-- Split a key into the units processed by the hash function of a scheme: bytes
+-- for "byte", and little-endian 32-bit words for "word", with the last word
+-- padded with zeroes.
+local function hash_units(key, scheme)
+    if scheme == 'byte' then return {key:byte(1, -1)} end
+    local units = {}
+    key = key .. ('\0'):rep(-#key % 4)
+    for i = 1, #key, 4 do table.insert(units, (('<I4'):unpack(key, i))) end
+    return units
 end
 
 -- Compute the perfect hash of a key with a set of parameters.
 local function perfect_hash(key, h)
-    return (h.g[hash(key, h.seed1) % #h.g + 1]
-            + h.g[hash(key, h.seed2) % #h.g + 1]) % h.nkeys
+    local hash, units = hashes[h.scheme], hash_units(key, h.scheme)
+    return (h.g[hash(units, #key, h.seed1) % #h.g + 1]
+            + h.g[hash(units, #key, h.seed2) % #h.g + 1]) % h.nkeys
+end
+
+-- Find the root of the tree containing vertex v in a union-find forest, halving
+-- the path along the way. Roots have no parent.
+local function find_root(parent, v)
+    while true do
+        local p = parent[v]
+        if not p then return v end
+        local pp = parent[p]
+        if not pp then return p end
+        parent[v] = pp
+        v = pp
+    end
+end
+
+-- Compute the edges of the graph for the given seeds, and check that the graph
+-- is acyclic. Cycles are detected incrementally with a union-find forest, so
+-- that most cyclic graphs are rejected after hashing only a fraction of the
+-- keys, and without building the graph. Returns true iff the graph is acyclic.
+local function find_edges(units, lens, hash, nv, seed1, seed2, v1s, v2s)
+    local parent = {}
+    for i = 1, #units do
+        local u, len = units[i], lens[i]
+        local v1 = hash(u, len, seed1) % nv + 1
+        local v2 = hash(u, len, seed2) % nv + 1
+        local r1, r2 = find_root(parent, v1), find_root(parent, v2)
+        if r1 == r2 then return false end  -- The edge closes a cycle
+        parent[r1] = r2
+        v1s[i], v2s[i] = v1, v2
+    end
+    return true
 end
 
 -- Perform the mapping step for the given keys. Returns the hash parameters.
@@ -181,7 +242,9 @@ end
 -- Z. J. Czech, G. Havas and B. S. Majewski,
 -- Information Processing Letters, 43(5):257-264, 1992
 -- https://citeseerx.ist.psu.edu/doc/10.1.1.51.5566
-local function find_perfect_hash(keys)
+local function find_perfect_hash(keys, scheme)
+    local hash = hashes[scheme]
+    if not hash then raise("unknown hash scheme: %s", scheme) end
     local nk = #keys  -- Number of keys
     -- Considering nv = c * nk:
     --  - c <= 1: Finding an acyclic graph is impossible.
@@ -195,27 +258,31 @@ local function find_perfect_hash(keys)
     local nv = nk < 100 and nk + 1 or nvmax  -- Number of vertices
     local seed1, seed2 = 1, 2  -- Hash seeds
 
-    -- Generate graphs from hash pairs until the assignment step succeeds, i.e.
-    -- the graph is acyclic.
-    local h, attempt = nil, 1
+    -- Split the keys into hash units once, as they are hashed on each attempt.
+    local units, lens = {}, {}
+    for i, key in ipairs(keys) do
+        units[i], lens[i] = hash_units(key, scheme), #key
+    end
+
+    -- Generate graphs from hash pairs until one is acyclic.
+    local v1s, v2s, attempt = {}, {}, 1
     while true do
         if attempt % 100 == 0 and nv < nvmax then nv = nv + 1 end
-        local g = new_graph(nv, nk)
-        for i, key in ipairs(keys) do
-            local v1, v2 = hash(key, seed1) % nv + 1, hash(key, seed2) % nv + 1
-            if v1 == v2 then goto next_attempt end  -- Graph is trivially cyclic
-            g:connect(v1, v2, i - 1)
-        end
-        if g:assign() then
-            h = {seed1 = seed1, seed2 = seed2, nkeys = #keys, g = g.g}
+        if find_edges(units, lens, hash, nv, seed1, seed2, v1s, v2s) then
             break
         end
-        ::next_attempt::
         seed1 = seed1 + 7
         seed2 = seed2 + 13
         attempt = attempt + 1
     end
 
+    -- Build the graph and perform the assignment step.
+    local g = new_graph(nv, nk)
+    for i = 1, nk do g:connect(v1s[i], v2s[i], i - 1) end
+    if not g:assign() then raise("cyclic graph") end
+    local h = {scheme = scheme, seed1 = seed1, seed2 = seed2, nkeys = nk,
+               g = g.g}
+
     -- Check the consistency of the hash.
     for i, key in ipairs(keys) do
         local kh = perfect_hash(key, h)
@@ -283,8 +350,9 @@ local function format_hash(suffix, name, h, out)
     local data, bits = pack_hash(h)
     check_packed_hash(h, data)
     table.insert(out,
-        ('}; MLUA_SYMBOLS_HASH_FN%s(%s, %s, %s, %s, %s, %s, '):format(
-            suffix, name, h.seed1, h.seed2, h.nkeys, bits, #h.g))
+        ('}; MLUA_SYMBOLS_HASH_FN%s(%s, %s, %s, %s, %s, %s, %s, '):format(
+            suffix, name, h.scheme == 'word' and 1 or 0, h.seed1, h.seed2,
+            h.nkeys, bits, #h.g))
     for i = 0, #data - 1 do
         table.insert(out, ('0x%02x,'):format(data[i + 1] or 0))
     end
@@ -293,8 +361,8 @@ end
 
 local max_syms = 1 << 16
 
--- Preprocess C a module source.
-local function preprocess_cmod(text)
+-- Preprocess a C module source, using the given symbol hash scheme.
+local function preprocess_cmod(text, scheme)
     local out, suffix, name, syms, seen = {}
     for line in lines(text) do
         table.insert(out, line)
@@ -311,7 +379,7 @@ local function preprocess_cmod(text)
                 if #syms > max_syms then
                     raise("too many symbols: got %s, max %s", #syms, max_syms)
                 end
-                local h = find_perfect_hash(syms)
+                local h = find_perfect_hash(syms, scheme)
                 table.remove(out)
                 format_hash(suffix, name, h, out)
                 suffix, name, syms, seen = nil
@@ -327,17 +395,26 @@ local function preprocess_cmod(text)
     return table.concat(out)
 end
 
+-- Return the symbol hash scheme selected by the HASH keyword argument.
+local function hash_scheme(kwargs)
+    local scheme = kwargs.HASH[1] or 'byte'
+    if not hashes[scheme] then raise("unknown hash scheme: %s", scheme) end
+    return scheme
+end
+
 -- Preprocess a C module source file.
 function cmd_cmod(args)
     local input, output = table.unpack(args, 1, 2)
-    write_file(output, preprocess_cmod(read_file(input)))
+    local kwargs = parse_kwargs({'HASH'}, slice(args, 3))
+    write_file(output, preprocess_cmod(read_file(input), hash_scheme(kwargs)))
 end
 
 -- Generate a C module providing symbols defined in the build system.
 function cmd_configmod(args)
     local mod, template, output = table.unpack(args, 1, 3)
+    local kwargs = parse_kwargs({'HASH', 'SYMBOLS'}, slice(args, 4))
     local syms = {}
-    for _, sym in ipairs(slice(args, 4)) do
+    for _, sym in ipairs(kwargs.SYMBOLS) do
         local name, typ, value = sym:match('^([^:]+):([^=]+)=(.*)$')
         if not name then raise("invalid symbol definition: %s", sym) end
         table.insert(syms,
@@ -345,7 +422,8 @@ function cmd_configmod(args)
     end
     local tmpl = read_file(template)
     local sub = {MOD = mod, SYMBOLS = table.concat(syms, '\n')}
-    write_file(output, preprocess_cmod(tmpl:gsub('@(%u+)@', sub)))
+    write_file(output, preprocess_cmod(tmpl:gsub('@(%u+)@', sub),
+                                       hash_scheme(kwargs)))
 end
 
 -- Parse type mapping.
@@ -384,7 +462,7 @@ local function parse_defines(text, excludes, strip, types)
         for _, it in ipairs(types) do
             local pat, typ, cast = table.unpack(it)
             if sv:match(pat) then
-                syms[sym] = {typ, cast, csym}
+                syms[sym] = {typ, cast, csym, val}
                 break
             end
         end
@@ -393,11 +471,38 @@ local function parse_defines(text, excludes, strip, types)
     return syms
 end
 
+-- Parse the value of a preprocessor symbol as an integer literal, and return
+-- the integer, or nil if the value isn't a plain integer literal.
+local function parse_int_literal(val)
+    val = val:gsub('%s+', '')
+    while true do
+        local inner = val:match('^%((.*)%)$') or val:match('^_u%((.*)%)$')
+        if not inner then break end
+        val = inner
+    end
+    local num = val:match('^(0[xX]%x+)[uUlL]*$')
+                or val:match('^([1-9]%d*)[uUlL]*$')
+                or val:match('^(0)[uUlL]*$')
+    return num and math.tointeger(tonumber(num))
+end
+
+-- Format the integer constants of a header module, for use by the optimizer.
+local function format_consts(mod, syms, names)
+    local out = {('module %s\n'):format(mod)}
+    for _, name in ipairs(names) do
+        local typ, cast, _, val = table.unpack(syms[name])
+        local v = typ == 'integer' and cast == '' and parse_int_literal(val)
+        if v then table.insert(out, ('%s %d\n'):format(name, v)) end
+    end
+    return table.concat(out)
+end
+
 -- Generate a C module providing the preprocessor symbols defined by a header
 -- file.
 function cmd_headermod(args)
     local mod, include, defines, template, output = table.unpack(args, 1, 5)
-    local kwargs = parse_kwargs({'EXCLUDE', 'STRIP', 'TYPES'}, slice(args, 6))
+    local kwargs = parse_kwargs(
+        {'EXCLUDE', 'STRIP', 'TYPES', 'CONSTS', 'HASH'}, slice(args, 6))
     local syms = parse_defines(read_file(defines), kwargs.EXCLUDE, kwargs.STRIP,
                                typemap(kwargs.TYPES))
     local names = {}
@@ -418,28 +523,247 @@ function cmd_headermod(args)
     local sub = {
         MOD = mod, INCLUDE = include, SYMBOLS = table.concat(symdefs, '\n'),
     }
-    write_file(output, preprocess_cmod(tmpl:gsub('@(%u+)@', sub)))
+    write_file(output, preprocess_cmod(tmpl:gsub('@(%u+)@', sub),
+                                       hash_scheme(kwargs)))
+    local consts_path = kwargs.CONSTS[1]
+    if consts_path then
+        write_file(consts_path, format_consts(mod, syms, names))
+    end
+end
+
+-- Encode a size in the format used by string.dump().
+local function dump_size(n)
+    local bytes = {(n & 0x7f) | 0x80}
+    n = n >> 7
+    while n > 0 do
+        table.insert(bytes, 1, n & 0x7f)
+        n = n >> 7
+    end
+    return string.char(table.unpack(bytes))
+end
+
+-- Return the position of the main function in a binary chunk.
+local function dump_main_pos(bin)
+    return 15 + bin:byte(14) + bin:byte(15) + 2
+end
+
+-- Parse a binary chunk and return the line ranges of its functions, as a list
+-- of {linedefined, lastlinedefined} pairs.
+local function dump_functions(bin)
+    local si, sn, pos = bin:byte(14), bin:byte(15), dump_main_pos(bin)
+    local function skip(n) pos = pos + n end
+    local function byte()
+        pos = pos + 1
+        return bin:byte(pos - 1)
+    end
+    local function size()
+        local v = 0
+        while true do
+            local b = byte()
+            v = (v << 7) | (b & 0x7f)
+            if b & 0x80 ~= 0 then return v end
+        end
+    end
+    local function str()
+        local n = size()
+        if n > 0 then skip(n - 1) end
+    end
+    local funcs = {}
+    local function func()
+        str()  -- source
+        table.insert(funcs, {size(), size()})
+        skip(3)  -- numparams, is_vararg, maxstacksize
+        skip(size() * bin:byte(13))  -- code
+        for _ = 1, size() do  -- constants
+            local typ = byte()
+            if typ == 0x03 then skip(si)
+            elseif typ == 0x13 then skip(sn)
+            elseif typ == 0x04 or typ == 0x14 then str() end
+        end
+        skip(size() * 3)  -- upvalues
+        for _ = 1, size() do func() end  -- protos
+        skip(size())  -- lineinfo
+        for _ = 1, size() do size() size() end  -- abslineinfo
+        for _ = 1, size() do str() size() size() end  -- locvars
+        for _ = 1, size() do str() end  -- upvalue names
+    end
+    func()
+    return funcs
+end
+
+-- Format the line map of a stripped module, mapping function definition lines
+-- to their line range and source text.
+local function format_line_map(mod, src, bin)
+    local srclines = {}
+    for line in lines(src) do table.insert(srclines, line) end
+    local out, seen = {('module %s\n'):format(mod)}, {}
+    for _, f in ipairs(dump_functions(bin)) do
+        local first, last = table.unpack(f)
+        if not seen[first] then
+            seen[first] = true
+            local text = (srclines[first] or ''):match('^%s*(.-)%s*$')
+            table.insert(out, ('%d %d %s\n'):format(first, last, text))
+        end
+    end
+    return table.concat(out)
+end
+
+-- The parameters of the LZ format of compressed modules. They must match the
+-- decoder in core/module.c.
+local lz_window_bits = 10
+local lz_window = 1 << lz_window_bits
+local lz_len_bits = 16 - lz_window_bits
+local lz_min_match = 3
+local lz_max_match = (1 << lz_len_bits) - 1 + lz_min_match
+local lz_max_chain = 64
+
+-- Convert a list of bytes to a string.
+local function bytes_to_string(bytes)
+    local out = {}
+    for i = 1, #bytes, 4096 do
+        table.insert(out, string.char(table.unpack(bytes, i,
+                                                   math.min(i + 4095, #bytes))))
+    end
+    return table.concat(out)
+end
+
+-- Compress data with an LZ77 format that can be decompressed incrementally
+-- with a small window. The output is a sequence of groups, each consisting of
+-- a flags byte followed by up to 8 tokens. A cleared flag bit denotes a literal
+-- byte, and a set bit a match, encoded in two big-endian bytes as the offset
+-- minus one, followed by the length minus the minimum match length.
+local function compress_lz(data)
+    local n, b = #data, {}
+    for i = 1, n do b[i] = data:byte(i) end
+    local heads, prev = {}, {}  -- Hash chains of 3-byte prefixes
+    local function insert(i)
+        if i + 2 > n then return end
+        local k = (b[i] << 16) | (b[i + 1] << 8) | b[i + 2]
+        prev[i], heads[k] = heads[k], i
+    end
+    local out, fpos, nflags = {}, 0, 8
+    local function token(match, ...)
+        if nflags == 8 then
+            table.insert(out, 0)
+            fpos, nflags = #out, 0
+        end
+        if match then out[fpos] = out[fpos] | (1 << nflags) end
+        nflags = nflags + 1
+        for _, v in ipairs({...}) do table.insert(out, v) end
+    end
+    local i = 1
+    while i <= n do
+        local len, off = 0, 0
+        if i + 2 <= n then
+            local max = math.min(lz_max_match, n - i + 1)
+            local j = heads[(b[i] << 16) | (b[i + 1] << 8) | b[i + 2]]
+            local chain = lz_max_chain
+            while j and i - j <= lz_window and chain > 0 do
+                local l = 0
+                while l < max and b[j + l] == b[i + l] do l = l + 1 end
+                if l > len then
+                    len, off = l, i - j
+                    if l == max then break end
+                end
+                j, chain = prev[j], chain - 1
+            end
+        end
+        if len >= lz_min_match then
+            local v = ((off - 1) << lz_len_bits) | (len - lz_min_match)
+            token(true, v >> 8, v & 0xff)
+            for k = i, i + len - 1 do insert(k) end
+            i = i + len
+        else
+            token(false, b[i])
+            insert(i)
+            i = i + 1
+        end
+    end
+    return bytes_to_string(out)
 end
 
--- Compile a Lua module and return the generated chunk as C array data.
-local function compile_lua(mod, src)
+-- Decompress data compressed with compress_lz().
+local function decompress_lz(data)
+    local out, pos, flags, nflags = {}, 1, 0, 0
+    while pos <= #data do
+        if nflags == 0 then
+            flags, nflags, pos = data:byte(pos), 8, pos + 1
+        else
+            if flags & 1 == 0 then
+                table.insert(out, data:byte(pos))
+                pos = pos + 1
+            else
+                local v = (data:byte(pos) << 8) | data:byte(pos + 1)
+                pos = pos + 2
+                local off = (v >> lz_len_bits) + 1
+                for _ = 1, (v & ((1 << lz_len_bits) - 1)) + lz_min_match do
+                    table.insert(out, out[#out + 1 - off])
+                end
+            end
+            flags, nflags = flags >> 1, nflags - 1
+        end
+    end
+    return bytes_to_string(out)
+end
+
+-- Compile a Lua module and return the generated chunk as C array data. If
+-- strip is true, debug information is stripped from the chunk, except for the
+-- source name, and the line map of the chunk is returned as well. If opts
+-- isn't empty, the source is optimized before compiling it. If compress is
+-- true, the chunk is compressed.
+local function compile_lua(mod, src, strip, opts, consts, compress)
     -- Compile the input file.
-    local chunk = assert(load(src, '@' .. mod))
-    local bin = string.dump(chunk)
+    local code = src
+    if next(opts) then code = luaopt.optimize(mod, src, opts, consts) end
+    local chunk = assert(load(code, '@' .. mod))
+    local bin, line_map = string.dump(chunk, strip)
+    if strip then
+        -- Restore the source name, so that tracebacks identify the module.
+        local pos = dump_main_pos(bin)
+        if bin:byte(pos) ~= 0x80 then
+            raise("%s: unexpected binary chunk format", mod)
+        end
+        local name = '@' .. mod
+        bin = bin:sub(1, pos - 1) .. dump_size(#name + 1) .. name
+              .. bin:sub(pos + 1)
+        line_map = format_line_map(mod, src, bin)
+    end
+    if compress then
+        local data = compress_lz(bin)
+        if decompress_lz(data) ~= bin then
+            raise("%s: compressed chunk inconsistency", mod)
+        end
+        bin = data
+    end
 
     -- Format the compiled chunk as C array data.
     local out = {}
     for i = 1, #bin do table.insert(out, ('0x%02x,'):format(bin:byte(i))) end
-    return table.concat(out)
+    return table.concat(out), line_map
 end
 
 -- Generate a C module from a Lua source file.
 function cmd_luamod(args)
     local mod, src, template, output = table.unpack(args, 1, 4)
-    local data = compile_lua(mod, read_file(src))
+    local kwargs = parse_kwargs({'STRIP', 'OPTIMIZE', 'CONSTS', 'COMPRESS'},
+                                slice(args, 5))
+    local line_map_path = kwargs.STRIP[1]
+    local codec = kwargs.COMPRESS[1]
+    if codec and codec ~= 'lz' then raise("unknown codec: %s", codec) end
+    local opts, consts = {}, {}
+    for _, opt in ipairs(kwargs.OPTIMIZE) do opts[opt] = true end
+    for _, path in ipairs(kwargs.CONSTS) do
+        if path ~= '' then luaopt.parse_consts(read_file(path), consts) end
+    end
+    local data, line_map = compile_lua(mod, read_file(src),
+                                       line_map_path ~= nil, opts, consts,
+                                       codec ~= nil)
     local tmpl = read_file(template)
-    local sub = {MOD = mod, DATA = data, INCBIN = '0'}
+    local sub = {
+        MOD = mod, DATA = data, INCBIN = '0', COMPRESS = codec and '1' or '0',
+    }
     write_file(output, tmpl:gsub('@(%u+)@', sub))
+    if line_map_path then write_file(line_map_path, line_map) end
 end
 
 -- Dispatch to the selected sub-command.
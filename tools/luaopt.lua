@@ -0,0 +1,485 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+-- Source-to-source optimization of Lua modules, applied before compilation.
+-- The transformations work on the token stream, and preserve line numbers, so
+-- that error locations and line maps remain valid.
+--
+--  - hoist: Hoist the lookups of standard library functions in loops into
+--    locals, initialized when entering the loop.
+--  - fold: Replace the integer constants of header modules with their values.
+--  - noassert: Remove assert() statements whose arguments don't contain
+--    function calls. This changes semantics if the assertions fail.
+
+_ENV = module(...)
+
+local string = require 'string'
+local table = require 'table'
+
+-- Raise an error without location information.
+local function raise(format, ...) return error(format:format(...), 0) end
+
+local keywords = {}
+for kw in ([[and break do else elseif end false for function goto if in local
+             nil not or repeat return then true until while]]):gmatch('%a+') do
+    keywords[kw] = true
+end
+
+local ops = {'...', '..', '==', '~=', '<=', '>=', '<<', '>>', '//', '::'}
+
+-- The standard library modules whose tables have no metatable, i.e. for which
+-- looking up a missing field returns nil instead of raising an error.
+local plain_modules = {
+    coroutine = true, debug = true, io = true, math = true, os = true,
+    package = true, string = true, table = true, utf8 = true,
+}
+
+-- The maximum number of lookups hoisted per loop.
+local max_hoisted = 16
+
+-- Return the end position of a long bracket starting at pos, or nil if there is
+-- no long bracket at pos.
+local function long_bracket(src, pos, name)
+    local eqs = src:match('^%[(=*)%[', pos)
+    if not eqs then return end
+    local _, e = src:find(']' .. eqs .. ']', pos + #eqs + 2, true)
+    if not e then raise("%s: unfinished long bracket", name) end
+    return e
+end
+
+-- Return the end position of a quoted string starting at pos.
+local function quoted_string(src, pos, name)
+    local q, i = src:sub(pos, pos), pos + 1
+    while true do
+        local p = src:find('[\\\n' .. q .. ']', i)
+        local c = p and src:sub(p, p)
+        if not p or c == '\n' then raise("%s: unfinished string", name) end
+        if c == q then return p end
+        -- Skip the escaped character, and the whitespace following \z.
+        i = p + 2
+        if src:sub(p + 1, p + 1) == 'z' then
+            i = src:find('[^%s]', i) or #src + 1
+        end
+    end
+end
+
+-- Return the end position of a number starting at pos.
+local function number(src, pos)
+    local exp = src:match('^0[xX]', pos) and '[pP]' or '[eE]'
+    local i = pos
+    while true do
+        local c = src:sub(i, i)
+        if c:match(exp) and src:match('^[+-]', i + 1) then i = i + 2
+        elseif c:match('[%w%.]') then i = i + 1
+        else return i - 1 end
+    end
+end
+
+-- Split a Lua source into tokens. Each token is a table {type, text}, where
+-- type is one of 'ws' (whitespace and comments), 'name', 'keyword', 'number',
+-- 'string' or 'op'.
+function tokenize(src, name)
+    local toks, pos = {}, 1
+    local function add(typ, e)
+        table.insert(toks, {typ, src:sub(pos, e)})
+        pos = e + 1
+    end
+    while pos <= #src do
+        local e = select(2, src:find('^%s+', pos))
+        if e then add('ws', e) goto continue end
+        if src:match('^%-%-', pos) then
+            e = long_bracket(src, pos + 2, name)
+                or select(2, src:find('^[^\n]*', pos))
+            add('ws', e)
+            goto continue
+        end
+        e = select(2, src:find('^[%a_][%w_]*', pos))
+        if e then
+            add(keywords[src:sub(pos, e)] and 'keyword' or 'name', e)
+            goto continue
+        end
+        if src:match('^%.?%d', pos) then add('number', number(src, pos))
+            goto continue
+        end
+        if src:match('^["\']', pos) then
+            add('string', quoted_string(src, pos, name))
+            goto continue
+        end
+        e = long_bracket(src, pos, name)
+        if e then add('string', e) goto continue end
+        for _, op in ipairs(ops) do
+            if src:sub(pos, pos + #op - 1) == op then
+                add('op', pos + #op - 1)
+                goto continue
+            end
+        end
+        add('op', pos)
+        ::continue::
+    end
+    return toks
+end
+
+-- Return the source text of a token list.
+function concat(toks)
+    local parts = {}
+    for i, tok in ipairs(toks) do parts[i] = tok[2] end
+    return table.concat(parts)
+end
+
+local Source = {}
+Source.__index = Source
+
+-- Create a source from a token list. The significant (i.e. non-whitespace)
+-- tokens are indexed separately, and the block structure is analyzed.
+local function new_source(toks, name)
+    local self = setmetatable({toks = toks, name = name, sig = {}}, Source)
+    for i, tok in ipairs(toks) do
+        if tok[1] ~= 'ws' then table.insert(self.sig, i) end
+    end
+    self:analyze()
+    return self
+end
+
+-- Return the type and text of the significant token at index i.
+function Source:tok(i)
+    local tok = self.toks[self.sig[i]]
+    if tok then return tok[1], tok[2] end
+end
+
+-- Return true iff the significant token at index i is the given operator or
+-- keyword.
+function Source:is(i, text)
+    local typ, t = self:tok(i)
+    return t == text and (typ == 'op' or typ == 'keyword')
+end
+
+-- Set the text of the significant token at index i.
+function Source:set(i, text) self.toks[self.sig[i]][2] = text end
+
+-- Analyze the block structure of the source. Compute the function nesting
+-- depth of each significant token, and the extent of loops.
+function Source:analyze()
+    local depth, stack, loops = {}, {}, {}
+    local fdepth = 0
+    for i = 1, #self.sig do
+        local typ, text = self:tok(i)
+        depth[i] = fdepth
+        if typ ~= 'keyword' then goto continue end
+        if text == 'function' then
+            fdepth = fdepth + 1
+            table.insert(stack, {kind = 'function'})
+        elseif text == 'if' or text == 'repeat' then
+            table.insert(stack, {kind = text})
+        elseif text == 'for' or text == 'while' then
+            table.insert(stack, {kind = 'loop', start = i, fdepth = fdepth})
+        elseif text == 'do' then
+            local top = stack[#stack]
+            if top and top.kind == 'loop' and not top.body then
+                top.body = i
+            else
+                table.insert(stack, {kind = 'do'})
+            end
+        elseif text == 'end' or text == 'until' then
+            local top = table.remove(stack)
+            if not top or (text == 'until') ~= (top.kind == 'repeat') then
+                raise("%s: unbalanced block at '%s'", self.name, text)
+            end
+            if top.kind == 'function' then
+                fdepth = fdepth - 1
+            elseif top.kind == 'loop' then
+                top.stop = i
+                table.insert(loops, top)
+            end
+        end
+        ::continue::
+    end
+    if #stack > 0 then raise("%s: unbalanced blocks", self.name) end
+    self.depth, self.loops = depth, loops
+end
+
+-- Return true iff the significant token at index i is a name that isn't a
+-- field or method name.
+function Source:is_var(i)
+    return self:tok(i) == 'name' and not (self:is(i - 1, '.')
+                                          or self:is(i - 1, ':'))
+end
+
+-- Return true iff the field access starting at index i may be the target of an
+-- assignment, i.e. if it is followed by '=' or by a list of variables followed
+-- by '='. This is conservative, and may return true for reads.
+function Source:may_assign(i)
+    i = i + 2
+    if self:is(i, '=') then return true end
+    if not self:is(i, ',') then return false end
+    local prev
+    while true do
+        local typ, text = self:tok(i)
+        if typ == nil then return false end
+        if text == '=' and typ == 'op' then return true end
+        if typ == 'name' then
+            if prev == 'name' then return false end
+        elseif text == '[' or text == '(' then
+            local close, level = text == '[' and ']' or ')', 0
+            repeat
+                local _, t = self:tok(i)
+                if t == text then level = level + 1
+                elseif t == close then level = level - 1 end
+                i = i + 1
+            until level == 0 or self:tok(i) == nil
+            i = i - 1
+        elseif text ~= '.' and text ~= ',' and text ~= ':' then
+            return false
+        end
+        prev = typ
+        i = i + 1
+    end
+end
+
+local call_next = {
+    ['.'] = true, [':'] = true, ['['] = true, ['('] = true, ['{'] = true,
+}
+
+local stmt_start = {
+    ['local'] = true, ['function'] = true, ['if'] = true, ['for'] = true,
+    ['while'] = true, ['do'] = true, ['repeat'] = true, ['return'] = true,
+    ['goto'] = true, ['break'] = true, ['end'] = true, ['until'] = true,
+    ['else'] = true, ['elseif'] = true, [';'] = true, ['::'] = true,
+}
+
+-- Return the name of the module required by the expression starting at index
+-- i, if the expression is exactly require 'name' or require('name').
+function Source:required_module(i)
+    if select(2, self:tok(i)) ~= 'require' or not self:is_var(i) then return end
+    local paren = self:is(i + 1, '(')
+    local j = paren and i + 2 or i + 1
+    local typ, text = self:tok(j)
+    if typ ~= 'string' or not text:match('^["\']') then return end
+    if paren then
+        if not self:is(j + 1, ')') then return end
+        j = j + 1
+    end
+    local ntyp, ntext = self:tok(j + 1)
+    if not (ntyp == nil or ntyp == 'name' or stmt_start[ntext]) then return end
+    return load('return ' .. text)()
+end
+
+-- Find the module locals, i.e. the top-level locals initialized with
+-- require 'name', and return a map from local name to module name. Locals that
+-- are used other than for reading fields are excluded.
+function Source:module_locals()
+    local mods, decls = {}, {}
+    for i = 1, #self.sig do
+        if self.depth[i] == 0 and self:is(i, 'local')
+                and self:tok(i + 1) == 'name' and self:is(i + 2, '=') then
+            local mod = self:required_module(i + 3)
+            if mod then
+                local _, name = self:tok(i + 1)
+                if mods[name] ~= nil then mods[name] = false
+                else mods[name], decls[i + 1] = mod, true end
+            end
+        end
+    end
+    for i = 1, #self.sig do
+        local _, text = self:tok(i)
+        if mods[text] and not decls[i] and self:is_var(i)
+                and not (self:is(i + 1, '.') and self:tok(i + 2) == 'name'
+                         and not self:may_assign(i + 1)) then
+            mods[text] = false
+        end
+    end
+    for name, mod in pairs(mods) do
+        if not mod then mods[name] = nil end
+    end
+    return mods
+end
+
+-- Return the set of names used in the source.
+function Source:names()
+    local names = {}
+    for i = 1, #self.sig do
+        local typ, text = self:tok(i)
+        if typ == 'name' then names[text] = true end
+    end
+    return names
+end
+
+-- Hoist the lookups of plain module fields in loops into locals.
+function Source:hoist(mods)
+    local names = self:names()
+    local loops = self.loops
+    for _, loop in ipairs(loops) do
+        -- Only hoist at the outermost loop of each function.
+        for _, outer in ipairs(loops) do
+            if outer ~= loop and outer.fdepth == loop.fdepth
+                    and outer.start < loop.start and loop.stop < outer.stop then
+                goto next_loop
+            end
+        end
+        if select(2, self:tok(loop.start)) == '' then goto next_loop end
+        do
+            local locals, order, used = {}, {}, {}
+            for i = loop.start + 1, loop.stop - 1 do
+                local _, text = self:tok(i)
+                local mod = mods[text]
+                if self.depth[i] == loop.fdepth and mod and plain_modules[mod]
+                        and self:is_var(i) then
+                    local _, field = self:tok(i + 2)
+                    local key = text .. '.' .. field
+                    local name = locals[key]
+                    if not name and #order < max_hoisted then
+                        name = text .. '_' .. field
+                        local n = 1
+                        while names[name] or used[name] do
+                            name, n = ('%s_%s_%d'):format(text, field, n), n + 1
+                        end
+                        used[name], locals[key] = true, name
+                        table.insert(order, key)
+                    end
+                    if name then
+                        self:set(i, name)
+                        self:set(i + 1, '')
+                        self:set(i + 2, '')
+                    end
+                end
+            end
+            if #order > 0 then
+                local lhs = {}
+                for j, key in ipairs(order) do lhs[j] = locals[key] end
+                self:set(loop.start, ('do local %s = %s; %s'):format(
+                    table.concat(lhs, ', '), table.concat(order, ', '),
+                    select(2, self:tok(loop.start))))
+                self:set(loop.stop, 'end end')
+            end
+        end
+        ::next_loop::
+    end
+end
+
+-- Format an integer constant as a Lua expression.
+local function format_const(v)
+    if v < 0 then return ('(%d)'):format(v) end
+    return ('(0x%x)'):format(v)
+end
+
+-- Replace the fields of module locals that are known constants with their
+-- values.
+function Source:fold(mods, consts)
+    for i = 1, #self.sig do
+        local _, text = self:tok(i)
+        local mod = mods[text]
+        local values = mod and consts[mod]
+        if values and self:is_var(i) then
+            local _, field = self:tok(i + 2)
+            local v = values[field]
+            if v then
+                self:set(i, format_const(v))
+                self:set(i + 1, '')
+                self:set(i + 2, '')
+            end
+        end
+    end
+end
+
+local stmt_prev = {
+    [';'] = true, [')'] = true, [']'] = true, ['}'] = true, ['::'] = true,
+    ['do'] = true, ['then'] = true, ['else'] = true, ['end'] = true,
+    ['repeat'] = true, ['break'] = true, ['true'] = true, ['false'] = true,
+    ['nil'] = true, ['...'] = true,
+}
+
+-- Return true iff the tokens between indexes first and last may contain a
+-- function call or a function definition.
+function Source:has_call(first, last)
+    for i = first, last do
+        local typ, text = self:tok(i)
+        if text == '(' or text == ':' or text == '{' or text == 'function' then
+            return true
+        elseif typ == 'string' then
+            local ptyp, ptext = self:tok(i - 1)
+            if ptyp == 'name' or ptext == ')' or ptext == ']' then return true end
+        end
+    end
+    return false
+end
+
+-- Remove assert() statements whose arguments don't contain function calls.
+function Source:noassert()
+    -- Don't touch sources that use assert() other than by calling it.
+    for i = 1, #self.sig do
+        if select(2, self:tok(i)) == 'assert' and self:is_var(i)
+                and (self:is(i - 1, 'function') or not self:is(i + 1, '(')) then
+            return
+        end
+    end
+    local stmts = {}
+    for i = 1, #self.sig do
+        if select(2, self:tok(i)) ~= 'assert' or not self:is_var(i) then
+            goto continue
+        end
+        do
+            local ptyp, ptext = self:tok(i - 1)
+            if not (ptyp == nil or ptyp == 'name' or ptyp == 'number'
+                    or ptyp == 'string' or stmt_prev[ptext]) then
+                goto continue
+            end
+            local j, level = i + 1, 0
+            repeat
+                if self:is(j, '(') then level = level + 1
+                elseif self:is(j, ')') then level = level - 1 end
+                j = j + 1
+            until level == 0 or self:tok(j) == nil
+            local ntyp, ntext = self:tok(j)
+            if not (ntyp == 'string' or (ntyp == 'op' and call_next[ntext])
+                    or self:has_call(i + 2, j - 2)) then
+                table.insert(stmts, {i, j - 1})
+            end
+        end
+        ::continue::
+    end
+    for _, stmt in ipairs(stmts) do
+        -- Keep the line breaks, so that line numbers are preserved, and replace
+        -- the statement with an empty one, so that the surrounding statements
+        -- aren't merged.
+        local first, last = table.unpack(stmt)
+        for k = self.sig[first], self.sig[last] do
+            local tok = self.toks[k]
+            tok[2] = tok[2]:gsub('[^\n]+', '')
+        end
+        self:set(first, ';')
+    end
+end
+
+-- Parse a constants file, and add the constants to consts.
+function parse_consts(text, consts)
+    local values
+    for line in text:gmatch('[^\n]+') do
+        local mod = line:match('^module (%S+)$')
+        if mod then
+            values = {}
+            consts[mod] = values
+        else
+            local name, value = line:match('^(%S+) (%S+)$')
+            if not (values and name) then
+                raise("invalid constants file line: %s", line)
+            end
+            values[name] = tonumber(value)
+        end
+    end
+    return consts
+end
+
+-- Optimize the source of the Lua module mod, and return the optimized source.
+-- opts is a set of the transformations to apply, and consts maps header module
+-- names to tables of constants.
+function optimize(mod, src, opts, consts)
+    local toks = tokenize(src, mod)
+    local s = new_source(toks, mod)
+    local mods = s:module_locals()
+    if opts.noassert then s:noassert() end
+    if opts.fold then s:fold(mods, consts or {}) end
+    if opts.hoist then s:hoist(mods) end
+    local out = concat(toks)
+    local ok, err = load(out, '=' .. mod)
+    if not ok then raise("%s: invalid optimized source: %s", mod, err) end
+    return out
+end
@@ -0,0 +1,282 @@
+-- Copyright 2024 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+_ENV = module(...)
+
+local luaopt = require 'luaopt'
+local string = require 'string'
+local table = require 'table'
+
+-- Tokenize a source, and return the tokens formatted as "type:text".
+local function tokens(src)
+    local res = {}
+    for i, tok in ipairs(luaopt.tokenize(src, 'test')) do
+        res[i] = ('%s:%s'):format(tok[1], tok[2])
+    end
+    return table.concat(res, ' | ')
+end
+
+function test_tokenize(t)
+    for _, test in ipairs{
+        -- Names and keywords
+        {'local a_1 = nil', 'keyword:local | ws:  | name:a_1 | ws:  | op:= '
+                            .. '| ws:  | keyword:nil'},
+        {'goto continue ::continue::', 'keyword:goto | ws:  | name:continue '
+                                       .. '| ws:  | op::: | name:continue '
+                                       .. '| op:::'},
+        -- Operators
+        {'a//b..c...~=', 'name:a | op:// | name:b | op:.. | name:c | op:... '
+                         .. '| op:~='},
+        {'a.b:c[1]', 'name:a | op:. | name:b | op:: | name:c | op:[ '
+                     .. '| number:1 | op:]'},
+        -- Numerals
+        {'1 .5 3. 1e-3 1E+3 0x1p4 0XA.8P-1 0xe+1',
+         'number:1 | ws:  | number:.5 | ws:  | number:3. | ws:  '
+         .. '| number:1e-3 | ws:  | number:1E+3 | ws:  | number:0x1p4 | ws:  '
+         .. '| number:0XA.8P-1 | ws:  | number:0xe | op:+ | number:1'},
+        {'a..1', 'name:a | op:.. | number:1'},
+        -- Comments
+        {'a -- b\nc', 'name:a | ws:  | ws:-- b | ws:\n | name:c'},
+        {'a --[[ b\n]] c', 'name:a | ws:  | ws:--[[ b\n]] | ws:  | name:c'},
+        {'--[==[ ]] ]=] ]==]a', 'ws:--[==[ ]] ]=] ]==] | name:a'},
+        {'--[ a\nb', 'ws:--[ a | ws:\n | name:b'},
+        -- Strings
+        {[['a"b' "c'd"]], [[string:'a"b' | ws:  | string:"c'd"]]},
+        {[['a\'b\\' c]], [[string:'a\'b\\' | ws:  | name:c]]},
+        {'"a\\\nb"', 'string:"a\\\nb"'},
+        {'"a\\z\n   b"', 'string:"a\\z\n   b"'},
+        {'[[a]]b', 'string:[[a]] | name:b'},
+        {'[=[a]]b]=]', 'string:[=[a]]b]=]'},
+        {'a[ [[b]] ]', 'name:a | op:[ | ws:  | string:[[b]] | ws:  | op:]'},
+    } do
+        local src, want = table.unpack(test)
+        t:expect(tokens(src)):label("tokenize(%q)", src):eq(want)
+        t:expect(luaopt.concat(luaopt.tokenize(src, 'test')))
+            :label("concat(tokenize(%q))", src):eq(src)
+    end
+end
+
+function test_tokenize_errors(t)
+    for _, test in ipairs{
+        {"'abc", "test: unfinished string"},
+        {"'ab\nc'", "test: unfinished string"},
+        {'"ab\\', "test: unfinished string"},
+        {'[[abc', "test: unfinished long bracket"},
+        {'--[==[abc]]', "test: unfinished long bracket"},
+    } do
+        local src, want = table.unpack(test)
+        t:expect(t.expr(luaopt).tokenize(src, 'test')):raises(want)
+    end
+end
+
+-- Optimize a source with the given transformations.
+local function optimize(src, opts, consts)
+    local o = {}
+    for opt in opts:gmatch('%a+') do o[opt] = true end
+    return luaopt.optimize('test', src, o, consts)
+end
+
+function test_optimize_noop(t)
+    local src = [[
+local math = require 'math'
+for i = 1, 10 do
+    assert(math.abs(i) > 0)
+end
+]]
+    t:expect(optimize(src, '')):eq(src)
+end
+
+function test_optimize_errors(t)
+    for _, test in ipairs{
+        {'if a then', "test: unbalanced blocks"},
+        {'a() end', "test: unbalanced block at 'end'"},
+        {'repeat a() end', "test: unbalanced block at 'end'"},
+        {'do a() until b', "test: unbalanced block at 'until'"},
+    } do
+        local src, want = table.unpack(test)
+        t:expect(t.expr(luaopt).optimize('test', src, {})):raises(want)
+    end
+end
+
+function test_hoist(t)
+    for _, test in ipairs{
+        -- Lookups in loops are hoisted.
+        {[[
+local math = require 'math'
+local string = require('string')
+function f(n)
+    for i = 1, n do
+        g(math.abs(i), math.abs(-i), string.rep('a', i))
+    end
+end
+]], [[
+local math = require 'math'
+local string = require('string')
+function f(n)
+    do local math_abs, string_rep = math.abs, string.rep; for i = 1, n do
+        g(math_abs(i), math_abs(-i), string_rep('a', i))
+    end end
+end
+]]},
+        -- Only the outermost loop of each function is hoisted.
+        {[[
+local math = require 'math'
+while a do
+    repeat
+        b = math.max(b, c)
+    until b
+    local f = function() for i = 1, 2 do math.min(i, b) end end
+end
+]], [[
+local math = require 'math'
+do local math_max = math.max; while a do
+    repeat
+        b = math_max(b, c)
+    until b
+    local f = function() do local math_min = math.min; for i = 1, 2 do math_min(i, b) end end end
+end end
+]]},
+        -- Hoisted locals don't shadow existing names.
+        {[[
+local table = require 'table'
+local table_insert = 1
+for _, v in ipairs(a) do table.insert(b, v + table_insert) end
+]], [[
+local table = require 'table'
+local table_insert = 1
+do local table_insert_1 = table.insert; for _, v in ipairs(a) do table_insert_1(b, v + table_insert) end end
+]]},
+        -- Modules with metatables, and modules whose locals are assigned or
+        -- used other than for reading fields, aren't hoisted.
+        {[[
+local util = require 'mlua.util'
+local math = require 'math'
+local string = require 'string'
+local table = require 'table'
+math.pi = 3
+x, string.format = 1, nil
+for i = 1, 10 do
+    util.f(math.pi, string.format(i), table)
+end
+]]},
+        -- Locals that aren't initialized with a require call aren't modules.
+        {[[
+local math = require 'math'.x
+local string = require
+local table = require(name)
+for i = 1, 10 do math.abs(string.rep(table.concat(i))) end
+]]},
+        -- Locals declared in functions aren't modules.
+        {[[
+function f() local string = require 'string' end
+for i = 1, 10 do string.rep(i) end
+]]},
+    } do
+        local src, want = table.unpack(test)
+        t:expect(optimize(src, 'hoist')):label("hoist(%q)", src)
+            :eq(want or src)
+    end
+end
+
+function test_fold(t)
+    local consts = luaopt.parse_consts([[
+module hardware.regs.sio
+CPUID_OFFSET 0
+GPIO_IN_OFFSET 4
+SPINLOCK_ST_BITS 4294967295
+module test.neg
+NEG -12
+]], {})
+    for _, test in ipairs{
+        {[[
+local sio = require 'hardware.regs.sio'
+local neg = require 'test.neg'
+return sio.GPIO_IN_OFFSET + sio.CPUID_OFFSET,
+       sio.SPINLOCK_ST_BITS, sio.OTHER, neg.NEG, x.sio.CPUID_OFFSET
+]], [[
+local sio = require 'hardware.regs.sio'
+local neg = require 'test.neg'
+return (0x4) + (0x0),
+       (0xffffffff), sio.OTHER, (-12), x.sio.CPUID_OFFSET
+]]},
+        -- Constants of modules whose locals are shadowed or escape aren't
+        -- folded.
+        {[[
+local sio = require 'hardware.regs.sio'
+local sio = require 'hardware.regs.sio'
+return sio.CPUID_OFFSET
+]]},
+        {[[
+local sio = require 'hardware.regs.sio'
+f(sio)
+return sio.CPUID_OFFSET
+]]},
+    } do
+        local src, want = table.unpack(test)
+        t:expect(optimize(src, 'fold', consts)):label("fold(%q)", src)
+            :eq(want or src)
+    end
+end
+
+function test_noassert(t)
+    for _, test in ipairs{
+        -- Statements are removed, line breaks are kept.
+        {[[
+local a = 1
+assert(a > 0)
+assert(a ~= nil,
+       "a is nil")
+if a then assert(a) end
+return a
+]], [[
+local a = 1
+;
+;
+
+if a then ; end
+return a
+]]},
+        -- Assertions with function calls are kept.
+        {[[
+assert(f(a))
+assert(a:b())
+assert(a, {})
+assert(a, function() end)
+assert(a, f"x")
+]]},
+        -- Results of assert() that are used are kept.
+        {[[
+local a = assert(b)
+c(assert(b))
+assert(b):c()
+assert(b).c = 1
+assert(b)"c"
+]]},
+        -- Sources using assert() other than by calling it are unchanged.
+        {[[
+assert(a)
+local f = assert
+]]},
+        {[[
+local function assert() end
+assert(a)
+]]},
+    } do
+        local src, want = table.unpack(test)
+        t:expect(optimize(src, 'noassert')):label("noassert(%q)", src)
+            :eq(want or src)
+    end
+end
+
+function test_parse_consts(t)
+    local consts = luaopt.parse_consts('module a.b\nX 1\nY -2\n\nmodule c\n',
+                                       {d = {}})
+    t:expect(consts['a.b'].X):label("X"):eq(1)
+    t:expect(consts['a.b'].Y):label("Y"):eq(-2)
+    t:expect(next(consts.c)):label("next(c)"):eq(nil)
+    t:expect(consts.d):label("d"):neq(nil)
+    t:expect(t.expr(luaopt).parse_consts('X 1\n', {}))
+        :raises("invalid constants file line: X 1")
+    t:expect(t.expr(luaopt).parse_consts('module a\nX\n', {}))
+        :raises("invalid constants file line: X")
+end
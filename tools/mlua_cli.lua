@@ -361,8 +361,128 @@ local function cmd_fs(opts, args)
     if opts.device and not opts.output then write_flash_range(opts, out) end
 end
 
+-- Parse a heap snapshot, as returned by mlua.heap_snapshot.take(). Lines that
+-- aren't part of the snapshot are ignored, so that snapshots can be captured
+-- from a console log.
+local function parse_heap_snapshot(path)
+    local snap = {types = {}, objects = {}}
+    for line in read_file(path):gmatch('[^\r\n]+') do
+        local kind, rest = line:match('^(%w+) (.*)$')
+        if kind == 'heap' then
+            local count, size, nodes, status =
+                rest:match('^(%d+) (%d+) (%d+) (%w+)$')
+            if count then
+                snap.count, snap.size = tonumber(count), tonumber(size)
+                snap.truncated = status == 'truncated'
+            end
+        elseif kind == 'type' then
+            local name, count, size = rest:match('^(%w+) (%d+) (%d+)$')
+            if name then
+                snap.types[name] = {tonumber(count), tonumber(size)}
+            end
+        elseif kind == 'object' then
+            local typ, size, path = rest:match('^(%w+) (%d+) (.*)$')
+            if typ then snap.objects[typ .. ' ' .. path] = tonumber(size) end
+        elseif kind == 'table' then
+            local size, path = rest:match('^(%d+) %d+ %d+ (.*)$')
+            if size then snap.objects['table ' .. path] = tonumber(size) end
+        end
+    end
+    if not snap.count then raise("%s: no heap snapshot found", path) end
+    return snap
+end
+
+local function cmd_heap_diff(opts, args)
+    cli.parse_opts(opts, {})
+    if #args ~= 2 then raise("usage: heap-diff BEFORE AFTER") end
+    local before = parse_heap_snapshot(args[1])
+    local after = parse_heap_snapshot(args[2])
+    printf("%-12s %10s %10s %10s %10s\n", "", "count", "delta", "size",
+           "delta")
+    printf("%-12s %10d %+10d %10d %+10d\n", "heap", after.count,
+           after.count - before.count, after.size, after.size - before.size)
+    local names = list()
+    for name in pairs(after.types) do names:append(name) end
+    for name in pairs(before.types) do
+        if not after.types[name] then names:append(name) end
+    end
+    names:sort()
+    for _, name in names:ipairs() do
+        local b, a = before.types[name] or {0, 0}, after.types[name] or {0, 0}
+        printf("%-12s %10d %+10d %10d %+10d\n", name, a[1], a[1] - b[1], a[2],
+               a[2] - b[2])
+    end
+
+    -- Report objects by decreasing growth.
+    local keys = list()
+    for key, size in pairs(after.objects) do
+        if size ~= before.objects[key] then keys:append(key) end
+    end
+    for key in pairs(before.objects) do
+        if not after.objects[key] then keys:append(key) end
+    end
+    local function delta(key)
+        return (after.objects[key] or 0) - (before.objects[key] or 0)
+    end
+    keys:sort(function(a, b)
+        local da, db = delta(a), delta(b)
+        if da ~= db then return da > db end
+        return a < b
+    end)
+    if #keys > 0 then printf("\n") end
+    for _, key in keys:ipairs() do
+        local status = not before.objects[key] and '+'
+                       or not after.objects[key] and '-' or '~'
+        printf("%s %10d %+10d  %s\n", status, after.objects[key] or 0,
+               delta(key), key)
+    end
+    if before.truncated or after.truncated then
+        printf("\nWarning: truncated traversal, some paths are missing\n")
+    end
+end
+
+-- Parse a line map, as generated for stripped Lua modules, into the module
+-- name and a table mapping function definition lines to {last, text} pairs.
+local function parse_line_map(path)
+    local mod, funcs = nil, {}
+    for line in read_file(path):gmatch('[^\r\n]+') do
+        local name = line:match('^module (.*)$')
+        if name then
+            mod = name
+        else
+            local first, last, text = line:match('^(%d+) (%d+) ?(.*)$')
+            if first then funcs[tonumber(first)] = {tonumber(last), text} end
+        end
+    end
+    if not mod then raise("%s: not a line map", path) end
+    return mod, funcs
+end
+
+local function cmd_symbolize(opts, args)
+    cli.parse_opts(opts, {})
+    if #args == 0 then raise("usage: symbolize LINE_MAP...") end
+    local maps = {}
+    for _, path in ipairs(args) do
+        local mod, funcs = parse_line_map(path)
+        maps[mod] = funcs
+    end
+    -- Annotate function references in tracebacks read from stdin with the
+    -- line range and the first source line of the function.
+    for line in io.lines() do
+        line = line:gsub('<([^<>:]+):(%d+)>', function(mod, first)
+            local funcs = maps[mod]
+            local f = funcs and funcs[tonumber(first)]
+            if not f then return end
+            return ('<%s:%s-%d: %s>'):format(mod, first, f[1], f[2])
+        end)
+        printf("%s\n", line)
+    end
+end
+
 local commands = {
     fs = cmd_fs,
+    ['heap-diff'] = cmd_heap_diff,
+    symbolize = cmd_symbolize,
 }
 
 function main() return cli.run(arg, commands) end